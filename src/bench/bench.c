@@ -0,0 +1,910 @@
+/**
+ * Benchmarks for the card reader stack that run without the hardware
+ *
+ * Usage:
+ * ```
+ * bench sim [cycles]                         Tap cycles against the simulated reader
+ * bench record <trace> [cycles] [device]     Same, recorded to a trace file; with a
+ *                                            spidev device (e.g. /dev/spidev0.0) the
+ *                                            real reader is recorded, a card must lie on it
+ * bench replay <trace> [cycles]              Replay a recorded trace
+ * bench enum [cycles]                        Enumerate 1 to 4 simulated cards
+ * bench gain [attempts]                      Calibrate the receiver gain with a weak simulated card
+ * bench sector [cycles]                      Read 4 sectors block by block and pipelined
+ * bench latency [cycles]                     Tap-to-sound latency per stage, see latency.h
+ * bench lcd [updates] [snapshot]             Screen updates on the virtual LCD
+ * bench scan [directories] [workers]         Index a synthetic music tree
+ * ```
+ *
+ * A tap cycle is what the daemon does when a card shows up: wake up, select,
+ * authenticate, read the card id from block 8 and halt the card again. All
+ * timings are taken from the bus' clock, so they are virtual when simulated
+ * and the recorded ones when replaying.
+ *
+ * The enumeration benchmark measures mfrc522_picc_enumerate(), i.e. one poll
+ * of the daemon, with 1 to 4 cards with random UIDs in the field.
+ *
+ * The gain benchmark puts a card into the field that needs 36 dB to be heard,
+ * with noise drowning everything above 46 dB, and compares the read success
+ * and taps to play at the default gain with the calibrated one.
+ *
+ * The sector benchmark reads the 12 data blocks of sectors 1 to 4 from the
+ * simulated card three ways: authenticating for every block, authenticating
+ * once per sector and reading block by block, and mfrc522_mifare_read_sectors().
+ *
+ * The latency benchmark follows taps through the stages of latency.h the way
+ * the daemon does, from the poll that first sees the card to mpd playing.
+ * The database and mpd are not there, their stages take the fixed times
+ * BENCH_DB_LOOKUP_US, BENCH_MPD_COMMAND_US and BENCH_MPD_START_US.
+ *
+ * The LCD benchmark runs the LCD driver against the virtual HD44780 on a
+ * 100 kHz I2C bus and reports what the daemon's typical screen updates
+ * cost on the bus. It fails if the driver writes to the controller while
+ * it is still busy. The screen at the end is printed, or written to the
+ * snapshot file. Then it compares initializing the LCD reading the busy
+ * flag with timing the instructions, on a controller at the nominal and
+ * at a slow clock; only the latter may be overrun on the slow one.
+ *
+ * The scan benchmark creates a music tree of 100 artists with 10 albums
+ * each and discs below them, with two files per disc, in a temporary
+ * directory. It reads the tree the way the browser once did, recursing
+ * with opendir() and snprintf() into a path buffer per level, and with
+ * dir_scan() on 1 up to `workers` threads, best of BENCH_SCAN_RUNS. The
+ * tree is in the page cache after the first run, so this is what the CPU
+ * does, not the SD card.
+ *
+ * Build with `make bench`
+ *
+ * @package kiddyblaster
+ */
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../dir_scan.h"
+#include "../i2c_lcd.h"
+#include "../latency.h"
+#include "../lcd_sim.h"
+#include "../mfrc522.h"
+#include "../mfrc522_sim.h"
+#include "../rx_gain.h"
+#include "../spi_bus.h"
+
+#define BENCH_DEFAULT_CYCLES 100
+#define BENCH_SPI_SPEED 4000000
+
+// Assumed costs of the stages the simulation does not cover, in µs
+#define BENCH_DB_LOOKUP_US 2000         // Reading the card's file from the SD card
+#define BENCH_MPD_COMMAND_US 15000      // clear, add and play over the mpd socket
+#define BENCH_MPD_START_US 150000       // Decoder and audio output starting up
+
+#define BENCH_LCD_BUS_KHZ 100
+#define BENCH_LCD_OSC_KHZ 270           // The HD44780's nominal oscillator
+#define BENCH_LCD_SLOW_OSC_KHZ 190      // A slow one
+
+#define BENCH_SCAN_DIRECTORIES 100000
+#define BENCH_SCAN_ARTISTS 100
+#define BENCH_SCAN_ALBUMS 10            // Per artist
+#define BENCH_SCAN_FILES 2              // Per disc
+#define BENCH_SCAN_RUNS 5
+
+static Uid uid;
+
+static MIFARE_Key auth_key = {{ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }};
+
+typedef struct {
+    unsigned int cycles;
+    unsigned int failures;
+    uint64_t total_us;
+    uint64_t min_us;
+    uint64_t max_us;
+} BenchResult;
+
+
+
+static void usage() {
+    fprintf(stderr, "Usage: bench sim [cycles]\n");
+    fprintf(stderr, "       bench record <trace> [cycles] [spidev-device]\n");
+    fprintf(stderr, "       bench replay <trace> [cycles]\n");
+    fprintf(stderr, "       bench enum [cycles]\n");
+    fprintf(stderr, "       bench gain [attempts]\n");
+    fprintf(stderr, "       bench sector [cycles]\n");
+    fprintf(stderr, "       bench latency [cycles]\n");
+    fprintf(stderr, "       bench lcd [updates] [snapshot]\n");
+    fprintf(stderr, "       bench scan [directories] [workers]\n");
+}
+
+
+
+/**
+ * Put a card with id 42 in block 8 into the simulated field
+ */
+static SpiBus *new_sim_reader(SpiBus **sim) {
+    static const byte sim_uid[] = { 0xde, 0xad, 0xbe, 0xef };
+    byte block[16] = { 42, 0 };
+
+    *sim = mfrc522_sim_new();
+    SimTag *tag = mfrc522_sim_add_tag(*sim, SIM_TAG_MIFARE_1K, sim_uid, sizeof(sim_uid));
+    mfrc522_sim_tag_write(tag, 8, block, sizeof(block));
+    return *sim;
+}
+
+
+
+/**
+ * One tap: WUPA, select, authenticate, read block 8, halt
+ *
+ * @return int      The card id or -1 on failure
+ */
+static int tap_cycle() {
+    byte atqa[2];
+    byte size = sizeof(atqa);
+    byte data[16];
+    unsigned int len = sizeof(data);
+    byte result = mfrc522_picc_wakeup_a(atqa, &size);
+
+    if (result != STATUS_OK && result != STATUS_COLLISION) {
+        return -1;
+    }
+    if (mfrc522_picc_select(&uid, 0) != STATUS_OK) {
+        return -1;
+    }
+    if (mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, 8, &auth_key, &uid) != STATUS_OK) {
+        return -1;
+    }
+    result = mfrc522_mifare_read_blocks(8, 1, data, &len);
+    mfrc522_pcd_stop_crypto_1();
+    mfrc522_picc_halt_a();
+
+    return (result == STATUS_OK) ? data[0] + 256 * data[1] : -1;
+}
+
+
+
+static BenchResult run(SpiBus *bus, unsigned int cycles) {
+    BenchResult res;
+    unsigned int i;
+
+    memset(&res, 0, sizeof(res));
+    res.min_us = UINT64_MAX;
+
+    mfrc522_pcd_init();
+
+    for (i = 0; i < cycles; i++) {
+        uint64_t start = spi_bus_now(bus);
+        if (tap_cycle() < 0) {
+            res.failures++;
+        }
+        uint64_t elapsed = spi_bus_now(bus) - start;
+
+        res.total_us += elapsed;
+        if (elapsed < res.min_us) {
+            res.min_us = elapsed;
+        }
+        if (elapsed > res.max_us) {
+            res.max_us = elapsed;
+        }
+        res.cycles++;
+    }
+    return res;
+}
+
+
+
+static void report(const char *name, BenchResult *res) {
+    printf("%s: %u cycles, %u failed\n", name, res->cycles, res->failures);
+    if (res->cycles > 0) {
+        printf("  per cycle: mean %llu us, min %llu us, max %llu us\n",
+            (unsigned long long)(res->total_us / res->cycles),
+            (unsigned long long)res->min_us,
+            (unsigned long long)res->max_us
+        );
+    }
+}
+
+
+
+static void report_sim(SpiBus *sim, unsigned int cycles) {
+    Mfrc522SimStats stats = mfrc522_sim_get_stats(sim);
+    if (cycles == 0) {
+        return;
+    }
+    printf("  per cycle: %lu SPI transfers, %lu SPI frames, %lu SPI bytes, %lu RF exchanges, %lu timeouts\n",
+        stats.transfers / cycles, stats.frames / cycles, stats.bytes / cycles, stats.rf_exchanges / cycles, stats.timeouts / cycles
+    );
+}
+
+
+
+/**
+ * Enumerate `n_tags` cards with random UIDs, new ones for every cycle
+ */
+static BenchResult run_enum(unsigned int n_tags, unsigned int cycles) {
+    BenchResult res;
+    unsigned int i, j, k;
+
+    memset(&res, 0, sizeof(res));
+    res.min_us = UINT64_MAX;
+
+    for (i = 0; i < cycles; i++) {
+        SpiBus *sim = mfrc522_sim_new();
+        mfrc522_init(sim);
+        mfrc522_pcd_init();
+
+        for (j = 0; j < n_tags; j++) {
+            byte tag_uid[4];
+            for (k = 0; k < sizeof(tag_uid); k++) {
+                tag_uid[k] = rand();
+            }
+            if (tag_uid[0] == PICC_CMD_CT) {
+                tag_uid[0]++;
+            }
+            mfrc522_sim_add_tag(sim, SIM_TAG_MIFARE_1K, tag_uid, sizeof(tag_uid));
+        }
+
+        Uid found[MFRC522_SIM_MAX_TAGS];
+        uint64_t start = spi_bus_now(sim);
+        if (mfrc522_picc_enumerate(found, MFRC522_SIM_MAX_TAGS) != n_tags) {
+            res.failures++;
+        }
+        uint64_t elapsed = spi_bus_now(sim) - start;
+
+        res.total_us += elapsed;
+        if (elapsed < res.min_us) {
+            res.min_us = elapsed;
+        }
+        if (elapsed > res.max_us) {
+            res.max_us = elapsed;
+        }
+        res.cycles++;
+        mfrc522_close();
+    }
+    return res;
+}
+
+
+
+static void report_gain(const char *name, RxGainStats *stats) {
+    printf("%s: %d dB, %u/%u read (%u%%), %.2f taps to play\n",
+        name,
+        rx_gain_db(stats->gain),
+        stats->read_ok,
+        stats->attempts,
+        stats->attempts > 0 ? stats->read_ok * 100 / stats->attempts : 0,
+        rx_gain_taps_to_play(stats)
+    );
+}
+
+
+
+/**
+ * Measure the default gain, calibrate and measure the calibrated one
+ *
+ * @return int      The number of failed reads with the calibrated gain
+ */
+static int run_gain(unsigned int attempts) {
+    static const byte sim_uid[] = { 0xca, 0xfe, 0xba, 0xbe };
+    byte block[16] = { 42, 0 };
+    RxGainStats before, after;
+
+    SpiBus *sim = mfrc522_sim_new();
+    SimTag *tag = mfrc522_sim_add_tag(sim, SIM_TAG_MIFARE_1K, sim_uid, sizeof(sim_uid));
+    mfrc522_sim_tag_write(tag, 8, block, sizeof(block));
+    tag->signal_db = 36;
+    mfrc522_sim_set_noise(sim, 46);
+
+    mfrc522_init(sim);
+    mfrc522_pcd_init();
+
+    rx_gain_measure(RxGain_33dB, &auth_key, 8, attempts, &before);
+    int best = rx_gain_calibrate(&auth_key, 8, attempts, NULL);
+    if (best < 0) {
+        return attempts;
+    }
+    rx_gain_measure(best, &auth_key, 8, attempts, &after);
+
+    report_gain("before", &before);
+    report_gain("after", &after);
+    return after.attempts - after.read_ok;
+}
+
+
+
+typedef enum {
+    READ_AUTH_PER_BLOCK,
+    READ_AUTH_PER_SECTOR,
+    READ_PIPELINED
+} SectorReadMode;
+
+#define BENCH_FIRST_SECTOR 1
+#define BENCH_SECTORS 4
+
+/**
+ * Select the card and read the data blocks of BENCH_SECTORS sectors
+ *
+ * @return int      Number of bytes read, -1 on failure
+ */
+static int read_sectors(SectorReadMode mode, byte *buffer) {
+    byte atqa[2], data[18], size = sizeof(atqa);
+    unsigned int len = 0, s, b;
+    byte result = mfrc522_picc_wakeup_a(atqa, &size);
+
+    if ((result != STATUS_OK && result != STATUS_COLLISION) || mfrc522_picc_select(&uid, 0) != STATUS_OK) {
+        return -1;
+    }
+
+    if (mode == READ_PIPELINED) {
+        MIFARE_SectorKey keys[BENCH_SECTORS];
+        for (s = 0; s < BENCH_SECTORS; s++) {
+            keys[s].sector = BENCH_FIRST_SECTOR + s;
+            keys[s].key = auth_key;
+        }
+        len = BENCH_SECTORS * 48;
+        result = mfrc522_mifare_read_sectors(keys, BENCH_SECTORS, &uid, buffer, &len);
+    }
+    else {
+        for (s = BENCH_FIRST_SECTOR; s < BENCH_FIRST_SECTOR + BENCH_SECTORS; s++) {
+            for (b = s * 4; b < s * 4 + 3; b++) {
+                if (b == s * 4 || mode == READ_AUTH_PER_BLOCK) {
+                    result = mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, b, &auth_key, &uid);
+                    if (result != STATUS_OK) {
+                        break;
+                    }
+                }
+                size = sizeof(data);
+                if ((result = mfrc522_mifare_read(b, data, &size)) != STATUS_OK) {
+                    break;
+                }
+                memcpy(buffer + len, data, 16);
+                len += 16;
+            }
+            if (result != STATUS_OK) {
+                break;
+            }
+        }
+    }
+    mfrc522_pcd_stop_crypto_1();
+    mfrc522_picc_halt_a();
+
+    return result == STATUS_OK ? (int)len : -1;
+}
+
+
+
+static BenchResult run_sectors(SectorReadMode mode, unsigned int cycles, SpiBus **sim) {
+    static const byte sim_uid[] = { 0xde, 0xad, 0xbe, 0xef };
+    byte expected[BENCH_SECTORS * 48], buffer[BENCH_SECTORS * 48];
+    BenchResult res;
+    unsigned int i;
+
+    *sim = mfrc522_sim_new();
+    SimTag *tag = mfrc522_sim_add_tag(*sim, SIM_TAG_MIFARE_1K, sim_uid, sizeof(sim_uid));
+    for (i = 0; i < sizeof(expected); i++) {
+        expected[i] = i * 7;
+    }
+    for (i = 0; i < BENCH_SECTORS * 3; i++) {
+        byte block = (BENCH_FIRST_SECTOR + i / 3) * 4 + i % 3;
+        mfrc522_sim_tag_write(tag, block, expected + i * 16, 16);
+    }
+
+    memset(&res, 0, sizeof(res));
+    res.min_us = UINT64_MAX;
+    mfrc522_init(*sim);
+    mfrc522_pcd_init();
+
+    for (i = 0; i < cycles; i++) {
+        uint64_t start = spi_bus_now(*sim);
+        if (read_sectors(mode, buffer) != sizeof(buffer) || memcmp(buffer, expected, sizeof(buffer)) != 0) {
+            res.failures++;
+        }
+        uint64_t elapsed = spi_bus_now(*sim) - start;
+
+        res.total_us += elapsed;
+        if (elapsed < res.min_us) {
+            res.min_us = elapsed;
+        }
+        if (elapsed > res.max_us) {
+            res.max_us = elapsed;
+        }
+        res.cycles++;
+    }
+    return res;
+}
+
+
+
+static SpiBus *latency_bus;
+
+static uint64_t latency_bus_now() {
+    return spi_bus_now(latency_bus);
+}
+
+
+
+/**
+ * Follow taps of the simulated card through all stages and dump the
+ * histograms to syslog
+ *
+ * @return unsigned int     Number of failed taps
+ */
+static unsigned int run_latency(SpiBus *sim, unsigned int cycles) {
+    Uid found[4];
+    byte atqa[2], data[16], size;
+    unsigned int i, len, failures = 0;
+
+    latency_bus = sim;
+    latency_set_clock(latency_bus_now);
+    mfrc522_pcd_init();
+
+    for (i = 0; i < cycles; i++) {
+        latency_tap_start(latency_now());
+        mfrc522_picc_enumerate(found, 4);
+
+        size = sizeof(atqa);
+        byte result = mfrc522_picc_wakeup_a(atqa, &size);
+        if (result != STATUS_OK && result != STATUS_COLLISION) {
+            goto failed;
+        }
+        latency_tap_mark(LATENCY_REQA);
+        if (mfrc522_picc_select(&uid, 0) != STATUS_OK) {
+            goto failed;
+        }
+        latency_tap_mark(LATENCY_SELECT);
+        len = sizeof(data);
+        if (mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, 8, &auth_key, &uid) != STATUS_OK ||
+            mfrc522_mifare_read_blocks(8, 1, data, &len) != STATUS_OK) {
+            goto failed;
+        }
+        mfrc522_pcd_stop_crypto_1();
+        mfrc522_picc_halt_a();
+        latency_tap_mark(LATENCY_READ);
+
+        mfrc522_sim_advance(sim, BENCH_DB_LOOKUP_US);
+        latency_tap_mark(LATENCY_DB_LOOKUP);
+        mfrc522_sim_advance(sim, BENCH_MPD_COMMAND_US);
+        latency_tap_mark(LATENCY_MPD_COMMAND);
+        mfrc522_sim_advance(sim, BENCH_MPD_START_US);
+        latency_tap_mark(LATENCY_MPD_PLAYING);
+        continue;
+
+failed:
+        latency_tap_cancel();
+        mfrc522_pcd_stop_crypto_1();
+        failures++;
+    }
+    latency_dump();
+    return failures;
+}
+
+
+
+typedef enum {
+    LCD_UPDATE_REDRAW,      // Everything sent anew
+    LCD_UPDATE_TRACK,       // The next track's title
+    LCD_UPDATE_SHIFT,       // A long line moved by one character
+    LCD_UPDATE_WIFI,        // The signal strength icon
+    LCD_UPDATE_GLYPHS,      // More glyphs on screen than CGRAM slots
+    LCD_UPDATE_COUNT
+} LcdUpdate;
+
+static const char *lcd_update_names[LCD_UPDATE_COUNT] = {
+    "full redraw", "track change", "line shift", "wifi icon", "glyph churn"
+};
+
+static const char *lcd_titles[] = {
+    "Pippi Langstrumpf", "Die Olchis", "Der Grüffelo", "Räuber Hotzenplotz"
+};
+
+
+
+/**
+ * Put the i-th screen of an update on the LCD
+ */
+static void lcd_update(LcdUpdate update, unsigned int i) {
+    static const char *path = "Kinderlieder/Rolf Zuckowski/Winterkinder";
+    static const char *glyphs[] = { "pause", "play", "battery", "sleep", "repeat" };
+    char line[LCD_COLS + 1];
+    unsigned int n;
+
+    switch (update) {
+        case LCD_UPDATE_REDRAW:
+            lcd_refresh();
+            break;
+        case LCD_UPDATE_TRACK:
+            lcd_puts(LCD_LINE_2, lcd_titles[i % (sizeof(lcd_titles) / sizeof(*lcd_titles))]);
+            break;
+        case LCD_UPDATE_SHIFT:
+            n = strlen(path) - LCD_COLS + 1;
+            snprintf(line, sizeof(line), "%s", path + i % n);
+            lcd_puts(LCD_LINE_2, line);
+            break;
+        case LCD_UPDATE_WIFI:
+            lcd_put(LCD_LINE_1, LCD_COLS - 1, LCD_CHAR_WIFI_0 + i % 4);
+            break;
+        case LCD_UPDATE_GLYPHS:
+            // Two more glyphs each time, the oldest ones have to make room
+            for (n = 0; n < 2; n++) {
+                lcd_put(LCD_LINE_1, (2 * i + n) % 8, lcd_glyph(glyphs[(2 * i + n) % 5]));
+            }
+            break;
+        default:
+            break;
+    }
+    lcd_flush();
+}
+
+
+
+/**
+ * Initialize a virtual LCD `resets` times, reading the busy flag if R/W is
+ * wired and timing the instructions if not
+ *
+ * @return unsigned int     Writes to the LCD while it was busy
+ */
+static unsigned int run_lcd_resets(bool rw_wired, unsigned int osc_khz, unsigned int resets) {
+    LcdBus *bus = lcd_sim_new(BENCH_LCD_BUS_KHZ);
+    LcdSimStats before, after;
+    uint64_t start;
+    unsigned int i;
+
+    lcd_sim_set_oscillator(bus, osc_khz);
+    lcd_sim_set_rw_wired(bus, rw_wired);
+    lcd_init(bus);
+    lcd_sync();
+
+    before = lcd_sim_get_stats(bus);
+    start = lcd_bus_now(bus);
+    for (i = 0; i < resets; i++) {
+        lcd_reset();
+        lcd_sync();
+    }
+    after = lcd_sim_get_stats(bus);
+    printf("%-12s %7u kHz %10.1f %10lu\n", rw_wired ? "busy flag" : "timing table", osc_khz,
+           (double)(lcd_bus_now(bus) - start) / resets, after.busy_violations - before.busy_violations);
+    return after.busy_violations - before.busy_violations;
+}
+
+
+
+/**
+ * Run `updates` screen updates of each kind against the virtual LCD
+ *
+ * @return unsigned int     Writes to the LCD while it was busy
+ */
+static unsigned int run_lcd(unsigned int updates, const char *snapshot) {
+    LcdBus *bus = lcd_sim_new(BENCH_LCD_BUS_KHZ);
+    LcdSimStats before, after;
+    uint64_t start;
+    unsigned int update, i, violations;
+
+    lcd_init(bus);
+    lcd_puts(LCD_LINE_1, "Press any card");
+    lcd_puts(LCD_LINE_2, lcd_titles[0]);
+    lcd_flush();
+    lcd_sync();
+    after = lcd_sim_get_stats(bus);
+    printf("%-12s %10s %10s %10s\n", "", "writes", "bytes", "us");
+    printf("%-12s %10lu %10lu %10s\n", "init", after.writes, after.bytes, "");
+
+    for (update = 0; update < LCD_UPDATE_COUNT; update++) {
+        before = lcd_sim_get_stats(bus);
+        start = lcd_bus_now(bus);
+        for (i = 0; i < updates; i++) {
+            lcd_update(update, i);
+            lcd_sync();
+        }
+        after = lcd_sim_get_stats(bus);
+        printf("%-12s %10.1f %10.1f %10.1f\n", lcd_update_names[update],
+               (double)(after.writes - before.writes) / updates,
+               (double)(after.bytes - before.bytes) / updates,
+               (double)(lcd_bus_now(bus) - start) / updates);
+    }
+
+    violations = after.busy_violations;
+    printf("busy violations: %u\n", violations);
+    if (snapshot != NULL) {
+        lcd_sim_snapshot(bus, snapshot);
+    }
+    else {
+        lcd_sim_render(bus, stdout);
+    }
+
+    // The slow controller is expected to be overrun when only timed
+    printf("\n%-12s %14s %10s %10s\n", "reset", "", "us", "violations");
+    violations += run_lcd_resets(true, BENCH_LCD_OSC_KHZ, updates);
+    violations += run_lcd_resets(false, BENCH_LCD_OSC_KHZ, updates);
+    violations += run_lcd_resets(true, BENCH_LCD_SLOW_OSC_KHZ, updates);
+    run_lcd_resets(false, BENCH_LCD_SLOW_OSC_KHZ, updates);
+
+    lcd_deinit();
+    return violations;
+}
+
+
+
+static uint64_t wall_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+
+/*
+ * Artists, albums and discs below `root`, about `directories` in all
+ */
+static unsigned int make_tree(const char *root, unsigned int directories) {
+    unsigned int discs, artist, album, disc, file, n = 0;
+    char path[PATH_MAX];
+    int fd;
+
+    discs = directories > BENCH_SCAN_ARTISTS * (BENCH_SCAN_ALBUMS + 1) ?
+        (directories - BENCH_SCAN_ARTISTS * (BENCH_SCAN_ALBUMS + 1)) / (BENCH_SCAN_ARTISTS * BENCH_SCAN_ALBUMS) : 0;
+
+    for (artist = 0; artist < BENCH_SCAN_ARTISTS; artist++) {
+        snprintf(path, sizeof(path), "%s/Artist %u", root, artist);
+        n += mkdir(path, 0755) == 0;
+        for (album = 0; album < BENCH_SCAN_ALBUMS; album++) {
+            snprintf(path, sizeof(path), "%s/Artist %u/Album %u", root, artist, album);
+            n += mkdir(path, 0755) == 0;
+            for (disc = 0; disc < discs; disc++) {
+                snprintf(path, sizeof(path), "%s/Artist %u/Album %u/CD %u", root, artist, album, disc);
+                n += mkdir(path, 0755) == 0;
+                for (file = 0; file < BENCH_SCAN_FILES; file++) {
+                    snprintf(path, sizeof(path), "%s/Artist %u/Album %u/CD %u/%02u.mp3", root, artist, album, disc, file);
+                    if ((fd = open(path, O_WRONLY | O_CREAT, 0644)) >= 0) {
+                        close(fd);
+                    }
+                }
+            }
+        }
+    }
+    return n;
+}
+
+
+
+static void remove_tree(const char *path) {
+    char child[PATH_MAX];
+    struct dirent *ent;
+    DIR *dir;
+
+    if ((dir = opendir(path)) != NULL) {
+        while ((ent = readdir(dir)) != NULL) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+                continue;
+            }
+            snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
+            if (ent->d_type == DT_DIR) {
+                remove_tree(child);
+            }
+            else {
+                unlink(child);
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+
+
+/*
+ * The browser's walk before the index, less the list it built
+ */
+static unsigned int read_directories(const char *path) {
+    DIR *dir;
+    struct dirent *ent;
+    unsigned int n = 0;
+
+    if ((dir = opendir(path)) == NULL) {
+        return 0;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_type == DT_DIR) {
+            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+                continue;
+            }
+
+            char new_path[1024];
+
+            snprintf(new_path, sizeof(new_path), "%s/%s", path, ent->d_name);
+            n += 1 + read_directories(new_path);
+        }
+    }
+
+    closedir(dir);
+    return n;
+}
+
+
+
+/**
+ * Scan a synthetic tree of about `directories` directories, the old way
+ * and with 1 to `max_workers` workers
+ *
+ * @return unsigned int     Scans that did not find every directory
+ */
+static unsigned int run_scan(unsigned int directories, int max_workers) {
+    char root[] = "/tmp/kiddyblaster-bench-XXXXXX";
+    DirScanStats stats, best_stats = { 0 };
+    DirScanNode *node;
+    uint64_t start, us, best_us;
+    unsigned int n, found, failures = 0;
+    int workers, run;
+
+    if (mkdtemp(root) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    start = wall_us();
+    n = make_tree(root, directories);
+    printf("%u directories in %s, created in %.1f s\n\n", n, root, (wall_us() - start) / 1e6);
+    printf("%-18s %12s %10s %8s %8s\n", "", "directories", "ms", "stats", "steals");
+
+    best_us = UINT64_MAX;
+    for (run = 0; run < BENCH_SCAN_RUNS; run++) {
+        start = wall_us();
+        found = read_directories(root);
+        if ((us = wall_us() - start) < best_us) {
+            best_us = us;
+        }
+    }
+    failures += found != n;
+    printf("%-18s %12u %10.1f %8s %8s\n", "read_directories", found, best_us / 1e3, "", "");
+
+    for (workers = 1; workers <= max_workers; workers++) {
+        best_us = UINT64_MAX;
+        for (run = 0; run < BENCH_SCAN_RUNS; run++) {
+            start = wall_us();
+            node = dir_scan(root, workers, -1, 0, &stats);
+            if ((us = wall_us() - start) < best_us) {
+                best_us = us;
+                best_stats = stats;
+            }
+            dir_scan_free(node);
+        }
+        // The stats count the root as well
+        failures += best_stats.directories != n + 1;
+        printf("dir_scan %d %-7s %12u %10.1f %8u %8u\n", workers, workers > 1 ? "workers" : "worker",
+               best_stats.directories - 1, best_us / 1e3, best_stats.stats, best_stats.steals);
+    }
+
+    remove_tree(root);
+    return failures;
+}
+
+
+
+int main(int argc, char **argv) {
+    SpiBus *bus, *sim = NULL;
+    unsigned int cycles = BENCH_DEFAULT_CYCLES;
+    BenchResult res;
+
+    openlog("kiddyblaster-bench", LOG_PERROR, LOG_USER);
+
+    if (argc < 2) {
+        usage();
+        return 1;
+    }
+
+    if (strcmp(argv[1], "sim") == 0) {
+        if (argc > 2) {
+            cycles = atoi(argv[2]);
+        }
+        mfrc522_init(new_sim_reader(&sim));
+        res = run(sim, cycles);
+        report("sim", &res);
+        report_sim(sim, cycles);
+    }
+    else if (strcmp(argv[1], "record") == 0 && argc > 2) {
+        if (argc > 3) {
+            cycles = atoi(argv[3]);
+        }
+        SpiBus *inner = (argc > 4) ? spi_spidev_new(argv[4], BENCH_SPI_SPEED, -1) : new_sim_reader(&sim);
+        if (inner == NULL) {
+            return 1;
+        }
+        if ((bus = spi_trace_record_new(inner, argv[2])) == NULL) {
+            spi_bus_free(inner);
+            return 1;
+        }
+        mfrc522_init(bus);
+        res = run(bus, cycles);
+        report("record", &res);
+        if (sim != NULL) {
+            report_sim(sim, cycles);
+        }
+    }
+    else if (strcmp(argv[1], "replay") == 0 && argc > 2) {
+        if (argc > 3) {
+            cycles = atoi(argv[3]);
+        }
+        if ((bus = spi_trace_replay_new(argv[2])) == NULL) {
+            return 1;
+        }
+        mfrc522_init(bus);
+        res = run(bus, cycles);
+        report("replay", &res);
+    }
+    else if (strcmp(argv[1], "enum") == 0) {
+        unsigned int n, failures = 0;
+        char name[16];
+        if (argc > 2) {
+            cycles = atoi(argv[2]);
+        }
+        srand(1);
+        for (n = 1; n <= 4; n++) {
+            res = run_enum(n, cycles);
+            snprintf(name, sizeof(name), "enum %u", n);
+            report(name, &res);
+            failures += res.failures;
+        }
+        res.failures = failures;
+        closelog();
+        return res.failures > 0 ? 2 : 0;
+    }
+    else if (strcmp(argv[1], "sector") == 0) {
+        static const char *names[] = { "auth per block", "auth per sector", "pipelined" };
+        unsigned int mode, failures = 0;
+        if (argc > 2) {
+            cycles = atoi(argv[2]);
+        }
+        for (mode = READ_AUTH_PER_BLOCK; mode <= READ_PIPELINED; mode++) {
+            res = run_sectors(mode, cycles, &sim);
+            report(names[mode], &res);
+            report_sim(sim, cycles);
+            failures += res.failures;
+            mfrc522_close();
+        }
+        closelog();
+        return failures > 0 ? 2 : 0;
+    }
+    else if (strcmp(argv[1], "latency") == 0) {
+        if (argc > 2) {
+            cycles = atoi(argv[2]);
+        }
+        mfrc522_init(new_sim_reader(&sim));
+        res.failures = run_latency(sim, cycles);
+    }
+    else if (strcmp(argv[1], "lcd") == 0) {
+        if (argc > 2) {
+            cycles = atoi(argv[2]);
+        }
+        closelog();
+        return run_lcd(cycles, (argc > 3) ? argv[3] : NULL) > 0 ? 2 : 0;
+    }
+    else if (strcmp(argv[1], "scan") == 0) {
+        int workers = dir_scan_workers();
+        if (argc > 2) {
+            cycles = atoi(argv[2]);
+        }
+        if (argc > 3) {
+            workers = atoi(argv[3]);
+        }
+        closelog();
+        return run_scan(argc > 2 ? cycles : BENCH_SCAN_DIRECTORIES, workers) > 0 ? 2 : 0;
+    }
+    else if (strcmp(argv[1], "gain") == 0) {
+        if (argc > 2) {
+            cycles = atoi(argv[2]);
+        }
+        res.failures = run_gain(cycles);
+    }
+    else {
+        usage();
+        return 1;
+    }
+
+    mfrc522_close();
+    closelog();
+
+    return res.failures > 0 ? 2 : 0;
+}
@@ -1,6 +1,22 @@
 /**
  * File System Browser
  *
+ * Browses the tree a directory at a time: next and previous step through
+ * the subdirectories of the one browsed, enter goes down into the
+ * selected one and up back to where it came from.
+ *
+ * The directories come from the file system or from mpd's database. With
+ * mpd, a directory is listed the first time it is selected and kept until
+ * mpd has updated its database; the paths are the URIs mpd plays. Only
+ * moving the selection lists anything, the getters read what is there.
+ *
+ * Either way the index is saved and loaded on the next start, so browsing
+ * does not wait for the tree to be walked or mpd to be asked again. Each
+ * level is sorted by name, see collate.h.
+ *
+ * Nothing is locked: a browser is used by one thread, in the daemon the
+ * one handling the buttons and drawing the display.
+ *
  * @author Johannes Braun <johannes.braun@hannenzn.de>
  * @package kiddyblaster
  * @version Mon Jan  6 20:40:45 GMT 2020
@@ -9,91 +25,521 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
+#include <syslog.h>
+#include <mpd/client.h>
 #include "browser.h"
+#include "collate.h"
+#include "player.h"
 
+// What a directory that can't be listed right now has, not cached
+static BrowserLevel unavailable;
+
+
+
+static void level_free(gpointer data) {
+    BrowserLevel *level = data;
+    free(level->entries);
+    free(level->runs);
+    free(level->run_starts);
+    free(level);
+}
 
-static void read_directories(Browser *browser, const char *path, int depth);
 
 
 /**
- * Creates a new FileBrowser
+ * Creates a new FileBrowser on the directories below `base_path`, from the
+ * saved index if there is one, else by indexing them
  *
  * @param const gchar*  base_path
- * @return Object       FileBrowser object, free with `free`
+ * @return Object       FileBrowser object, free with `browser_free`
  */
 Browser *browser_new(const gchar *base_path) {
 
-    Browser *browser = malloc(sizeof(Browser));
+    Browser *browser = calloc(1, sizeof(Browser));
     if (browser == NULL) {
         return NULL;
     }
 
-    browser->directories = NULL;
-    browser->selected_dir = NULL;
-    
-    strncpy(browser->base_path, base_path, sizeof(browser->base_path));
+    g_strlcpy(browser->base_path, base_path, sizeof(browser->base_path));
+    browser->index = browser_index_load(BROWSER_INDEX_FILE, base_path);
+    if (browser->index == NULL) {
+        browser->index = browser_index_new(base_path);
+    }
+    browser->levels = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, level_free);
+    browser->levels_generation = browser->index->generation;
     return browser;
 }
 
 
+
+/**
+ * Creates a new FileBrowser on mpd's database
+ *
+ * @return Object       FileBrowser object, free with `browser_free`
+ */
+Browser *browser_new_mpd() {
+
+    Browser *browser = calloc(1, sizeof(Browser));
+    if (browser == NULL) {
+        return NULL;
+    }
+
+    browser->source = BROWSER_SOURCE_MPD;
+    browser->index = browser_index_load(BROWSER_INDEX_FILE, "");
+    if (browser->index == NULL) {
+        browser->index = browser_index_new_empty("");
+    }
+    browser->levels = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, level_free);
+    browser->levels_generation = browser->index->generation;
+    return browser;
+}
+
+
+
+void browser_free(Browser *browser) {
+    if (browser == NULL) {
+        return;
+    }
+    g_hash_table_destroy(browser->levels);
+    browser_index_free(browser->index);
+    free(browser);
+}
+
+
+
+/**
+ * Save the index for the next start, if it has changed
+ *
+ * @return int      0 on success, -1 on failure
+ */
+int browser_save(Browser *browser) {
+    if (!browser->index->dirty) {
+        return 0;
+    }
+    return browser_index_save(browser->index, BROWSER_INDEX_FILE);
+}
+
+
+
+/*
+ * The path of `entry` the way mpd plays it, relative to the base directory
+ * (mpd's music directory) even when the index is of the file system
+ *
+ * @return int      Length of the path, -1 if it does not fit
+ */
+static int entry_uri(Browser *browser, int entry, gchar *uri, size_t size) {
+    size_t base_len = strlen(browser->base_path);
+    int len;
+
+    if ((len = browser_index_path(browser->index, entry, uri, size)) < 0) {
+        return -1;
+    }
+    if (base_len > 0 && g_str_has_prefix(uri, browser->base_path)) {
+        if (uri[base_len] == '/') {
+            base_len++;
+        }
+        len -= base_len;
+        memmove(uri, uri + base_len, len + 1);
+    }
+    return len;
+}
+
+
+
+static void level_add(BrowserLevel *level, int entry, int *size) {
+    if (level->n_entries == *size) {
+        *size = *size > 0 ? *size * 2 : 16;
+        level->entries = realloc(level->entries, *size * sizeof(int));
+    }
+    level->entries[level->n_entries++] = entry;
+}
+
+
+
+/*
+ * List the subdirectories of `dir` with mpd's lsinfo and add them to the
+ * index
+ *
+ * @return bool     false if mpd could not be asked
+ */
+static bool list_mpd(Browser *browser, int dir) {
+    struct mpd_connection *mpd;
+    struct mpd_entity *entity;
+    gchar uri[PATH_MAX];
+    const char *path, *name;
+    bool success;
+
+    if (entry_uri(browser, dir, uri, sizeof(uri)) < 0 ||
+        (mpd = player_connection_get()) == NULL) {
+        return false;
+    }
+
+    mpd_send_list_meta(mpd, *uri != '\0' ? uri : NULL);
+    while ((entity = mpd_recv_entity(mpd)) != NULL) {
+        if (mpd_entity_get_type(entity) == MPD_ENTITY_TYPE_DIRECTORY) {
+            path = mpd_directory_get_path(mpd_entity_get_directory(entity));
+            name = strrchr(path, '/');
+            browser_index_add(browser->index, dir, name != NULL ? name + 1 : path);
+        }
+        mpd_entity_free(entity);
+    }
+    success = mpd_response_finish(mpd);
+    player_connection_release(mpd);
+    if (success) {
+        browser->index->entries[dir].flags |= BROWSER_ENTRY_LISTED;
+    }
+    return success;
+}
+
+
+
+/*
+ * Group the sorted entries of a level by their initials
+ */
+static void find_runs(Browser *browser, BrowserLevel *level) {
+    char key[COLLATE_KEY_MAX], initial, previous = '\0';
+    int i;
+
+    level->runs = malloc(level->n_entries * sizeof(int));
+    level->run_starts = malloc(level->n_entries * sizeof(int));
+    level->n_runs = 0;
+    for (i = 0; i < level->n_entries; i++) {
+        collate_key(browser_index_name(browser->index, level->entries[i]), key, sizeof(key));
+        initial = collate_initial(key);
+        if (i == 0 || initial != previous) {
+            level->run_starts[level->n_runs++] = i;
+            previous = initial;
+        }
+        level->runs[i] = level->n_runs - 1;
+    }
+}
+
+
+
+/*
+ * The subdirectories of `dir`, sorted, from the index once it is sure to
+ * have them: mpd is asked on the first visit, the file system checked
+ */
+static BrowserLevel *load_level(Browser *browser, int dir) {
+    BrowserIndex *index = browser->index;
+    BrowserLevel *level;
+    int i, size = 0;
+
+    level = g_hash_table_lookup(browser->levels, GINT_TO_POINTER(dir));
+    if (level != NULL) {
+        return level;
+    }
+
+    if (browser->source == BROWSER_SOURCE_MPD) {
+        int n_entries = index->n_entries;
+        size_t arena_len = index->arena_len;
+        if (!(index->entries[dir].flags & BROWSER_ENTRY_LISTED) && !list_mpd(browser, dir)) {
+            syslog(LOG_WARNING, "Failed to list a directory in mpd's database\n");
+            // Forget what has been added, the next visit lists it again
+            index->n_entries = n_entries;
+            index->arena_len = arena_len;
+            return &unavailable;
+        }
+    }
+    else {
+        browser_index_list(index, dir);
+    }
+
+    level = calloc(1, sizeof(BrowserLevel));
+    for (i = dir + 1; i < index->n_entries; i++) {
+        if (index->entries[i].parent == dir) {
+            level_add(level, i, &size);
+        }
+    }
+    browser_index_sort(index, level->entries, level->n_entries);
+    find_runs(browser, level);
+    g_hash_table_insert(browser->levels, GINT_TO_POINTER(dir), level);
+    return level;
+}
+
+
+
+/*
+ * Start over if mpd has updated its database since it has been listed
+ */
+static void update_mpd(Browser *browser) {
+    struct mpd_connection *mpd;
+    struct mpd_stats *stats;
+    uint64_t db_update = browser->index->key;
+
+    if ((mpd = player_connection_get()) == NULL) {
+        return;
+    }
+    if ((stats = mpd_run_stats(mpd)) != NULL) {
+        db_update = mpd_stats_get_db_update_time(stats);
+        mpd_stats_free(stats);
+    }
+    player_connection_release(mpd);
+
+    if (db_update != browser->index->key) {
+        browser_index_clear(browser->index);
+        browser->index->key = db_update;
+    }
+}
+
+
+
+static int selected_entry(Browser *browser) {
+    if (browser->level == NULL || browser->selected_pos >= browser->level->n_entries) {
+        return -1;
+    }
+    return browser->level->entries[browser->selected_pos];
+}
+
+
+
+/*
+ * Look into the directory that has been selected, so that whether it has
+ * subdirectories is known without listing anything when it is shown
+ */
+static void selection_changed(Browser *browser) {
+    int entry = selected_entry(browser);
+    browser->selected_has_children = entry >= 0 && load_level(browser, entry)->n_entries > 0;
+}
+
+
+
+/*
+ * Browse `dir` with `entry` selected, or its first subdirectory if
+ * `entry` is not one of them
+ */
+static void browse(Browser *browser, int dir, int entry) {
+    int i;
+
+    browser->dir = dir;
+    browser->level = load_level(browser, dir);
+    browser->selected_pos = 0;
+    for (i = 0; i < browser->level->n_entries; i++) {
+        if (browser->level->entries[i] == entry) {
+            browser->selected_pos = i;
+            break;
+        }
+    }
+    selection_changed(browser);
+}
+
+
+
+/*
+ * Find the selection again after the index has changed, by its path (see
+ * entry_uri()): as deep as the directories on it are still there
+ */
+static void reselect(Browser *browser, const gchar *uri) {
+    BrowserIndex *index = browser->index;
+    BrowserLevel *level;
+    gchar rel[PATH_MAX];
+    char *name, *save = NULL;
+    int dir = 0, entry = -1, child, i;
+
+    g_strlcpy(rel, uri, sizeof(rel));
+    for (name = strtok_r(rel, "/", &save); name != NULL; name = strtok_r(NULL, "/", &save)) {
+        level = load_level(browser, entry >= 0 ? entry : dir);
+        child = -1;
+        for (i = 0; i < level->n_entries; i++) {
+            if (strcmp(browser_index_name(index, level->entries[i]), name) == 0) {
+                child = level->entries[i];
+                break;
+            }
+        }
+        if (child < 0) {
+            break;
+        }
+        if (entry >= 0) {
+            dir = entry;
+        }
+        entry = child;
+    }
+    browse(browser, dir, entry);
+}
+
+
+
+/**
+ * Enter browsing where it has been left, reading only what has changed
+ * in the tree since
+ */
 void browser_start_browsing(Browser *browser) {
-    g_list_free_full(browser->directories, g_free);
-    browser->directories = NULL;
+    gchar path[PATH_MAX] = "";
+    int entry = selected_entry(browser);
 
-    read_directories(browser, browser->base_path, 0);
-    browser->selected_dir = browser->directories;
+    if (entry >= 0 && entry_uri(browser, entry, path, sizeof(path)) < 0) {
+        path[0] = '\0';
+    }
+    if (browser->source == BROWSER_SOURCE_MPD) {
+        update_mpd(browser);
+    }
+    else {
+        browser_index_update(browser->index);
+    }
+
+    // Directories that are not watched are checked again on the next visit
+    if (browser->levels_generation != browser->index->generation ||
+        (browser->source == BROWSER_SOURCE_FILES && browser->index->inotify_fd < 0)) {
+        g_hash_table_remove_all(browser->levels);
+        browser->levels_generation = browser->index->generation;
+        browser->level = NULL;
+    }
+    if (browser->level == NULL || browser->level == &unavailable) {
+        reselect(browser, path);
+    }
 }
 
 
+
+/**
+ * The path of the selected directory, the URI mpd plays it by
+ *
+ * @return const gchar*     NULL if there is none
+ */
 const gchar *browser_get_selected_directory(Browser *browser) {
+    int entry;
+
     g_assert(browser != NULL);
-    g_assert(browser->selected_dir != NULL);
-    g_assert(browser->selected_dir->data != NULL);
+
+    if ((entry = selected_entry(browser)) < 0 ||
+        entry_uri(browser, entry, browser->selected_path, sizeof(browser->selected_path)) < 0) {
+        return NULL;
+    }
+    return browser->selected_path;
+}
+
 
 
-    return  browser->selected_dir->data;
+/**
+ * The name of the selected directory
+ *
+ * @return const gchar*     NULL if there is none
+ */
+const gchar *browser_get_selected_name(Browser *browser) {
+    int entry = selected_entry(browser);
+    return entry >= 0 ? browser_index_name(browser->index, entry) : NULL;
 }
 
 
+
+/**
+ * Whether the selected directory can be entered, from what has been
+ * looked up when it has been selected
+ */
+bool browser_selected_has_children(Browser *browser) {
+    return selected_entry(browser) >= 0 && browser->selected_has_children;
+}
+
+
+
 void browser_previous(Browser *browser) {
-    if (browser->selected_dir->prev != NULL) {
-        browser->selected_dir = browser->selected_dir->prev;
+    if (browser->selected_pos > 0) {
+        browser->selected_pos--;
+        selection_changed(browser);
     }
 }
 
 
 
 void browser_next(Browser *browser) {
-    if (browser->selected_dir->next != NULL) {
-        browser->selected_dir = browser->selected_dir->next;
+    if (selected_entry(browser) >= 0 && browser->selected_pos + 1 < browser->level->n_entries) {
+        browser->selected_pos++;
+        selection_changed(browser);
     }
 }
 
 
 
-static void read_directories(Browser *browser, const char *path, int depth) {
-    DIR *dir;
-    struct dirent *ent;
+/**
+ * Jump to the first directory with the next initial, or the last one if
+ * there is none
+ */
+void browser_next_initial(Browser *browser) {
+    BrowserLevel *level = browser->level;
+    int run;
 
-    if ((dir = opendir(path)) == NULL) {
+    if (selected_entry(browser) < 0) {
         return;
     }
+    run = level->runs[browser->selected_pos];
+    browser->selected_pos = run + 1 < level->n_runs ? level->run_starts[run + 1] : level->n_entries - 1;
+    selection_changed(browser);
+}
 
-    while ((ent = readdir(dir)) != NULL) {
-        if (ent->d_type == DT_DIR) {
-            if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
-                continue;
-            }
 
-            char new_path[1024];
 
-            snprintf(new_path, sizeof(new_path), "%s/%s", path, ent->d_name);
-            browser->directories = g_list_append(browser->directories, g_strdup(new_path));
-            read_directories(browser, new_path, depth + 4);
-        }
+/**
+ * Jump to the first directory with the selected one's initial or, if it
+ * is already, to the first with the initial before
+ */
+void browser_previous_initial(Browser *browser) {
+    BrowserLevel *level = browser->level;
+    int run;
+
+    if (selected_entry(browser) < 0) {
+        return;
+    }
+    run = level->runs[browser->selected_pos];
+    if (browser->selected_pos == level->run_starts[run] && run > 0) {
+        run--;
+    }
+    browser->selected_pos = level->run_starts[run];
+    selection_changed(browser);
+}
+
+
+
+/**
+ * Go down into the selected directory
+ *
+ * @return bool     false if it has no subdirectories
+ */
+bool browser_enter(Browser *browser) {
+    if (!browser_selected_has_children(browser)) {
+        return false;
     }
+    browse(browser, selected_entry(browser), -1);
+    return true;
+}
+
+
+
+/**
+ * Go back up, with the directory that has been browsed selected
+ */
+void browser_up(Browser *browser) {
+    if (browser->level == NULL || browser->dir <= 0) {
+        return;
+    }
+    browse(browser, browser->index->entries[browser->dir].parent, browser->dir);
+}
+
+
+
+/**
+ * How deep the directory browsed is below the base directory, 0 for the
+ * base directory itself
+ */
+int browser_get_depth(Browser *browser) {
+    int depth = 0, dir;
+
+    for (dir = browser->dir; dir > 0; dir = browser->index->entries[dir].parent) {
+        depth++;
+    }
+    return depth;
+}
+
+
+
+/**
+ * Position of the selected directory among its siblings, from 1
+ */
+int browser_get_position(Browser *browser) {
+    return selected_entry(browser) >= 0 ? browser->selected_pos + 1 : 0;
+}
+
+
 
-    closedir(dir);
-    return;
+int browser_get_count(Browser *browser) {
+    return browser->level != NULL ? browser->level->n_entries : 0;
 }
@@ -8,19 +8,67 @@
 #ifndef __BROWSER_H__
 #define __BROWSER_H__
 
+#include <limits.h>
+
+#include "browser_index.h"
+
+// Where the index is kept between runs
+#define BROWSER_INDEX_FILE "/var/lib/kiddyblaster/browser.index"
+
+/*
+ * The subdirectories of a directory, entries of the index
+ */
+typedef struct {
+    int *entries;
+    int n_entries;
+
+    // Entries next to each other with the same initial, see
+    // collate_initial(), are a run: the run of each entry and where each
+    // run starts, to jump from one initial to the next
+    int *runs;
+    int *run_starts;
+    int n_runs;
+} BrowserLevel;
+
+typedef enum {
+    BROWSER_SOURCE_FILES,   // The file system, indexed and watched or checked
+    BROWSER_SOURCE_MPD      // mpd's database, listed as needed
+} BrowserSource;
+
 typedef struct {
     gchar base_path[256];
-    GList *directories;
-    GList *selected_dir;
+    BrowserSource source;
+    BrowserIndex *index;    // With mpd, keyed by the update time of its database
+
+    // Levels are loaded on the first visit and kept until the index changes
+    // or, for a directory that is not watched, browsing starts again
+    GHashTable *levels;     // Directory entry -> BrowserLevel
+    unsigned int levels_generation;
+
+    int dir;                // The directory browsed, an entry of the index
+    BrowserLevel *level;    // Its subdirectories
+    int selected_pos;       // The selected one of them
+    bool selected_has_children;     // Looked up when the selection changes
+    gchar selected_path[PATH_MAX];
 } Browser;
 
 
 Browser *browser_new(const gchar *base_path);
+Browser *browser_new_mpd();
+void browser_free(Browser *browser);
+int browser_save(Browser *browser);
 void browser_start_browsing(Browser *browser);
 void browser_next(Browser *browser);
 void browser_previous(Browser *browser);
+void browser_next_initial(Browser *browser);
+void browser_previous_initial(Browser *browser);
+bool browser_enter(Browser *browser);
 void browser_up(Browser *browser);
 const gchar *browser_get_selected_directory(Browser *browser);
-// static void read_directories(const char *path, int depth);
+const gchar *browser_get_selected_name(Browser *browser);
+bool browser_selected_has_children(Browser *browser);
+int browser_get_depth(Browser *browser);
+int browser_get_position(Browser *browser);
+int browser_get_count(Browser *browser);
 
 #endif
@@ -0,0 +1,771 @@
+/**
+ * Index of the directories below the music folder
+ *
+ * @package kiddyblaster
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "browser_index.h"
+#include "collate.h"
+#include "dir_scan.h"
+
+#define WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+
+
+
+static uint32_t arena_add(BrowserIndex *index, const char *name) {
+    size_t len = strlen(name) + 1;
+    uint32_t offset;
+
+    if (index->arena_len + len > index->arena_size) {
+        while (index->arena_len + len > index->arena_size) {
+            index->arena_size = index->arena_size > 0 ? index->arena_size * 2 : 4096;
+        }
+        index->arena = realloc(index->arena, index->arena_size);
+    }
+    offset = index->arena_len;
+    memcpy(index->arena + offset, name, len);
+    index->arena_len += len;
+    return offset;
+}
+
+
+
+static void unwatch(BrowserIndex *index, int i) {
+    BrowserEntry *entry = &index->entries[i];
+
+    if (entry->wd < 0) {
+        return;
+    }
+    g_hash_table_remove(index->watches, GINT_TO_POINTER(entry->wd));
+    inotify_rm_watch(index->inotify_fd, entry->wd);
+    entry->wd = -1;
+}
+
+
+
+static int add_entry(BrowserIndex *index, int parent, const char *name) {
+    BrowserEntry *entry;
+
+    if (index->n_entries == index->size) {
+        index->size = index->size > 0 ? index->size * 2 : 1024;
+        index->entries = realloc(index->entries, index->size * sizeof(BrowserEntry));
+    }
+    entry = &index->entries[index->n_entries];
+    entry->name = arena_add(index, name);
+    entry->parent = parent;
+    entry->mtime = 0;
+    entry->wd = -1;
+    entry->flags = 0;
+    index->dirty = true;
+    return index->n_entries++;
+}
+
+
+
+static int64_t mtime_of(const struct stat *st) {
+    return (int64_t)st->st_mtim.tv_sec * 1000000000 + st->st_mtim.tv_nsec;
+}
+
+
+
+/*
+ * Whether `ent`, read from `dir`, is a directory. Only file systems that
+ * don't tell the type cost a stat.
+ */
+static bool is_directory(DIR *dir, const struct dirent *ent) {
+    struct stat st;
+
+    if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0) {
+        return false;
+    }
+    if (ent->d_type == DT_UNKNOWN) {
+        return fstatat(dirfd(dir), ent->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+    }
+    return ent->d_type == DT_DIR;
+}
+
+
+
+/*
+ * Add what has been scanned below entry `i`
+ */
+static void add_scanned(BrowserIndex *index, int i, DirScanNode *node) {
+    DirScanNode *child;
+
+    if (node->listed) {
+        index->entries[i].mtime = node->mtime;
+        index->entries[i].flags |= BROWSER_ENTRY_LISTED;
+    }
+    if (node->wd >= 0) {
+        index->entries[i].wd = node->wd;
+        g_hash_table_insert(index->watches, GINT_TO_POINTER(node->wd), GINT_TO_POINTER(i + 1));
+    }
+    for (child = node->children; child != NULL; child = child->next) {
+        add_scanned(index, add_entry(index, i, child->name), child);
+    }
+}
+
+
+
+/*
+ * Add and watch the subdirectories of entry `i`, at `path`, and
+ * everything below them
+ */
+static void scan(BrowserIndex *index, int i, const char *path, int n_workers) {
+    DirScanStats stats;
+    DirScanNode *root;
+
+    if ((root = dir_scan(path, n_workers, index->inotify_fd, WATCH_MASK, &stats)) == NULL) {
+        return;
+    }
+    add_scanned(index, i, root);
+    dir_scan_free(root);
+
+    if (stats.watches_exhausted && !index->watches_exhausted) {
+        syslog(LOG_WARNING, "Out of inotify watches, raise fs.inotify.max_user_watches\n");
+        index->watches_exhausted = true;
+    }
+}
+
+
+
+/*
+ * Throw everything away and walk the tree
+ */
+static void build(BrowserIndex *index) {
+    if (index->inotify_fd >= 0) {
+        close(index->inotify_fd);
+    }
+    index->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (index->inotify_fd < 0) {
+        syslog(LOG_WARNING, "Failed to set up inotify, the browser won't see new directories\n");
+    }
+    g_hash_table_remove_all(index->watches);
+    index->watches_exhausted = false;
+
+    index->n_entries = 0;
+    index->n_removed = 0;
+    index->arena_len = 0;
+    add_entry(index, -1, index->base_path);
+    scan(index, 0, index->base_path, 0);
+    index->generation++;
+
+    syslog(LOG_INFO, "Indexed %d directories below %s\n", index->n_entries - 1, index->base_path);
+}
+
+
+
+/**
+ * Index the directories below `base_path`
+ *
+ * @param const gchar*      base_path
+ * @return BrowserIndex*    Free with browser_index_free()
+ */
+BrowserIndex *browser_index_new(const gchar *base_path) {
+    BrowserIndex *index = calloc(1, sizeof(BrowserIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+
+    g_strlcpy(index->base_path, base_path, sizeof(index->base_path));
+    index->inotify_fd = -1;
+    index->watches = g_hash_table_new(g_direct_hash, g_direct_equal);
+    build(index);
+    return index;
+}
+
+
+
+/**
+ * An index holding only the base directory, neither walked nor watched;
+ * the directories below are added with browser_index_add()
+ *
+ * @param const gchar*      base_path   May be empty
+ * @return BrowserIndex*    Free with browser_index_free()
+ */
+BrowserIndex *browser_index_new_empty(const gchar *base_path) {
+    BrowserIndex *index = calloc(1, sizeof(BrowserIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+
+    g_strlcpy(index->base_path, base_path, sizeof(index->base_path));
+    index->inotify_fd = -1;
+    index->watches = g_hash_table_new(g_direct_hash, g_direct_equal);
+    add_entry(index, -1, index->base_path);
+    return index;
+}
+
+
+
+/**
+ * Add a directory below entry `parent`
+ *
+ * @return int      The new entry
+ */
+int browser_index_add(BrowserIndex *index, int parent, const char *name) {
+    return add_entry(index, parent, name);
+}
+
+
+
+/**
+ * Drop everything but the base directory
+ */
+void browser_index_clear(BrowserIndex *index) {
+    index->n_entries = 1;
+    index->n_removed = 0;
+    index->arena_len = strlen(index->arena) + 1;
+    index->entries[0].flags = 0;
+    index->generation++;
+    index->dirty = true;
+}
+
+
+
+void browser_index_free(BrowserIndex *index) {
+    if (index == NULL) {
+        return;
+    }
+    if (index->inotify_fd >= 0) {
+        close(index->inotify_fd);
+    }
+    g_hash_table_destroy(index->watches);
+    free(index->entries);
+    free(index->arena);
+    free(index);
+}
+
+
+
+const char *browser_index_name(BrowserIndex *index, int i) {
+    return index->arena + index->entries[i].name;
+}
+
+
+
+/**
+ * Build the full path of an entry. With an empty base path it is relative
+ * to the base directory.
+ *
+ * @param BrowserIndex* index
+ * @param int           i       The entry
+ * @param char*         path    Receives the path
+ * @param size_t        size    Of `path`
+ * @return int          Length of the path, -1 if it does not fit
+ */
+int browser_index_path(BrowserIndex *index, int i, char *path, size_t size) {
+    const char *name;
+    size_t len = 0, name_len;
+    int j;
+
+    // From the entry up, each name before the ones below it
+    for (j = i; j >= 0; j = index->entries[j].parent) {
+        name = browser_index_name(index, j);
+        if (*name == '\0') {
+            continue;
+        }
+        len += strlen(name) + (j != i ? 1 : 0);
+        if (len + 1 > size) {
+            return -1;
+        }
+    }
+    path[len] = '\0';
+    for (j = i; j >= 0; j = index->entries[j].parent) {
+        name = browser_index_name(index, j);
+        name_len = strlen(name);
+        if (name_len == 0) {
+            continue;
+        }
+        if (j != i) {
+            path[--len] = '/';
+        }
+        len -= name_len;
+        memcpy(path + len, name, name_len);
+    }
+    return strlen(path);
+}
+
+
+
+/*
+ * Find a child of `parent` by name, -1 if there is none
+ */
+static int find_child(BrowserIndex *index, int parent, const char *name) {
+    int i;
+
+    for (i = parent + 1; i < index->n_entries; i++) {
+        if (index->entries[i].parent == parent && strcmp(browser_index_name(index, i), name) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+
+/*
+ * A directory has appeared in `parent`, add it and what it holds
+ */
+static bool add_subtree(BrowserIndex *index, int parent, const char *name) {
+    char path[PATH_MAX];
+    int len;
+
+    if (find_child(index, parent, name) >= 0) {
+        return false;
+    }
+    if ((len = browser_index_path(index, parent, path, sizeof(path))) < 0 ||
+        len + 1 + strlen(name) >= sizeof(path)) {
+        return false;
+    }
+    path[len] = '/';
+    strcpy(path + len + 1, name);
+
+    // Mostly a single directory, not worth starting threads for
+    scan(index, add_entry(index, parent, name), path, 1);
+    return true;
+}
+
+
+
+/*
+ * A directory has gone from `parent`, remove it and everything below. The
+ * children come after their parents, so one pass finds them all.
+ */
+static bool remove_subtree(BrowserIndex *index, int parent, const char *name) {
+    BrowserEntry *entries = index->entries;
+    int i, j;
+
+    if ((i = find_child(index, parent, name)) < 0) {
+        return false;
+    }
+    unwatch(index, i);
+    entries[i].parent = BROWSER_INDEX_REMOVED;
+    index->n_removed++;
+
+    for (j = i + 1; j < index->n_entries; j++) {
+        if (entries[j].parent >= 0 && entries[entries[j].parent].parent == BROWSER_INDEX_REMOVED) {
+            unwatch(index, j);
+            entries[j].parent = BROWSER_INDEX_REMOVED;
+            index->n_removed++;
+        }
+    }
+    index->dirty = true;
+    return true;
+}
+
+
+
+/*
+ * Drop the removed entries and their names, keeping the order
+ */
+static void compact(BrowserIndex *index) {
+    BrowserEntry *entries = index->entries;
+    int *moved_to = malloc(index->n_entries * sizeof(int));
+    char *arena = malloc(index->arena_size);
+    size_t arena_len = 0, len;
+    int i, n = 0;
+
+    for (i = 0; i < index->n_entries; i++) {
+        if (entries[i].parent == BROWSER_INDEX_REMOVED) {
+            moved_to[i] = -1;
+            continue;
+        }
+        len = strlen(index->arena + entries[i].name) + 1;
+        memcpy(arena + arena_len, index->arena + entries[i].name, len);
+
+        entries[n] = entries[i];
+        entries[n].name = arena_len;
+        entries[n].parent = entries[i].parent >= 0 ? moved_to[entries[i].parent] : -1;
+        if (entries[n].wd >= 0) {
+            g_hash_table_insert(index->watches, GINT_TO_POINTER(entries[n].wd), GINT_TO_POINTER(n + 1));
+        }
+        arena_len += len;
+        moved_to[i] = n++;
+    }
+
+    free(index->arena);
+    free(moved_to);
+    index->arena = arena;
+    index->arena_len = arena_len;
+    index->n_entries = n;
+    index->n_removed = 0;
+}
+
+
+
+/**
+ * Apply the changes to the tree that have been reported since the last
+ * update. Does not block.
+ *
+ * @return bool     Whether the index has changed
+ */
+bool browser_index_update(BrowserIndex *index) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *event;
+    bool changed = false;
+    ssize_t len;
+    char *p;
+    int i;
+
+    if (index->inotify_fd < 0) {
+        return false;
+    }
+
+    while ((len = read(index->inotify_fd, buf, sizeof(buf))) > 0) {
+        for (p = buf; p < buf + len; p += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *)p;
+
+            // Events have been lost, start over
+            if (event->mask & IN_Q_OVERFLOW) {
+                build(index);
+                return true;
+            }
+            if (!(event->mask & IN_ISDIR) || event->len == 0) {
+                continue;
+            }
+            i = GPOINTER_TO_INT(g_hash_table_lookup(index->watches, GINT_TO_POINTER(event->wd))) - 1;
+            if (i < 0) {
+                continue;
+            }
+
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                changed |= add_subtree(index, i, event->name);
+            }
+            else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                changed |= remove_subtree(index, i, event->name);
+            }
+        }
+    }
+
+    if (index->n_removed * 100 > index->n_entries * BROWSER_INDEX_COMPACT_PERCENT) {
+        compact(index);
+    }
+    if (changed) {
+        index->generation++;
+    }
+    return changed;
+}
+
+
+
+
+/**
+ * Make sure the subdirectories of entry `i` are in the index. A watched
+ * directory always has them; any other is read if it has not been listed
+ * yet or its mtime is not the one it has been listed with.
+ *
+ * @return bool     Whether the index has changed
+ */
+bool browser_index_list(BrowserIndex *index, int i) {
+    gchar path[PATH_MAX];
+    struct stat st;
+    struct dirent *ent;
+    DIR *dir;
+    bool changed = false, *found;
+    int n_entries = index->n_entries, j;
+
+    if (index->entries[i].wd >= 0 && (index->entries[i].flags & BROWSER_ENTRY_LISTED)) {
+        return false;
+    }
+    if (browser_index_path(index, i, path, sizeof(path)) < 0 || stat(path, &st) != 0) {
+        return false;
+    }
+    if ((index->entries[i].flags & BROWSER_ENTRY_LISTED) && index->entries[i].mtime == mtime_of(&st)) {
+        return false;
+    }
+    if ((dir = opendir(path)) == NULL) {
+        return false;
+    }
+
+    // The children of before not seen now are gone
+    found = calloc(n_entries, sizeof(bool));
+    while ((ent = readdir(dir)) != NULL) {
+        if (!is_directory(dir, ent)) {
+            continue;
+        }
+        if ((j = find_child(index, i, ent->d_name)) >= 0) {
+            found[j] = true;
+        }
+        else {
+            add_entry(index, i, ent->d_name);
+            changed = true;
+        }
+    }
+    closedir(dir);
+
+    for (j = i + 1; j < n_entries; j++) {
+        if (index->entries[j].parent == i && !found[j]) {
+            changed |= remove_subtree(index, i, browser_index_name(index, j));
+        }
+    }
+    free(found);
+
+    index->entries[i].mtime = mtime_of(&st);
+    index->entries[i].flags |= BROWSER_ENTRY_LISTED;
+    index->dirty = true;
+    if (changed) {
+        index->generation++;
+    }
+    return changed;
+}
+
+
+
+typedef struct {
+    int entry;
+    const char *name;
+    char key[COLLATE_KEY_MAX];
+} SortKey;
+
+
+
+static int compare_sort_keys(const void *a, const void *b) {
+    const SortKey *key_a = a, *key_b = b;
+    int diff = collate_compare(key_a->key, key_b->key);
+
+    // Names that only differ in case or accents still get a fixed order
+    return diff != 0 ? diff : strcmp(key_a->name, key_b->name);
+}
+
+
+
+/**
+ * Sort entries by their names, see collate.h
+ *
+ * @param BrowserIndex* index
+ * @param int*          entries     Sorted in place
+ * @param int           n
+ */
+void browser_index_sort(BrowserIndex *index, int *entries, int n) {
+    SortKey *keys;
+    int i;
+
+    if (n < 2 || (keys = malloc(n * sizeof(SortKey))) == NULL) {
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        keys[i].entry = entries[i];
+        keys[i].name = browser_index_name(index, entries[i]);
+        collate_key(keys[i].name, keys[i].key, sizeof(keys[i].key));
+    }
+    qsort(keys, n, sizeof(SortKey), compare_sort_keys);
+    for (i = 0; i < n; i++) {
+        entries[i] = keys[i].entry;
+    }
+    free(keys);
+}
+
+
+
+/*
+ * The order the entries are saved in: breadth first, the children of each
+ * directory sorted, the removed ones left out
+ *
+ * @return int      Number of entries in `order`
+ */
+static int save_order(BrowserIndex *index, int *order) {
+    BrowserEntry *entries = index->entries;
+    int n = index->n_entries;
+    int *first = calloc(n + 1, sizeof(int));
+    int *children = malloc(n * sizeof(int));
+    int *next = malloc(n * sizeof(int));
+    int i, head, tail;
+
+    // Group the children by their parent
+    for (i = 1; i < n; i++) {
+        if (entries[i].parent >= 0) {
+            first[entries[i].parent + 1]++;
+        }
+    }
+    for (i = 0; i < n; i++) {
+        first[i + 1] += first[i];
+        next[i] = first[i];
+    }
+    for (i = 1; i < n; i++) {
+        if (entries[i].parent >= 0) {
+            children[next[entries[i].parent]++] = i;
+        }
+    }
+
+    order[0] = 0;
+    for (head = 0, tail = 1; head < tail; head++) {
+        i = order[head];
+        browser_index_sort(index, children + first[i], first[i + 1] - first[i]);
+        memcpy(order + tail, children + first[i], (first[i + 1] - first[i]) * sizeof(int));
+        tail += first[i + 1] - first[i];
+    }
+
+    free(first);
+    free(children);
+    free(next);
+    return tail;
+}
+
+
+
+/**
+ * Save the index to `filename`, replacing it at once so that a crash
+ * leaves the old one
+ *
+ * @return int      0 on success, -1 on failure
+ */
+int browser_index_save(BrowserIndex *index, const char *filename) {
+    BrowserIndexHeader header;
+    BrowserEntry entry;
+    char tmp_filename[PATH_MAX];
+    int *order = malloc(index->n_entries * sizeof(int));
+    int *moved_to = malloc(index->n_entries * sizeof(int));
+    uint32_t name = 0;
+    int i, n;
+    FILE *file;
+    bool ok;
+
+    snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+    if (order == NULL || moved_to == NULL || (file = fopen(tmp_filename, "w")) == NULL) {
+        syslog(LOG_WARNING, "Failed to save the browser index to %s\n", filename);
+        free(order);
+        free(moved_to);
+        return -1;
+    }
+
+    n = save_order(index, order);
+    for (i = 0; i < n; i++) {
+        moved_to[order[i]] = i;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, BROWSER_INDEX_MAGIC, sizeof(header.magic));
+    header.version = BROWSER_INDEX_VERSION;
+    header.entry_size = sizeof(BrowserEntry);
+    header.n_entries = n;
+    header.key = index->key;
+    g_strlcpy(header.base_path, index->base_path, sizeof(header.base_path));
+    for (i = 0; i < n; i++) {
+        header.arena_len += strlen(browser_index_name(index, order[i])) + 1;
+    }
+    ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    for (i = 0; i < n && ok; i++) {
+        entry = index->entries[order[i]];
+        entry.name = name;
+        entry.parent = entry.parent >= 0 ? moved_to[entry.parent] : -1;
+        entry.wd = -1;
+        name += strlen(browser_index_name(index, order[i])) + 1;
+        ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+    }
+    for (i = 0; i < n && ok; i++) {
+        ok = fputs(browser_index_name(index, order[i]), file) >= 0 && fputc('\0', file) != EOF;
+    }
+    free(order);
+    free(moved_to);
+
+    if (fclose(file) != 0 || !ok || rename(tmp_filename, filename) != 0) {
+        syslog(LOG_WARNING, "Failed to save the browser index to %s\n", filename);
+        unlink(tmp_filename);
+        return -1;
+    }
+    index->dirty = false;
+    return 0;
+}
+
+
+
+/*
+ * Whether the mapped file holds a sound index of `base_path`
+ */
+static bool check_file(const char *map, size_t size, const gchar *base_path) {
+    const BrowserIndexHeader *header = (const BrowserIndexHeader *)map;
+    const BrowserEntry *entries = (const BrowserEntry *)(map + sizeof(BrowserIndexHeader));
+    const char *arena;
+    uint32_t i;
+
+    if (size < sizeof(BrowserIndexHeader) ||
+        memcmp(header->magic, BROWSER_INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->version != BROWSER_INDEX_VERSION ||
+        header->entry_size != sizeof(BrowserEntry) ||
+        strncmp(header->base_path, base_path, sizeof(header->base_path)) != 0 ||
+        header->n_entries == 0 || header->arena_len == 0 ||
+        size != sizeof(BrowserIndexHeader) + (uint64_t)header->n_entries * sizeof(BrowserEntry) + header->arena_len) {
+        return false;
+    }
+
+    arena = (const char *)(entries + header->n_entries);
+    if (arena[header->arena_len - 1] != '\0') {
+        return false;
+    }
+    for (i = 0; i < header->n_entries; i++) {
+        if (entries[i].name >= header->arena_len || entries[i].parent < -1 ||
+            entries[i].parent >= (int32_t)i || (entries[i].parent == -1) != (i == 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+
+/**
+ * Load an index saved with browser_index_save(). Nothing below
+ * `base_path` is read: the directories are checked when they are listed.
+ *
+ * @param const char*       filename
+ * @param const gchar*      base_path   The index must be of this one
+ * @return BrowserIndex*    NULL if there is no such file or it does not
+ *                          hold an index of `base_path`
+ */
+BrowserIndex *browser_index_load(const char *filename, const gchar *base_path) {
+    const BrowserIndexHeader *header;
+    BrowserIndex *index = NULL;
+    struct stat st;
+    char *map;
+    int fd, i;
+
+    if ((fd = open(filename, O_RDONLY | O_CLOEXEC)) < 0) {
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size == 0 ||
+        (map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+    close(fd);
+
+    header = (const BrowserIndexHeader *)map;
+    if (!check_file(map, st.st_size, base_path)) {
+        syslog(LOG_WARNING, "Ignoring the browser index in %s, it is not one of %s\n", filename, base_path);
+    }
+    else if ((index = calloc(1, sizeof(BrowserIndex))) != NULL) {
+        g_strlcpy(index->base_path, base_path, sizeof(index->base_path));
+        index->inotify_fd = -1;
+        index->watches = g_hash_table_new(g_direct_hash, g_direct_equal);
+        index->key = header->key;
+
+        index->n_entries = index->size = header->n_entries;
+        index->entries = malloc(index->size * sizeof(BrowserEntry));
+        memcpy(index->entries, map + sizeof(BrowserIndexHeader), index->size * sizeof(BrowserEntry));
+        for (i = 0; i < index->n_entries; i++) {
+            index->entries[i].wd = -1;
+        }
+        index->arena_len = index->arena_size = header->arena_len;
+        index->arena = malloc(index->arena_size);
+        memcpy(index->arena, map + sizeof(BrowserIndexHeader) + index->size * sizeof(BrowserEntry), index->arena_len);
+
+        syslog(LOG_INFO, "Loaded %d directories below %s from %s\n", index->n_entries - 1, base_path, filename);
+    }
+
+    munmap(map, st.st_size);
+    return index;
+}
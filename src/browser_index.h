@@ -0,0 +1,99 @@
+/**
+ * Index of the directories below the music folder
+ *
+ * All directories in one flat array, each entry pointing to its parent, a
+ * parent always coming before its children, and all names in one string
+ * arena. It is built once, reading the tree on all cores with dir_scan.h,
+ * and then kept up to date from inotify events, so the browser never has
+ * to walk the tree again. An empty index is filled by its user instead,
+ * e.g. from mpd.
+ *
+ * The index is saved to a file and loaded from it on the next start. A
+ * loaded index is neither walked nor watched: each directory remembers
+ * its mtime, and browser_index_list() compares it to the one on the disk
+ * when the directory is visited, reading it again only if it has changed.
+ *
+ * @package kiddyblaster
+ */
+#ifndef __BROWSER_INDEX_H__
+#define __BROWSER_INDEX_H__
+
+#include <glib.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Parent of the entries that have been removed
+#define BROWSER_INDEX_REMOVED -2
+
+// Removed entries are dropped from the array once they make up this share
+// of it, in percent
+#define BROWSER_INDEX_COMPACT_PERCENT 50
+
+#define BROWSER_INDEX_MAGIC "KBIX"
+#define BROWSER_INDEX_VERSION 1
+
+// The subdirectories of the entry are in the index
+#define BROWSER_ENTRY_LISTED 0x01
+
+/*
+ * A directory, stored in the file as it is
+ */
+typedef struct {
+    uint32_t name;          // Offset into the arena
+    int32_t parent;         // Index of the parent, -1 for the base directory
+    int64_t mtime;          // Of the directory when it has been listed
+    int32_t wd;             // inotify watch, -1 if none
+    uint32_t flags;         // BROWSER_ENTRY_*
+} BrowserEntry;
+
+/*
+ * The file starts with this, followed by the entries and the arena. The
+ * entries are in breadth-first order with the children of each directory
+ * sorted, see collate.h.
+ */
+typedef struct {
+    char magic[4];          // BROWSER_INDEX_MAGIC
+    uint32_t version;       // BROWSER_INDEX_VERSION
+    uint32_t entry_size;    // sizeof(BrowserEntry)
+    uint32_t n_entries;
+    uint64_t arena_len;
+    uint64_t key;
+    char base_path[256];
+} BrowserIndexHeader;
+
+typedef struct {
+    gchar base_path[256];
+
+    // Entry 0 is the base directory itself
+    BrowserEntry *entries;
+    int n_entries;
+    int size;
+    int n_removed;
+
+    char *arena;
+    size_t arena_len;
+    size_t arena_size;
+
+    int inotify_fd;
+    GHashTable *watches;    // wd -> entry index + 1
+    bool watches_exhausted;
+
+    unsigned int generation;    // Changes whenever the entries do
+    uint64_t key;           // Set by the user to tell a stale file, e.g. from mpd
+    bool dirty;             // Changed since it has been loaded or saved
+} BrowserIndex;
+
+BrowserIndex *browser_index_new(const gchar *base_path);
+BrowserIndex *browser_index_new_empty(const gchar *base_path);
+int browser_index_add(BrowserIndex *index, int parent, const char *name);
+void browser_index_clear(BrowserIndex *index);
+void browser_index_free(BrowserIndex *index);
+bool browser_index_update(BrowserIndex *index);
+const char *browser_index_name(BrowserIndex *index, int i);
+int browser_index_path(BrowserIndex *index, int i, char *path, size_t size);
+bool browser_index_list(BrowserIndex *index, int i);
+void browser_index_sort(BrowserIndex *index, int *entries, int n);
+int browser_index_save(BrowserIndex *index, const char *filename);
+BrowserIndex *browser_index_load(const char *filename, const gchar *base_path);
+
+#endif
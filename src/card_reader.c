@@ -1,69 +1,561 @@
 #include <syslog.h>
+#include <signal.h>
+#include <stdlib.h>
 #include <pigpio.h>
 
 #include "mfrc522.h"
 #include "card_reader.h"
 #include "i2c_lcd.h"
+#include "metrics.h"
+#include "rx_gain.h"
+#include "latency.h"
 
 
 
-extern Uid uid;
-typedef void (*callback_t)();
-
-
 // This is the default key for authentication
 static MIFARE_Key auth_key = {{ 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }};
 
 
 
-void card_reader_init() {
-    mfrc522_init();
+/*
+ * Time on the reader bus' clock, so recovery times are also right on
+ * simulated or replayed buses
+ */
+static uint64_t reader_now(CardReader *reader) {
+    return reader->pcd != NULL ? spi_bus_now(reader->pcd->bus) : spi_monotonic_now();
+}
+
+
+
+/*
+ * Where the calibrated receiver gain of the reader is kept
+ */
+static void rx_gain_path(CardReader *reader, char *path, size_t size) {
+    snprintf(path, size, "%s.%s", RX_GAIN_FILE, reader->name);
+}
+
+
+
+/*
+ * Initialize the PCD, a reset also resets the receiver gain
+ */
+static void configure_reader(CardReader *reader) {
     mfrc522_pcd_init();
+    if (reader->rx_gain >= 0) {
+        mfrc522_pcd_set_antenna_gain(reader->rx_gain);
+    }
+}
+
+
+
+static bool open_reader(CardReader *reader) {
+    SpiBus *bus = spi_spidev_new(reader->spi_device, CARD_READER_SPI_SPEED, reader->reset_gpio);
+    if (bus == NULL) {
+        syslog(LOG_ERR, "Failed to open SPI bus for the %s card reader\n", reader->name);
+        return false;
+    }
+    reader->pcd = mfrc522_new(bus);
+    mfrc522_use(reader->pcd);
+    configure_reader(reader);
+    return true;
 }
 
 
 
 /**
- * Check for new cards.
- * This function is executed as a thread
+ * Check that the reader answers and still has the configuration from
+ * mfrc522_pcd_init(). A dead SPI link reads 0x00 or 0xff as version; after
+ * a brown-out the chip answers again, but with its registers back at their
+ * defaults, i.e. the timer set up for nothing and the antenna off.
  *
+ * @param CardReader*   reader
+ * @return bool
  */
+static bool reader_responds(CardReader *reader) {
+    if (reader->pcd == NULL) {
+        return false;
+    }
+
+    byte version = mfrc522_pcd_read_register(VersionReg);
+    switch (version) {
+        case 0x88:  // Clone
+        case 0x90:  // Version 0.0
+        case 0x91:  // Version 1.0
+        case 0x92:  // Version 2.0
+            break;
+        default:
+            syslog(LOG_WARNING, "Card reader %s: unexpected version 0x%02x\n", reader->name, version);
+            return false;
+    }
 
+    if (mfrc522_pcd_read_register(TModeReg) != 0x80 || (mfrc522_pcd_read_register(TxControlReg) & 0x03) != 0x03) {
+        syslog(LOG_WARNING, "Card reader %s: lost its configuration\n", reader->name);
+        return false;
+    }
+    return true;
+}
 
-void* read_cards(void *callback) {
 
-    int card_id = 0;
 
-    while(1) {
-        gpioDelay(500000);
+/**
+ * Open a card reader and check that it answers
+ *
+ * @param const char*           name        Identifies the reader in the log and its calibration file
+ * @param const char*           spi_device  e.g. CARD_READER_SPI_DEVICE
+ * @param int                   reset_gpio  GPIO of the NRSTPD line, -1 if not connected
+ * @param CardReaderConfig*     config
+ * @return CardReader*          Free with card_reader_free()
+ */
+CardReader *card_reader_new(const char *name, const char *spi_device, int reset_gpio, CardReaderConfig *config) {
+    char path[128];
+
+    CardReader *reader = calloc(1, sizeof(CardReader));
+    if (reader == NULL) {
+        return NULL;
+    }
+    snprintf(reader->name, sizeof(reader->name), "%s", name);
+    snprintf(reader->spi_device, sizeof(reader->spi_device), "%s", spi_device);
+    reader->reset_gpio = reset_gpio;
+    reader->config = config;
+
+    rx_gain_path(reader, path, sizeof(path));
+    reader->rx_gain = rx_gain_load(path);
+    if (reader->rx_gain >= 0) {
+        syslog(LOG_NOTICE, "Card reader %s: using calibrated RxGain of %d dB\n", name, rx_gain_db(reader->rx_gain));
+    }
+
+    reader->healthy = open_reader(reader) && reader_responds(reader);
+    if (!reader->healthy) {
+        reader->down_since = reader_now(reader);
+        // Maybe none is fitted, don't keep its bus and reset line till the
+        // next attempt to recover it opens them again
+        mfrc522_free(reader->pcd);
+        reader->pcd = NULL;
+    }
+    mfrc522_use(NULL);
+    return reader;
+}
+
+
+
+void card_reader_free(CardReader *reader) {
+    if (reader == NULL) {
+        return;
+    }
+    mfrc522_free(reader->pcd);
+    free(reader);
+}
+
+
+
+/**
+ * Spread the polls of the readers evenly over the poll interval, so they
+ * take turns on the SPI bus instead of all polling at once
+ *
+ * @param CardReader**  readers
+ * @param int           n_readers
+ */
+void card_reader_schedule(CardReader **readers, int n_readers) {
+    int i;
+    for (i = 0; i < n_readers; i++) {
+        readers[i]->poll_offset = i * CARD_READER_POLL_INTERVAL / n_readers;
+    }
+}
+
 
-        // Check for a new rfid card
-        if (!mfrc522_picc_is_new_card_present()) {
+
+bool card_reader_is_healthy(CardReader *reader) {
+    return reader->healthy;
+}
+
+
+
+/**
+ * Try to bring the reader back: run the self test, pull the reset line if
+ * it fails (falls back to a soft reset without one) and initialize the PCD
+ * again. Reopens the bus if it could not be opened at all.
+ *
+ * @param CardReader*   reader
+ * @return bool         Whether the reader works again
+ */
+static bool recover_reader(CardReader *reader) {
+    metrics_inc(METRIC_READER_RECOVERY_ATTEMPTS);
+
+    if (reader->pcd == NULL) {
+        return open_reader(reader) && reader_responds(reader);
+    }
+
+    if (!mfrc522_pcd_perform_self_test()) {
+        metrics_inc(METRIC_READER_SELF_TEST_FAILURES);
+        syslog(LOG_WARNING, "Card reader %s: self test failed, resetting\n", reader->name);
+        spi_bus_set_reset(reader->pcd->bus, 0);
+        spi_bus_delay(reader->pcd->bus, 1);
+    }
+    // Hard reset if the line is low, soft reset otherwise
+    configure_reader(reader);
+
+    return reader_responds(reader);
+}
+
+
+
+/**
+ * Check the reader every CARD_READER_HEALTH_INTERVAL polls while it works,
+ * on every poll while it does not, and try to recover it.
+ *
+ * @param CardReader*   reader
+ * @return bool         Whether the health state has changed
+ */
+static bool check_health(CardReader *reader) {
+    if (reader->healthy && ++reader->polls < CARD_READER_HEALTH_INTERVAL) {
+        return false;
+    }
+    reader->polls = 0;
+
+    metrics_inc(METRIC_READER_HEALTH_CHECKS);
+    if (reader->healthy && reader_responds(reader)) {
+        return false;
+    }
+
+    metrics_inc(METRIC_READER_HEALTH_FAILURES);
+    bool was_healthy = reader->healthy;
+    if (was_healthy) {
+        reader->healthy = false;
+        reader->down_since = reader_now(reader);
+        syslog(LOG_ERR, "Card reader %s is not responding, trying to recover\n", reader->name);
+    }
+
+    if (!recover_reader(reader)) {
+        return was_healthy;
+    }
+
+    uint64_t elapsed_ms = (reader_now(reader) - reader->down_since) / 1000;
+    metrics_inc(METRIC_READER_RECOVERIES);
+    metrics_add(METRIC_READER_RECOVERY_MS_TOTAL, elapsed_ms);
+    metrics_max(METRIC_READER_RECOVERY_MS_MAX, elapsed_ms);
+    syslog(LOG_NOTICE, "Card reader %s recovered after %llu ms\n", reader->name, (unsigned long long)elapsed_ms);
+
+    reader->healthy = true;
+    return !was_healthy;
+}
+
+
+
+static bool uid_equals(Uid *a, Uid *b) {
+    return a->size == b->size && memcmp(a->uidByte, b->uidByte, a->size) == 0;
+}
+
+
+
+/**
+ * Select a card the enumeration has left halted, authenticate and read its
+ * id from block 8, then halt it again
+ *
+ * @return int      The card id or -1 on failure
+ */
+static int read_card_id(Uid *card_uid) {
+    byte atqa[2];
+    byte size = sizeof(atqa);
+    byte result = mfrc522_picc_wakeup_a(atqa, &size);
+    int card_id = -1;
+
+    if (result != STATUS_OK && result != STATUS_COLLISION) {
+        return -1;
+    }
+    latency_tap_mark(LATENCY_REQA);
+
+    // Select exactly this card, all others go back to HALT
+    Uid selected = *card_uid;
+    if (mfrc522_picc_select(&selected, card_uid->size * 8) != STATUS_OK) {
+        return -1;
+    }
+    latency_tap_mark(LATENCY_SELECT);
+
+    if (mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, 8, &auth_key, card_uid) != STATUS_OK) {
+        syslog(LOG_ERR, "Failed to authenticate\n");
+        mfrc522_picc_halt_a();
+        return -1;
+    }
+
+    byte data[16];
+    unsigned int len = sizeof(data);
+    result = mfrc522_mifare_read_blocks(8, 1, data, &len);
+    mfrc522_pcd_stop_crypto_1();
+    if (result != STATUS_OK) {
+        syslog(LOG_ERR, "Failed to read card: %s\n", mfrc522_get_status_code_name(result));
+    }
+    else {
+        syslog(LOG_NOTICE, "%02x %02x %02x %02x\n", data[0], data[1], data[2], data[3]);
+        card_id = data[0] + 256 * data[1];
+    }
+    mfrc522_picc_halt_a();
+    if (card_id >= 0) {
+        latency_tap_mark(LATENCY_READ);
+    }
+
+    return card_id;
+}
+
+
+
+static int tracker_find(CardReader *reader, Uid *card_uid) {
+    int i;
+    for (i = 0; i < reader->n_cards; i++) {
+        if (uid_equals(&reader->cards[i].uid, card_uid)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+
+static RecentRead *recent_find(CardReader *reader, Uid *card_uid) {
+    int i;
+    for (i = 0; i < CARD_READER_RECENT_READS; i++) {
+        if (uid_equals(&reader->recent[i].uid, card_uid)) {
+            return &reader->recent[i];
+        }
+    }
+    return NULL;
+}
+
+
+
+/*
+ * Remember a card that has just been read as lying on the reader
+ */
+static void recent_add(CardReader *reader, TrackedCard *card) {
+    RecentRead *recent = recent_find(reader, &card->uid);
+    if (recent == NULL) {
+        recent = &reader->recent[reader->next_recent];
+        reader->next_recent = (reader->next_recent + 1) % CARD_READER_RECENT_READS;
+    }
+    recent->uid = card->uid;
+    recent->card_id = card->card_id;
+    recent->removed_at = 0;
+}
+
+
+
+/*
+ * Whether a card that has just shown up is one put back within the
+ * cooldown. If so it takes over the card id it was read with before.
+ */
+static bool recent_returned(CardReader *reader, TrackedCard *card) {
+    RecentRead *recent = recent_find(reader, &card->uid);
+    uint64_t cooldown = (uint64_t)reader->config->cooldown * 1000;
+
+    if (recent == NULL || recent->removed_at == 0 || reader_now(reader) - recent->removed_at >= cooldown) {
+        return false;
+    }
+    card->card_id = recent->card_id;
+    recent->removed_at = 0;
+    return true;
+}
+
+
+
+/**
+ * Number of readable cards seen on the reader by the latest poll
+ */
+int card_reader_cards_present(CardReader *reader) {
+    int i, n = 0;
+    for (i = 0; i < reader->n_cards; i++) {
+        if (reader->cards[i].misses == 0 && reader->cards[i].card_id >= 0) {
+            n++;
+        }
+    }
+    return n;
+}
+
+
+
+/**
+ * Poll the reader once: enumerate all cards in the field and report what
+ * has changed since the last poll through the callbacks.
+ *
+ * Only cards that have not been read yet are authenticated and read, in
+ * the order they have shown up; one that fails is tried again with the
+ * next poll. A card only counts as removed after `debounce` consecutive
+ * polls without seeing it; one put back within the cooldown is reported
+ * through on_card_returned instead of being read again, and arrives with
+ * the card id it had unless that callback takes care of it.
+ *
+ * @param CardReader*   reader
+ * @param int           debounce
+ */
+static void poll_cards(CardReader *reader, int debounce) {
+    CardReaderConfig *config = reader->config;
+    Uid found[CARD_READER_MAX_CARDS];
+    uint64_t polled_at = latency_now();
+    int n_found = mfrc522_picc_enumerate(found, CARD_READER_MAX_CARDS);
+    int i;
+
+    for (i = 0; i < reader->n_cards; i++) {
+        reader->cards[i].misses++;
+    }
+    for (i = 0; i < n_found; i++) {
+        int j = tracker_find(reader, &found[i]);
+        if (j >= 0) {
+            reader->cards[j].misses = 0;
+        }
+        else if (reader->n_cards < CARD_READER_MAX_CARDS) {
+            TrackedCard *card = &reader->cards[reader->n_cards++];
+            card->uid = found[i];
+            card->card_id = -1;
+            card->attempts = 0;
+            card->misses = 0;
+            card->seen_at = polled_at;
+
+            if (recent_returned(reader, card)) {
+                // Without a callback a card put back is left alone
+                if (config->on_card_returned == NULL || config->on_card_returned(card->card_id)) {
+                    syslog(LOG_NOTICE, "Card #%d is back on the %s reader\n", card->card_id, reader->name);
+                    metrics_inc(METRIC_RETRIGGERS_SUPPRESSED);
+                }
+                else {
+                    config->on_card_arrived(card->card_id);
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < reader->n_cards; i++) {
+        TrackedCard *card = &reader->cards[i];
+        if (card->misses > 0) {
+            continue;
+        }
+        if (card->card_id >= 0) {
+            if (config->on_card_still_present != NULL) {
+                config->on_card_still_present(card->card_id);
+            }
             continue;
         }
 
-        if (!mfrc522_picc_read_card_serial()) {
+        // The tap is followed on to the callbacks, see latency.c
+        card->attempts++;
+        metrics_inc(METRIC_READER_READ_ATTEMPTS);
+        latency_tap_start(card->seen_at);
+        if ((card->card_id = read_card_id(&card->uid)) < 0) {
+            metrics_inc(METRIC_READER_READ_FAILURES);
+            latency_tap_cancel();
             continue;
         }
+        metrics_inc(METRIC_READER_CARDS_READ);
+        metrics_add(METRIC_READER_TAPS_TO_PLAY_TOTAL, card->attempts);
+        reader->pcd->uid = card->uid;
+        recent_add(reader, card);
+
+        config->on_card_arrived(card->card_id);
+        latency_tap_cancel();
+    }
 
-        // Authenticate
-        if(mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, 8, &auth_key, &uid) != STATUS_OK) {
-            syslog(LOG_ERR, "Failed to authenticate\n");
+    for (i = 0; i < reader->n_cards; ) {
+        TrackedCard *card = &reader->cards[i];
+        if (card->misses < debounce) {
+            i++;
             continue;
         }
+        int card_id = card->card_id;
+        RecentRead *recent = recent_find(reader, &card->uid);
+        if (recent != NULL) {
+            recent->removed_at = reader_now(reader);
+        }
+        reader->n_cards--;
+        memmove(card, card + 1, (reader->n_cards - i) * sizeof(TrackedCard));
 
-        byte data[32];
-        byte size = sizeof(data);
-        /* mfrc522_pcd_read_register_multi(8, sizeof(data), data, 1); */
-        mfrc522_mifare_read(8, data, &size);
-        mfrc522_pcd_stop_crypto_1();
-        syslog(LOG_NOTICE, "%02x %02x %02x %02x\n", data[0], data[1], data[2], data[3]);
+        if (card_id < 0) {
+            continue;
+        }
+        syslog(LOG_NOTICE, "Card #%d has been removed from the %s reader\n", card_id, reader->name);
+        if (config->on_card_removed != NULL) {
+            config->on_card_removed(card_id);
+        }
+    }
+}
 
-        card_id = data[0] + 256 * data[1];
 
-        callback_t cb = callback;
-        cb(card_id);
 
+/**
+ * Calibrate the receiver gain with the next poll, a card needs to lie on
+ * the reader. Safe to call from a signal handler.
+ */
+void card_reader_request_calibration(CardReader *reader) {
+    reader->calibration_requested = true;
+}
+
+
+
+/**
+ * Sweep all receiver gain settings with the card lying on the reader and
+ * keep the best one, also across restarts
+ */
+static void calibrate(CardReader *reader) {
+    RxGainStats before, results[RX_GAIN_SETTINGS];
+    char path[128];
+    int i;
+
+    syslog(LOG_NOTICE, "Card reader %s: calibrating the receiver gain\n", reader->name);
+    rx_gain_measure(mfrc522_pcd_get_antenna_gain(), &auth_key, 8, RX_GAIN_ATTEMPTS, &before);
+
+    int best = rx_gain_calibrate(&auth_key, 8, RX_GAIN_ATTEMPTS, results);
+    for (i = 0; i < RX_GAIN_SETTINGS; i++) {
+        rx_gain_report("sweep", &results[i]);
+    }
+    if (best < 0) {
+        syslog(LOG_WARNING, "Card reader %s: no card could be read, keeping the receiver gain\n", reader->name);
+        configure_reader(reader);
+        return;
+    }
+
+    rx_gain_report("before", &before);
+    for (i = 0; i < RX_GAIN_SETTINGS; i++) {
+        if (results[i].gain == best) {
+            rx_gain_report("after", &results[i]);
+        }
     }
+
+    reader->rx_gain = best;
+    rx_gain_path(reader, path, sizeof(path));
+    rx_gain_save(path, best);
 }
 
+
+
+/**
+ * Check for cards arriving at and leaving the reader.
+ * This function is executed as a thread, one per reader: the driver talks
+ * to one reader per thread, so a reader waiting for a card to answer does
+ * not hold up the others.
+ *
+ * @param CardReader*   reader
+ */
+void* read_cards(void *data) {
+
+    CardReader *reader = data;
+    CardReaderConfig *config = reader->config;
+    int debounce = config->removal_debounce > 0 ? config->removal_debounce : CARD_REMOVAL_DEBOUNCE;
+
+    mfrc522_use(reader->pcd);
+    gpioDelay(reader->poll_offset);
+
+    while(1) {
+        gpioDelay(CARD_READER_POLL_INTERVAL);
+
+        if (check_health(reader) && config->on_health_changed != NULL) {
+            config->on_health_changed(reader->healthy);
+        }
+        if (!reader->healthy) {
+            continue;
+        }
+
+        if (reader->calibration_requested) {
+            reader->calibration_requested = false;
+            calibrate(reader);
+        }
+
+        metrics_inc(METRIC_READER_POLLS);
+        poll_cards(reader, debounce);
+    }
+}
@@ -1,7 +1,109 @@
 #ifndef __CARD_READER_H__
 #define __CARD_READER_H__
 
-void card_reader_init();
-void* read_cards(void *callback);
+#include <stdbool.h>
+#include <signal.h>
+
+#include "mfrc522.h"
+
+// The MFRC522 on SPI0, CE0, with NRSTPD on pin 22 of the header (GPIO 25)
+#define CARD_READER_SPI_DEVICE "/dev/spidev0.0"
+#define CARD_READER_SPI_SPEED 4000000
+#define CARD_READER_RESET_GPIO 25
+
+// The optional second MFRC522 on SPI0, CE1, with NRSTPD on pin 18 (GPIO 24)
+#define CARD_READER_2_SPI_DEVICE "/dev/spidev0.1"
+#define CARD_READER_2_RESET_GPIO 24
+
+// Cards that can lie on the reader at the same time
+#define CARD_READER_MAX_CARDS 4
+
+// Number of consecutive polls without an answer before a card counts as removed
+#define CARD_REMOVAL_DEBOUNCE 3
+
+// Check the reader's health every N polls (while it is healthy)
+#define CARD_READER_HEALTH_INTERVAL 10
+
+// Time between two polls of a reader in µs
+#define CARD_READER_POLL_INTERVAL 500000
+
+// A card put back within this many ms after it has been removed is not
+// reported as arriving again
+#define CARD_READER_COOLDOWN 10000
+
+// Cards remembered for the cooldown, per reader
+#define CARD_READER_RECENT_READS 8
+
+typedef void (*card_callback_t)(int card_id);
+typedef bool (*card_returned_callback_t)(int card_id);
+typedef void (*reader_health_callback_t)(bool healthy);
+
+typedef struct {
+    card_callback_t on_card_arrived;
+    card_callback_t on_card_still_present;  // optional, may be NULL
+    card_callback_t on_card_removed;        // optional, may be NULL
+    int removal_debounce;                   // see CARD_REMOVAL_DEBOUNCE
+    reader_health_callback_t on_health_changed;     // optional, may be NULL
+    card_returned_callback_t on_card_returned;      // optional, may be NULL; put back within the
+                                            // cooldown, false to have it arrive again
+    int cooldown;                           // in ms, see CARD_READER_COOLDOWN, 0 for none
+} CardReaderConfig;
+
+/*
+ * A card lying on the reader
+ */
+typedef struct {
+    Uid uid;
+    int card_id;            // -1 as long as it could not be read
+    int attempts;           // Polls it took to read the card
+    int misses;             // Consecutive polls it has not been seen in
+    uint64_t seen_at;       // Start of the poll that first saw it, see latency_now()
+} TrackedCard;
+
+/*
+ * A card that has been read on the reader, kept after it has been removed
+ */
+typedef struct {
+    Uid uid;
+    int card_id;
+    uint64_t removed_at;    // Reader time in µs, 0 while the card is on the reader
+} RecentRead;
+
+/*
+ * One MFRC522 with everything kept about it. Every reader is polled by its
+ * own thread running read_cards().
+ */
+typedef struct {
+    char name[16];
+    char spi_device[32];
+    int reset_gpio;
+    CardReaderConfig *config;
+    MFRC522 *pcd;
+    unsigned int poll_offset;   // µs the first poll is delayed, spreads the readers' polls
+
+    // The cards on the reader, in the order they have arrived
+    TrackedCard cards[CARD_READER_MAX_CARDS];
+    int n_cards;
+
+    // The cards read lately, by UID, oldest overwritten first
+    RecentRead recent[CARD_READER_RECENT_READS];
+    int next_recent;
+
+    // Health of the reader itself
+    bool healthy;
+    int polls;              // Since the last health check
+    uint64_t down_since;    // Bus time in µs when the outage was detected
+
+    int rx_gain;            // Calibrated receiver gain, -1 for the chip's default
+    volatile sig_atomic_t calibration_requested;
+} CardReader;
+
+CardReader *card_reader_new(const char *name, const char *spi_device, int reset_gpio, CardReaderConfig *config);
+void card_reader_free(CardReader *reader);
+void card_reader_schedule(CardReader **readers, int n_readers);
+bool card_reader_is_healthy(CardReader *reader);
+int card_reader_cards_present(CardReader *reader);
+void card_reader_request_calibration(CardReader *reader);
+void* read_cards(void *reader);
 
 #endif
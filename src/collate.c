@@ -0,0 +1,154 @@
+/**
+ * Sort order for directory names
+ *
+ * @package kiddyblaster
+ */
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "collate.h"
+#include "lcd_charset.h"
+
+/*
+ * Latin-1 Supplement and Latin Extended-A letters folded to ASCII, from
+ * U+00C0, NULL for what is not a letter
+ */
+static const char *folds[] = {
+    "a", "a", "a", "a", "a", "a", "ae", "c",        // U+00C0
+    "e", "e", "e", "e", "i", "i", "i", "i",         // U+00C8
+    "d", "n", "o", "o", "o", "o", "o", NULL,        // U+00D0
+    "o", "u", "u", "u", "u", "y", "th", "ss",       // U+00D8
+    "a", "a", "a", "a", "a", "a", "ae", "c",        // U+00E0
+    "e", "e", "e", "e", "i", "i", "i", "i",         // U+00E8
+    "d", "n", "o", "o", "o", "o", "o", NULL,        // U+00F0
+    "o", "u", "u", "u", "u", "y", "th", "y",        // U+00F8
+    "a", "a", "a", "a", "a", "a", "c", "c",         // U+0100
+    "c", "c", "c", "c", "c", "c", "d", "d",         // U+0108
+    "d", "d", "e", "e", "e", "e", "e", "e",         // U+0110
+    "e", "e", "e", "e", "g", "g", "g", "g",         // U+0118
+    "g", "g", "g", "g", "h", "h", "h", "h",         // U+0120
+    "i", "i", "i", "i", "i", "i", "i", "i",         // U+0128
+    "i", "i", "ij", "ij", "j", "j", "k", "k",       // U+0130
+    "k", "l", "l", "l", "l", "l", "l", "l",         // U+0138
+    "l", "l", "l", "n", "n", "n", "n", "n",         // U+0140
+    "n", "n", "n", "n", "o", "o", "o", "o",         // U+0148
+    "o", "o", "oe", "oe", "r", "r", "r", "r",       // U+0150
+    "r", "r", "s", "s", "s", "s", "s", "s",         // U+0158
+    "s", "s", "t", "t", "t", "t", "t", "t",         // U+0160
+    "u", "u", "u", "u", "u", "u", "u", "u",         // U+0168
+    "u", "u", "u", "u", "w", "w", "y", "y",         // U+0170
+    "y", "z", "z", "z", "z", "z", "z", "s"          // U+0178
+};
+
+#define FOLDS_FIRST 0xc0
+#define FOLDS_END (FOLDS_FIRST + sizeof(folds) / sizeof(*folds))
+
+// Dropped from the start of the folded name, if something follows
+static const char *articles[] = {
+    "der ", "die ", "das ", "ein ", "eine ", "the ", "a ", "an "
+};
+
+
+
+/**
+ * Build the key `name` sorts by
+ *
+ * @param const char*   name    UTF-8
+ * @param char*         key     Receives the key
+ * @param size_t        size    Of `key`
+ * @return size_t       Length of the key
+ */
+size_t collate_key(const char *name, char *key, size_t size) {
+    const unsigned char *s = (const unsigned char *)name, *start;
+    const char *fold;
+    uint32_t code_point;
+    size_t len = 0, n, i;
+
+    while (*s != '\0' && len + 1 < size) {
+        start = s;
+        code_point = lcd_charset_decode(&s);
+
+        if (code_point < 0x80) {
+            key[len++] = code_point >= 'A' && code_point <= 'Z' ? code_point + 'a' - 'A' : code_point;
+            continue;
+        }
+        // Other scripts keep their bytes and sort after the Latin letters
+        fold = code_point >= FOLDS_FIRST && code_point < FOLDS_END ? folds[code_point - FOLDS_FIRST] : NULL;
+        if (fold == NULL) {
+            fold = (const char *)start;
+            n = s - start;
+        }
+        else {
+            n = strlen(fold);
+        }
+        if (len + n + 1 > size) {
+            break;
+        }
+        memcpy(key + len, fold, n);
+        len += n;
+    }
+    key[len] = '\0';
+
+    for (i = 0; i < sizeof(articles) / sizeof(*articles); i++) {
+        n = strlen(articles[i]);
+        if (len > n && strncmp(key, articles[i], n) == 0) {
+            memmove(key, key + n, len - n + 1);
+            len -= n;
+            break;
+        }
+    }
+    return len;
+}
+
+
+
+/**
+ * Compare two keys, numbers by their value
+ *
+ * @return int      < 0, 0 or > 0 as with strcmp()
+ */
+int collate_compare(const char *a, const char *b) {
+    size_t len_a, len_b;
+    int diff;
+
+    while (*a != '\0' && *b != '\0') {
+        if (*a >= '0' && *a <= '9' && *b >= '0' && *b <= '9') {
+            while (*a == '0') {
+                a++;
+            }
+            while (*b == '0') {
+                b++;
+            }
+            len_a = strspn(a, "0123456789");
+            len_b = strspn(b, "0123456789");
+            if (len_a != len_b) {
+                return len_a < len_b ? -1 : 1;
+            }
+            if ((diff = strncmp(a, b, len_a)) != 0) {
+                return diff;
+            }
+            a += len_a;
+            b += len_b;
+            continue;
+        }
+        if (*a != *b) {
+            return (unsigned char)*a - (unsigned char)*b;
+        }
+        a++;
+        b++;
+    }
+    return (unsigned char)*a - (unsigned char)*b;
+}
+
+
+
+/**
+ * The letter a key is filed under, '#' for anything that does not start
+ * with one
+ *
+ * @return char     'A' to 'Z' or '#'
+ */
+char collate_initial(const char *key) {
+    return *key >= 'a' && *key <= 'z' ? *key - 'a' + 'A' : '#';
+}
@@ -0,0 +1,23 @@
+/**
+ * Sort order for directory names
+ *
+ * Names are compared by a key: case and accents folded the way German
+ * dictionaries sort (ä as a, ß as ss), a leading article dropped ("Die
+ * Olchis" sorts under O) and runs of digits compared by their value, so
+ * "Teil 2" comes before "Teil 10".
+ *
+ * @package kiddyblaster
+ */
+#ifndef __COLLATE_H__
+#define __COLLATE_H__
+
+#include <stddef.h>
+
+// Longest key built, longer ones are cut
+#define COLLATE_KEY_MAX 128
+
+size_t collate_key(const char *name, char *key, size_t size);
+int collate_compare(const char *key_a, const char *key_b);
+char collate_initial(const char *key);
+
+#endif
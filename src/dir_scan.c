@@ -0,0 +1,393 @@
+/**
+ * Parallel directory scanner
+ *
+ * @package kiddyblaster
+ */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "dir_scan.h"
+
+/*
+ * What getdents64 fills the buffer with, glibc only has a wrapper for it
+ * since 2.30
+ */
+typedef struct {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+} LinuxDirent64;
+
+/*
+ * Directories to read, its worker takes the newest, thieves the oldest
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    DirScanNode **jobs;     // Ring buffer
+    unsigned int head;
+    unsigned int count;
+    unsigned int size;
+} WorkQueue;
+
+typedef struct DirScan DirScan;
+
+typedef struct {
+    DirScan *scan;
+    int id;
+    pthread_t thread;
+    bool started;
+    WorkQueue queue;
+    char *buffer;
+    DirScanStats stats;
+} Worker;
+
+struct DirScan {
+    const char *path;
+    int root_fd;
+    int inotify_fd;
+    uint32_t watch_mask;
+    Worker workers[DIR_SCAN_MAX_WORKERS];
+    int n_workers;
+    unsigned int pending;   // Directories queued or being read
+    unsigned int queued;    // Directories queued
+    unsigned int waiting;   // Workers waiting for work_queued
+    pthread_mutex_t idle_lock;
+    pthread_cond_t work_queued;     // Also when the last directory is done
+};
+
+
+
+/**
+ * The number of workers to use by default, one per core
+ */
+int dir_scan_workers() {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cores < 1) {
+        return 1;
+    }
+    return cores < DIR_SCAN_MAX_WORKERS ? cores : DIR_SCAN_MAX_WORKERS;
+}
+
+
+
+static DirScanNode *new_node(const char *parent_path, const char *name) {
+    size_t parent_len = strlen(parent_path), name_len = strlen(name);
+    DirScanNode *node = malloc(sizeof(DirScanNode) + parent_len + name_len + 2);
+
+    if (node == NULL) {
+        return NULL;
+    }
+    if (parent_len > 0) {
+        memcpy(node->path, parent_path, parent_len);
+        node->path[parent_len++] = '/';
+    }
+    memcpy(node->path + parent_len, name, name_len + 1);
+    node->name = node->path + parent_len;
+    node->mtime = 0;
+    node->listed = false;
+    node->wd = -1;
+    node->children = NULL;
+    node->next = NULL;
+    return node;
+}
+
+
+
+static void queue_push(WorkQueue *queue, DirScanNode *node) {
+    DirScanNode **jobs;
+    unsigned int i;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count == queue->size) {
+        jobs = malloc((queue->size > 0 ? queue->size * 2 : 256) * sizeof(DirScanNode *));
+        for (i = 0; i < queue->count; i++) {
+            jobs[i] = queue->jobs[(queue->head + i) % queue->size];
+        }
+        free(queue->jobs);
+        queue->jobs = jobs;
+        queue->head = 0;
+        queue->size = queue->size > 0 ? queue->size * 2 : 256;
+    }
+    queue->jobs[(queue->head + queue->count++) % queue->size] = node;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+
+
+/*
+ * Take the newest directory from the queue, or the oldest one
+ */
+static DirScanNode *queue_pop(WorkQueue *queue, bool oldest) {
+    DirScanNode *node = NULL;
+
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count > 0) {
+        if (oldest) {
+            node = queue->jobs[queue->head];
+            queue->head = (queue->head + 1) % queue->size;
+        }
+        else {
+            node = queue->jobs[(queue->head + queue->count - 1) % queue->size];
+        }
+        queue->count--;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return node;
+}
+
+
+
+static void watch(Worker *worker, DirScanNode *node) {
+    DirScan *scan = worker->scan;
+    char path[PATH_MAX];
+
+    if (snprintf(path, sizeof(path), "%s%s%s", scan->path, *node->path != '\0' ? "/" : "", node->path) >= (int)sizeof(path)) {
+        return;
+    }
+    node->wd = inotify_add_watch(scan->inotify_fd, path, scan->watch_mask);
+    if (node->wd < 0 && errno == ENOSPC) {
+        worker->stats.watches_exhausted = true;
+    }
+}
+
+
+
+/*
+ * Queue a directory to be read and wake a worker waiting for one
+ */
+static void schedule(Worker *worker, DirScanNode *node) {
+    DirScan *scan = worker->scan;
+
+    __atomic_add_fetch(&scan->pending, 1, __ATOMIC_SEQ_CST);
+    queue_push(&worker->queue, node);
+    __atomic_add_fetch(&scan->queued, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&scan->waiting, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&scan->idle_lock);
+        pthread_cond_signal(&scan->work_queued);
+        pthread_mutex_unlock(&scan->idle_lock);
+    }
+}
+
+
+
+/*
+ * Sleep until a directory is queued, others are still reading and may
+ * queue more
+ *
+ * @return bool     false once all directories have been read
+ */
+static bool wait_for_work(DirScan *scan) {
+    bool more;
+
+    pthread_mutex_lock(&scan->idle_lock);
+    __atomic_add_fetch(&scan->waiting, 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&scan->queued, __ATOMIC_SEQ_CST) == 0 &&
+           __atomic_load_n(&scan->pending, __ATOMIC_SEQ_CST) != 0) {
+        pthread_cond_wait(&scan->work_queued, &scan->idle_lock);
+    }
+    __atomic_sub_fetch(&scan->waiting, 1, __ATOMIC_SEQ_CST);
+    more = __atomic_load_n(&scan->pending, __ATOMIC_SEQ_CST) != 0;
+    pthread_mutex_unlock(&scan->idle_lock);
+    return more;
+}
+
+
+
+/*
+ * Read one directory, queueing its subdirectories to be read
+ */
+static void read_node(Worker *worker, DirScanNode *node) {
+    DirScan *scan = worker->scan;
+    DirScanNode *child, **last = &node->children;
+    LinuxDirent64 *ent;
+    struct stat st;
+    long len, offset;
+    int fd;
+
+    fd = openat(scan->root_fd, *node->path != '\0' ? node->path : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &st) == 0) {
+        node->mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    }
+    if (scan->inotify_fd >= 0) {
+        watch(worker, node);
+    }
+    worker->stats.directories++;
+
+    while ((len = syscall(SYS_getdents64, fd, worker->buffer, DIR_SCAN_BUFFER_SIZE)) > 0) {
+        for (offset = 0; offset < len; offset += ent->d_reclen) {
+            ent = (LinuxDirent64 *)(worker->buffer + offset);
+            if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0' || (ent->d_name[1] == '.' && ent->d_name[2] == '\0'))) {
+                continue;
+            }
+            if (ent->d_type == DT_UNKNOWN) {
+                worker->stats.stats++;
+                if (fstatat(fd, ent->d_name, &st, 0) != 0 || !S_ISDIR(st.st_mode)) {
+                    continue;
+                }
+            }
+            else if (ent->d_type != DT_DIR) {
+                continue;
+            }
+
+            if ((child = new_node(node->path, ent->d_name)) == NULL) {
+                continue;
+            }
+            *last = child;
+            last = &child->next;
+            schedule(worker, child);
+        }
+    }
+    node->listed = len == 0;
+    close(fd);
+}
+
+
+
+static void *work(void *data) {
+    Worker *worker = data;
+    DirScan *scan = worker->scan;
+    DirScanNode *node;
+    int i;
+
+    for (;;) {
+        node = queue_pop(&worker->queue, false);
+        for (i = 1; node == NULL && i < scan->n_workers; i++) {
+            if ((node = queue_pop(&scan->workers[(worker->id + i) % scan->n_workers].queue, true)) != NULL) {
+                worker->stats.steals++;
+            }
+        }
+
+        if (node == NULL) {
+            if (!wait_for_work(scan)) {
+                break;
+            }
+            continue;
+        }
+        __atomic_sub_fetch(&scan->queued, 1, __ATOMIC_SEQ_CST);
+        read_node(worker, node);
+
+        // The last one lets the waiting workers go
+        if (__atomic_sub_fetch(&scan->pending, 1, __ATOMIC_SEQ_CST) == 0) {
+            pthread_mutex_lock(&scan->idle_lock);
+            pthread_cond_broadcast(&scan->work_queued);
+            pthread_mutex_unlock(&scan->idle_lock);
+        }
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Read the tree of directories below `path`. The calling thread is one of
+ * the workers.
+ *
+ * @param const char*   path
+ * @param int           n_workers   0 for dir_scan_workers()
+ * @param int           inotify_fd  Every directory read is watched with
+ *                                  `watch_mask`, -1 for none
+ * @param uint32_t      watch_mask
+ * @param DirScanStats* stats       Receives the totals, may be NULL
+ * @return DirScanNode* `path` itself, free with dir_scan_free(); NULL if
+ *                      out of memory
+ */
+DirScanNode *dir_scan(const char *path, int n_workers, int inotify_fd, uint32_t watch_mask, DirScanStats *stats) {
+    DirScan scan;
+    DirScanNode *root;
+    Worker *worker;
+    int i;
+
+    if (stats != NULL) {
+        memset(stats, 0, sizeof(DirScanStats));
+    }
+    if ((root = new_node("", "")) == NULL) {
+        return NULL;
+    }
+    if ((scan.root_fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        return root;
+    }
+
+    scan.path = path;
+    scan.inotify_fd = inotify_fd;
+    scan.watch_mask = watch_mask;
+    scan.n_workers = n_workers > 0 && n_workers <= DIR_SCAN_MAX_WORKERS ? n_workers : dir_scan_workers();
+    scan.pending = 1;
+    scan.queued = 1;
+    scan.waiting = 0;
+    pthread_mutex_init(&scan.idle_lock, NULL);
+    pthread_cond_init(&scan.work_queued, NULL);
+    for (i = 0; i < scan.n_workers; i++) {
+        worker = &scan.workers[i];
+        memset(worker, 0, sizeof(Worker));
+        worker->scan = &scan;
+        worker->id = i;
+        pthread_mutex_init(&worker->queue.lock, NULL);
+        worker->buffer = malloc(DIR_SCAN_BUFFER_SIZE);
+    }
+    queue_push(&scan.workers[0].queue, root);
+
+    // A worker that fails to start leaves its queue empty, the others
+    // cover for it
+    for (i = 1; i < scan.n_workers; i++) {
+        if (scan.workers[i].buffer != NULL) {
+            scan.workers[i].started = pthread_create(&scan.workers[i].thread, NULL, work, &scan.workers[i]) == 0;
+        }
+    }
+    if (scan.workers[0].buffer != NULL) {
+        work(&scan.workers[0]);
+    }
+
+    // All are done before any queue goes, they are looked into till the end
+    for (i = 0; i < scan.n_workers; i++) {
+        if (scan.workers[i].started) {
+            pthread_join(scan.workers[i].thread, NULL);
+        }
+    }
+    for (i = 0; i < scan.n_workers; i++) {
+        worker = &scan.workers[i];
+        if (stats != NULL) {
+            stats->directories += worker->stats.directories;
+            stats->stats += worker->stats.stats;
+            stats->steals += worker->stats.steals;
+            stats->watches_exhausted |= worker->stats.watches_exhausted;
+        }
+        pthread_mutex_destroy(&worker->queue.lock);
+        free(worker->queue.jobs);
+        free(worker->buffer);
+    }
+    pthread_cond_destroy(&scan.work_queued);
+    pthread_mutex_destroy(&scan.idle_lock);
+    close(scan.root_fd);
+    return root;
+}
+
+
+
+void dir_scan_free(DirScanNode *root) {
+    DirScanNode *child, *next;
+
+    if (root == NULL) {
+        return;
+    }
+    for (child = root->children; child != NULL; child = next) {
+        next = child->next;
+        dir_scan_free(child);
+    }
+    free(root);
+}
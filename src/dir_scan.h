@@ -0,0 +1,48 @@
+/**
+ * Parallel directory scanner
+ *
+ * Reads a tree of directories with getdents64 into large buffers, taking
+ * the type of each entry from d_type so that only file systems that don't
+ * tell it cost a stat. The directories found are spread over a few worker
+ * threads, each working on its own queue depth first and stealing from
+ * the others' when it runs dry.
+ *
+ * @package kiddyblaster
+ */
+#ifndef __DIR_SCAN_H__
+#define __DIR_SCAN_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Workers at most, the Pi has four cores
+#define DIR_SCAN_MAX_WORKERS 4
+
+// Bytes read per getdents64 call, per worker
+#define DIR_SCAN_BUFFER_SIZE 65536
+
+/*
+ * A directory found, with its subdirectories
+ */
+typedef struct DirScanNode {
+    const char *name;           // Last component of the path
+    int64_t mtime;              // In ns, when it has been read
+    bool listed;                // Whether it could be read
+    int wd;                     // inotify watch, -1 if none
+    struct DirScanNode *children;
+    struct DirScanNode *next;   // Next sibling
+    char path[];                // Relative to the scanned directory, "" for itself
+} DirScanNode;
+
+typedef struct {
+    unsigned int directories;
+    unsigned int stats;         // Entries d_type did not tell the type of
+    unsigned int steals;        // Directories a worker took from another one's queue
+    bool watches_exhausted;     // Watches could not be added, out of inotify watches
+} DirScanStats;
+
+int dir_scan_workers();
+DirScanNode *dir_scan(const char *path, int n_workers, int inotify_fd, uint32_t watch_mask, DirScanStats *stats);
+void dir_scan_free(DirScanNode *root);
+
+#endif
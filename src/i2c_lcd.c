@@ -1,71 +1,289 @@
-#include <pigpio.h>
+/**
+ * HD44780 LCD behind a PCF8574, on an LcdBus (I2C or the virtual LCD)
+ *
+ * The LCD is owned by one render thread, the only one that talks to the
+ * bus. Everybody else writes into a framebuffer and publishes it with
+ * lcd_flush(), which only hands it over: the thread picks up the latest
+ * published state whenever it is done with the previous one, so updates
+ * that come in while it is sending collapse into one, and callers never
+ * wait for I2C.
+ *
+ * Instructions are paced by their execution times (exec_times), at the
+ * PCF8574's pace only the long ones need a wait. If R/W is wired, those
+ * wait for the busy flag instead.
+ *
+ * Lines too long for the display scroll as a marquee: lcd_scroll()
+ * precomputes all the windows onto the text once, the render thread moves
+ * on to the next one every LCD_SCROLL_INTERVAL while the backlight is on.
+ *
+ * @package kiddyblaster
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <syslog.h>
 #include "i2c_lcd.h"
+#include "lcd_charset.h"
+#include "metrics.h"
+
+static LcdBus *bus;             // The render thread's
+
+/*
+ * A scrolling line: the windows onto the text followed by a gap, one
+ * for every position, `width` cells each
+ */
+typedef struct {
+    char *windows;          // NULL if the line does not scroll
+    int n_windows;
+    int width;
+    int pos;                // The window shown, advanced by the render thread
+} Marquee;
 
-int fd;
+/*
+ * Mailbox between the callers and the render thread, guarded by `lock`.
+ * `frame` is the back buffer the callers write into, lcd_flush() copies it
+ * to `published`, which is what the thread takes.
+ */
+static struct {
+    char frame[LCD_LINES][LCD_COLS];
+    char published[LCD_LINES][LCD_COLS];
+    Marquee marquee[LCD_LINES];             // Same for the scrolling lines,
+    Marquee published_marquee[LCD_LINES];   // they share the windows
+    int backlight;
+    bool flushed;           // lcd_flush() since the thread took the frame
+    bool refresh;           // Send the whole frame, see lcd_refresh()
+    bool reset;             // Initialize the controller again
+    LcdBus *bus;            // Switch to this bus with the reset
+    bool stop;
+    bool rendering;         // The thread is bringing the LCD up to date
+    bool bus_down;          // Writes fail, nothing is sent until an init succeeds
+} mailbox = {
+    .frame = { "                ", "                " },
+    .published = { "                ", "                " },
+    .backlight = 0x08,
+    .reset = true
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wakeup;           // On CLOCK_MONOTONIC, see wakeup_init()
+static pthread_once_t wakeup_once = PTHREAD_ONCE_INIT;
+static pthread_cond_t idle = PTHREAD_COND_INITIALIZER;
+static pthread_t render_thread;
+static bool render_thread_running;
 
 /*
- * Store content of LCD locally to
- * reprint with backlight off
+ * The render thread's side: what has been sent to the LCD
  */
-char content[2][16];
+static char shown[LCD_LINES][LCD_COLS];
+static bool shown_stale;        // Don't trust `shown`, send everything
 
-int backlight = 0x08;
+static const int line_addresses[LCD_LINES] = { LCD_LINE_1, LCD_LINE_2 };
 
+// Written by the render thread with `lock` held, lcd_sync() compares it
+static int backlight = 0x08;
 
 
-void lcd_set_backlight(int bl) {
-    backlight = bl ? 0x08 : 0x00;
 
-    // reprint
-    lcd_puts(LCD_LINE_1, content[0]);
-    lcd_puts(LCD_LINE_2, content[1]);
+/*
+ * What the render thread is going to send to the PCF8574, in one bus
+ * write. Every byte sets its outputs.
+ */
+static uint8_t batch[LCD_BATCH_SIZE];
+static unsigned int batch_len;
+
+/*
+ * Execution times of the instructions, by the highest bit set in them
+ */
+static const unsigned int exec_times[8] = {
+    LCD_EXEC_CLEAR,         // Clear display
+    LCD_EXEC_CLEAR,         // Return home
+    LCD_EXEC_DEFAULT,       // Entry mode set
+    LCD_EXEC_DEFAULT,       // Display on/off control
+    LCD_EXEC_DEFAULT,       // Cursor or display shift
+    LCD_EXEC_DEFAULT,       // Function set
+    LCD_EXEC_DEFAULT,       // Set CGRAM address
+    LCD_EXEC_DEFAULT        // Set DDRAM address
+};
+
+static unsigned int busy_us;    // The controller needs after the last instruction in the batch
+static bool busy_flag;          // Wait for the busy flag instead
+static bool busy_flag_probed;   // On this bus
+static bool write_failed;       // Since the controller has been initialized
+static int failed_inits;        // In a row, since a write has failed
+
+
+
+/*
+ * Send the batch as one write (address + the bytes)
+ */
+static void batch_send() {
+    if (batch_len == 0) {
+        return;
+    }
+    // The rest would fail too, don't knock on the bus for every batch
+    if (write_failed) {
+        batch_len = 0;
+        return;
+    }
+    if (lcd_bus_write(bus, batch, batch_len) != 0) {
+        write_failed = true;
+    }
+    metrics_add(METRIC_LCD_I2C_BYTES, batch_len + 1);
+    batch_len = 0;
 }
 
 
-void lcd_toggle_enable(int bits) {
-	// Toggle enable pin on LCD display
-    gpioDelay(500);
-    i2cReadByteData(fd, bits | ENABLE);
-    gpioDelay(500);
-    i2cReadByteData(fd, bits & ~ENABLE);
-    gpioDelay(500);
+
+/*
+ * Read the busy flag: R/W high, then the first of the two nibbles holds
+ * it while enable is high. Send the batch before.
+ *
+ * @return int      1 while busy, 0 when not, -1 if the bus can't read
+ */
+static int busy_flag_read() {
+    uint8_t bits = 0xf0 | READ_WRITE | backlight, in;
+    uint8_t enable[] = { bits, bits | ENABLE };
+    uint8_t rest[] = { bits, bits | ENABLE, bits };
+
+    if (write_failed) {
+        return -1;
+    }
+    if (lcd_bus_write(bus, enable, sizeof(enable)) != 0) {
+        write_failed = true;
+        return -1;
+    }
+    if (lcd_bus_read(bus, &in) != 0) {
+        return -1;
+    }
+    if (lcd_bus_write(bus, rest, sizeof(rest)) != 0) {
+        write_failed = true;
+    }
+    metrics_add(METRIC_LCD_I2C_BYTES, sizeof(enable) + 1 + 2 + sizeof(rest) + 1);
+    return (in & 0x80) ? 1 : 0;
+}
+
+
+
+/*
+ * Send the batch and wait until the controller has executed it
+ */
+static void wait_ready() {
+    uint64_t start;
+    int busy = 1;
+
+    batch_send();
+    if (busy_us == 0) {
+        return;
+    }
+    if (busy_flag) {
+        start = lcd_bus_now(bus);
+        while ((busy = busy_flag_read()) == 1 && lcd_bus_now(bus) - start < LCD_BUSY_FLAG_TIMEOUT);
+        if (busy != 0) {
+            syslog(LOG_WARNING, "The LCD stays busy, timing its instructions instead\n");
+            busy_flag = false;
+        }
+    }
+    if (busy != 0) {
+        lcd_bus_delay(bus, busy_us);
+    }
+    busy_us = 0;
+}
+
+
+
+/*
+ * Clock a nibble (the upper 4 bits of `bits`) into the LCD: put it out
+ * with enable high, then take enable low, on which the LCD latches it.
+ * At the PCF8574's pace of one byte per 9 I2C clocks the enable pulse
+ * and the setup and hold times are met without any delays, and the two
+ * bytes cover instructions of up to 2 * LCD_BUS_BYTE_US.
+ */
+static void batch_nibble(int bits, int mode) {
+    if (busy_us > 2 * LCD_BUS_BYTE_US) {
+        wait_ready();
+    }
+    if (batch_len + 2 > sizeof(batch)) {
+        batch_send();
+    }
+    bits = mode | (bits & 0xf0) | backlight;
+    batch[batch_len++] = bits | ENABLE;
+    batch[batch_len++] = bits & ~ENABLE;
+    busy_us = 0;
+}
+
+
+
+/*
+ * Hand something over to the render thread. Call with `lock` held.
+ */
+static void wake_render_thread() {
+    pthread_cond_signal(&wakeup);
 }
 
 
-// Send byte to data pins
+
+void lcd_set_backlight(int bl) {
+    pthread_mutex_lock(&lock);
+    mailbox.backlight = bl ? 0x08 : 0x00;
+    wake_render_thread();
+    pthread_mutex_unlock(&lock);
+}
+
+
+// Add a byte to the batch, only from the render thread. The next nibble
+// waits for it if needed.
 // @param int bits      The data
 // @param int mode      1 = data, 0 = command
 
-void lcd_byte(int bits, int mode) {
-	
-    int bits_hi, bits_lo;
+static void lcd_byte(int bits, int mode) {
+    int i;
 
-    bits_hi = mode | (bits & 0xf0) | backlight;
-    bits_lo = mode | ((bits << 4) & 0xf0) | backlight;
+    batch_nibble(bits, mode);
+    batch_nibble(bits << 4, mode);
 
-    i2cReadByteData(fd, bits_hi);
-    lcd_toggle_enable(bits_hi);
-    i2cReadByteData(fd, bits_lo);
-    lcd_toggle_enable(bits_lo);
+    for (i = 7; i > 0 && !(bits & (1 << i)); i--);
+    busy_us = mode == LCD_CHR ? LCD_EXEC_DATA : exec_times[i];
 }
 
 
 
-/**
- * Clear the display
+static int line_index(int line) {
+    return line == LCD_LINE_2 ? 1 : 0;
+}
+
+
+
+/*
+ * Set a line's marquee in the back buffer, `windows` may be NULL. Call
+ * with `lock` held.
  */
-void lcd_clear() {
-	lcd_byte(0x01, LCD_CMD);
-	lcd_byte(0x02, LCD_CMD);
+static void marquee_set(int l, char *windows, int n_windows, int width) {
+    Marquee *marquee = &mailbox.marquee[l];
+    if (marquee->windows != windows && marquee->windows != mailbox.published_marquee[l].windows) {
+        free(marquee->windows);
+    }
+    marquee->windows = windows;
+    marquee->n_windows = n_windows;
+    marquee->width = width;
+    marquee->pos = 0;
 }
 
 
 
 /**
- * Locate crsr at line
+ * Clear the framebuffer, the display follows with the next lcd_flush()
  */
-void lcd_loc(int line) {
-    lcd_byte(line, LCD_CMD);
+void lcd_clear() {
+    int l;
+    pthread_mutex_lock(&lock);
+    memset(mailbox.frame, ' ', sizeof(mailbox.frame));
+    for (l = 0; l < LCD_LINES; l++) {
+        marquee_set(l, NULL, 0, 0);
+    }
+    pthread_mutex_unlock(&lock);
 }
 
 
@@ -74,180 +292,653 @@ void lcd_loc(int line) {
  * Refresh the content of the LCD
  *
  * Needed as workaround to be called periodically to avoid gibberish content on
- * the LCD
+ * the LCD. Sends the whole framebuffer, not only what has changed.
  *
  * @param void
  * @return void
  */
 void lcd_refresh() {
-	lcd_puts(LCD_LINE_1, content[0]);
-	lcd_puts(LCD_LINE_2, content[1]);
+    pthread_mutex_lock(&lock);
+    mailbox.refresh = true;
+    wake_render_thread();
+    pthread_mutex_unlock(&lock);
+}
+
+
+
+/**
+ * Publish the framebuffer, the render thread sends it as soon as it is
+ * done with the previous one
+ */
+void lcd_flush() {
+    int l;
+    pthread_mutex_lock(&lock);
+    memcpy(mailbox.published, mailbox.frame, sizeof(mailbox.published));
+    for (l = 0; l < LCD_LINES; l++) {
+        Marquee *published = &mailbox.published_marquee[l];
+        if (published->windows == mailbox.marquee[l].windows) {
+            continue;
+        }
+        free(published->windows);
+        *published = mailbox.marquee[l];
+    }
+    mailbox.flushed = true;
+    wake_render_thread();
+    pthread_mutex_unlock(&lock);
+}
+
+
+
+static bool cell_changed(char frame[LCD_LINES][LCD_COLS], int l, int col) {
+    return shown_stale || frame[l][col] != shown[l][col];
+}
+
+
+
+/*
+ * Send what differs between `frame` and what the LCD shows. Every run of
+ * changed cells costs one cursor move; runs that are only one unchanged
+ * cell apart are sent as one, the cell costs what the move would.
+ */
+static void render(char frame[LCD_LINES][LCD_COLS]) {
+    int l, col, end, i;
+
+    for (l = 0; l < LCD_LINES; l++) {
+        for (col = 0; col < LCD_COLS; col = end + 1) {
+            if (!cell_changed(frame, l, col)) {
+                end = col;
+                continue;
+            }
+            end = col;
+            for (i = col + 1; i < LCD_COLS && i - end <= 2; i++) {
+                if (cell_changed(frame, l, i)) {
+                    end = i;
+                }
+            }
+
+            lcd_byte(line_addresses[l] + col, LCD_CMD);
+            for (i = col; i <= end; i++) {
+                lcd_byte(frame[l][i], LCD_CHR);
+                shown[l][i] = frame[l][i];
+            }
+        }
+    }
+    batch_send();
+    shown_stale = false;
+}
+
+
+
+/**
+ * Put a character (in the LCD's charset) into a cell of the framebuffer
+ *
+ * @param int   Line, LCD_LINE_1 or LCD_LINE_2
+ * @param int   Column, 0 - 15
+ * @param char  The character
+ */
+void lcd_put(int line, int col, char ch) {
+    if (col >= 0 && col < LCD_COLS) {
+        pthread_mutex_lock(&lock);
+        mailbox.frame[line_index(line)][col] = ch;
+        pthread_mutex_unlock(&lock);
+    }
 }
 
 
 
 /**
- * Output string on LCD display
+ * Write a string into a line of the framebuffer, from its start
  *
  * @param int           Line (0x80 or 0xc0), use constants LCD_LINE_1 ...
  * @param const char*   The string to print
  */
 void lcd_puts(int line, const char *str) {
+    char text[LCD_COLS];
+    int len = lcd_charset_transcode(str, text, LCD_COLS);
+
+    pthread_mutex_lock(&lock);
+    memcpy(mailbox.frame[line_index(line)], text, len);
+    marquee_set(line_index(line), NULL, 0, 0);
+    pthread_mutex_unlock(&lock);
+}
+
+
+
+/**
+ * Show a string in the first `width` cells of a line, scrolling if it is
+ * longer. Setting the text that scrolls already lets it go on from where
+ * it is.
+ *
+ * @param int           Line, LCD_LINE_1 or LCD_LINE_2
+ * @param int           Cells to use, from the start of the line
+ * @param const char*   The string to show
+ */
+void lcd_scroll(int line, int width, const char *str) {
+    char text[LCD_SCROLL_MAX + LCD_SCROLL_GAP];
+    char *windows = NULL;
+    int l = line_index(line), len, ring, i;
+
+    if (width > LCD_COLS) {
+        width = LCD_COLS;
+    }
+    len = lcd_charset_transcode(str, text, LCD_SCROLL_MAX);
+
+    if (len > width) {
+        memset(text + len, ' ', LCD_SCROLL_GAP);
+        ring = len + LCD_SCROLL_GAP;
+        windows = malloc(ring * width);
+        for (i = 0; i < ring * width; i++) {
+            windows[i] = text[(i / width + i % width) % ring];
+        }
+    }
+
+    pthread_mutex_lock(&lock);
+    memset(mailbox.frame[l], ' ', width);
+    if (windows == NULL) {
+        memcpy(mailbox.frame[l], text, len);
+        marquee_set(l, NULL, 0, 0);
+    }
+    else {
+        Marquee *published = &mailbox.published_marquee[l];
+        if (published->windows != NULL && published->width == width && published->n_windows == ring &&
+            memcmp(published->windows, windows, ring * width) == 0) {
+            free(windows);
+            marquee_set(l, published->windows, ring, width);
+        }
+        else {
+            marquee_set(l, windows, ring, width);
+        }
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+
+/*
+ * The custom characters, 5x8 pixels each, by LCD_CHAR_*. `fallback` is
+ * shown instead when all CGRAM slots are taken by other visible glyphs.
+ */
+static const struct {
+    const char *name;
+    char fallback;
+    unsigned char rows[8];
+} glyphs[] = {
+    [LCD_CHAR_WIFI_0 - LCD_GLYPH_BASE] = { "wifi-0", '_', {
+        0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b00000, 0b11111, 0b00000
+    }},
+    [LCD_CHAR_WIFI_1 - LCD_GLYPH_BASE] = { "wifi-1", '_', {
+        0b00000, 0b00000, 0b00000, 0b00000, 0b10000, 0b10000, 0b11111, 0b00000
+    }},
+    [LCD_CHAR_WIFI_2 - LCD_GLYPH_BASE] = { "wifi-2", '_', {
+        0b00000, 0b00000, 0b00100, 0b00100, 0b10100, 0b10100, 0b11111, 0b00000
+    }},
+    [LCD_CHAR_WIFI_3 - LCD_GLYPH_BASE] = { "wifi-3", '_', {
+        0b00000, 0b00001, 0b00001, 0b00101, 0b00101, 0b10101, 0b10101, 0b11111
+    }},
+    [LCD_CHAR_PAUSE - LCD_GLYPH_BASE] = { "pause", '=', {
+        0b11011, 0b11011, 0b11011, 0b11011, 0b11011, 0b11011, 0b11011, 0b00000
+    }},
+    [LCD_CHAR_PLAY - LCD_GLYPH_BASE] = { "play", '>', {
+        0b01000, 0b01100, 0b01110, 0b01111, 0b01110, 0b01100, 0b01000, 0b00000
+    }},
+    [LCD_CHAR_BATTERY - LCD_GLYPH_BASE] = { "battery", 'B', {
+        0b01110, 0b11011, 0b10001, 0b10001, 0b11111, 0b11111, 0b11111, 0b00000
+    }},
+    [LCD_CHAR_SLEEP - LCD_GLYPH_BASE] = { "sleep", 'z', {
+        0b00111, 0b01110, 0b11100, 0b11100, 0b11100, 0b01110, 0b00111, 0b00000
+    }},
+    [LCD_CHAR_REPEAT - LCD_GLYPH_BASE] = { "repeat", 'R', {
+        0b00010, 0b11111, 0b10010, 0b10000, 0b00001, 0b01001, 0b11111, 0b01000
+    }},
+    [LCD_CHAR_E_ACUTE - LCD_GLYPH_BASE] = { "e-acute", 'e', {
+        0b00010, 0b00100, 0b01110, 0b10001, 0b11111, 0b10000, 0b01110, 0b00000
+    }},
+    [LCD_CHAR_E_GRAVE - LCD_GLYPH_BASE] = { "e-grave", 'e', {
+        0b01000, 0b00100, 0b01110, 0b10001, 0b11111, 0b10000, 0b01110, 0b00000
+    }},
+    [LCD_CHAR_A_GRAVE - LCD_GLYPH_BASE] = { "a-grave", 'a', {
+        0b01000, 0b00100, 0b01110, 0b00001, 0b01111, 0b10001, 0b01111, 0b00000
+    }},
+    [LCD_CHAR_C_CEDILLA - LCD_GLYPH_BASE] = { "c-cedilla", 'c', {
+        0b00000, 0b01110, 0b10000, 0b10000, 0b10001, 0b01110, 0b00100, 0b01100
+    }}
+};
+
+#define N_GLYPHS (int)(sizeof(glyphs) / sizeof(glyphs[0]))
+
+/*
+ * The glyphs in the CGRAM slots, the render thread's
+ */
+static struct {
+    int glyph;              // -1 if the slot is free
+    unsigned long used;     // Frame it has last been visible in
+} slots[LCD_CGRAM_SLOTS];
+
+static unsigned long frame_count;
+
+
+
+/**
+ * Look up a custom character by name
+ *
+ * @param const char*   name    e.g. "battery"
+ * @return char         The code to put into the framebuffer, '?' if there
+ *                      is no glyph of that name
+ */
+char lcd_glyph(const char *name) {
     int i;
-    char ch;
-    lcd_loc(line);
-    for (i = 0; i < 16 && *str; i++) {
-        // Translate Umlaute from UTF-8 to LCD charset codes
-        if (*str == 0xc3) {
-            str++;
-            switch (*str) {
-                case 0xa4:
-                case 0x84:
-                    ch = 0b11100001;
-                    break;
-                case 0xb6:
-                case 0x96:
-                    ch = 0b11101111;
-                    break;
-                case 0xbc:
-                case 0x9c:
-                    ch = 0b11110101;
-                    break;
-                case 0x9f:
-                    ch = 0b11100010;
-                    break;
+    for (i = 0; i < N_GLYPHS; i++) {
+        if (strcmp(glyphs[i].name, name) == 0) {
+            return LCD_GLYPH_BASE + i;
+        }
+    }
+    return '?';
+}
+
+
+
+static void slots_clear() {
+    int s;
+    for (s = 0; s < LCD_CGRAM_SLOTS; s++) {
+        slots[s].glyph = -1;
+    }
+}
+
+
+
+static void slot_upload(int s, int glyph) {
+    int row;
+    lcd_byte(0x40 | (s << 3), LCD_CMD);
+    for (row = 0; row < 8; row++) {
+        lcd_byte(glyphs[glyph].rows[row], LCD_CHR);
+    }
+    slots[s].glyph = glyph;
+    metrics_inc(METRIC_LCD_CGRAM_UPLOADS);
+}
+
+
+
+/*
+ * Put the glyphs visible in `frame` into CGRAM and replace them by their
+ * slots. A glyph that is not in a slot yet takes a free one or the one
+ * not visible for the longest time; the CGRAM is only written to when
+ * glyphs come into view that are not in it. Glyphs that don't fit any
+ * more are shown as their fallback.
+ */
+static void resolve_glyphs(char frame[LCD_LINES][LCD_COLS]) {
+    int in_slot[N_GLYPHS], l, col, g, s, lru;
+    bool visible[N_GLYPHS] = { false };
+
+    for (l = 0; l < LCD_LINES; l++) {
+        for (col = 0; col < LCD_COLS; col++) {
+            g = (unsigned char)frame[l][col] - LCD_GLYPH_BASE;
+            if (g >= 0 && g < N_GLYPHS) {
+                visible[g] = true;
             }
         }
-        else {
-            ch = *str;
+    }
+
+    frame_count++;
+    for (g = 0; g < N_GLYPHS; g++) {
+        in_slot[g] = -1;
+    }
+    for (s = 0; s < LCD_CGRAM_SLOTS; s++) {
+        if (slots[s].glyph >= 0) {
+            in_slot[slots[s].glyph] = s;
+            if (visible[slots[s].glyph]) {
+                slots[s].used = frame_count;
+            }
         }
+    }
 
-		lcd_byte(ch, LCD_CHR);
-        switch (line) {
-            case LCD_LINE_1:
-                content[0][i] = ch;
+    for (g = 0; g < N_GLYPHS; g++) {
+        if (!visible[g] || in_slot[g] >= 0) {
+            continue;
+        }
+        for (lru = -1, s = 0; s < LCD_CGRAM_SLOTS; s++) {
+            if (slots[s].glyph < 0) {
+                lru = s;
                 break;
-            case LCD_LINE_2:
-                content[1][i] = ch;
+            }
+            if (slots[s].used < frame_count && (lru < 0 || slots[s].used < slots[lru].used)) {
+                lru = s;
+            }
+        }
+        if (lru < 0) {
+            continue;
+        }
+        if (slots[lru].glyph >= 0) {
+            in_slot[slots[lru].glyph] = -1;
+        }
+        slot_upload(lru, g);
+        slots[lru].used = frame_count;
+        in_slot[g] = lru;
+    }
+
+    for (l = 0; l < LCD_LINES; l++) {
+        for (col = 0; col < LCD_COLS; col++) {
+            g = (unsigned char)frame[l][col] - LCD_GLYPH_BASE;
+            if (g >= 0 && g < N_GLYPHS) {
+                frame[l][col] = in_slot[g] >= 0 ? in_slot[g] : glyphs[g].fallback;
+            }
+        }
+    }
+}
+
+
+
+/*
+ * Initialize the controller, from the render thread
+ */
+static void controller_init() {
+
+    if (bus == NULL) {
+        return;
+    }
+
+    // Init LCD into 4 bit mode by instruction, as in the HD44780 datasheet.
+    // The busy flag can't be read before the function set.
+    bool read_busy_flag = busy_flag;
+    busy_flag = false;
+    busy_us = 0;
+    batch_nibble(0x30, LCD_CMD);
+    busy_us = LCD_DELAY_INIT_1;
+    batch_nibble(0x30, LCD_CMD);
+    busy_us = LCD_DELAY_INIT_2;
+    batch_nibble(0x30, LCD_CMD);
+    batch_nibble(0x20, LCD_CMD);
+
+    lcd_byte(0x28, LCD_CMD);    // 2 lines, 5x8 font
+    busy_flag = read_busy_flag;
+    lcd_byte(0x0c, LCD_CMD);    // Display on, no cursor
+    lcd_byte(0x01, LCD_CMD);    // Clear
+    lcd_byte(0x06, LCD_CMD);    // Move the cursor to the right
+    wait_ready();
+
+    // With R/W tied to ground instead of wired, the pins read back high
+    // as busy. The E pulses then write 0xff, i.e. set the DDRAM address,
+    // which is harmless.
+    if (!busy_flag_probed) {
+        busy_flag_probed = true;
+        busy_flag = LCD_READ_BUSY_FLAG && busy_flag_read() == 0;
+        busy_us = LCD_EXEC_DEFAULT;
+        syslog(LOG_INFO, "LCD on %s: %s\n", bus->name,
+               busy_flag ? "reading the busy flag" : "timing the instructions");
+    }
+
+    // Don't rely on what the CGRAM held before
+    slots_clear();
+
+    // The init sequence has cleared the display
+    memset(shown, ' ', sizeof(shown));
+}
+
+
+
+static void render_done() {
+    pthread_mutex_lock(&lock);
+    mailbox.rendering = false;
+    mailbox.bus_down = failed_inits > 0;
+    pthread_cond_broadcast(&idle);
+    pthread_mutex_unlock(&lock);
+}
+
+
+
+/*
+ * Whether a published line scrolls and the backlight is on to see it.
+ * Call with `lock` held.
+ */
+static bool scrolling() {
+    int l;
+    for (l = 0; l < LCD_LINES; l++) {
+        if (mailbox.published_marquee[l].windows != NULL) {
+            return backlight != 0;
+        }
+    }
+    return false;
+}
+
+
+
+static void scroll_step() {
+    int l;
+    for (l = 0; l < LCD_LINES; l++) {
+        Marquee *marquee = &mailbox.published_marquee[l];
+        if (marquee->windows != NULL) {
+            marquee->pos = (marquee->pos + 1) % marquee->n_windows;
+        }
+    }
+}
+
+
+
+static void timespec_add_us(struct timespec *ts, long usec) {
+    ts->tv_nsec += (usec % 1000000) * 1000;
+    ts->tv_sec += usec / 1000000 + ts->tv_nsec / 1000000000;
+    ts->tv_nsec %= 1000000000;
+}
+
+
+
+/*
+ * The marquees are timed on the monotonic clock so that setting the time,
+ * e.g. by NTP after booting, neither stalls nor races them
+ */
+static void wakeup_init() {
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wakeup, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+
+
+/*
+ * Count an init that has been followed by a failed write. Bytes lost on
+ * the way leave the controller out of step with the nibbles, only
+ * initializing it again gets them back in step.
+ *
+ * @return long     µs until the next init, -1 to give up
+ */
+static long init_failed() {
+    failed_inits++;
+    if (failed_inits == 1) {
+        syslog(LOG_ERR, "LCD on %s: write failed, initializing it again up to %d times\n",
+               bus->name, LCD_RESET_RETRIES);
+    }
+    if (failed_inits > LCD_RESET_RETRIES) {
+        return -1;
+    }
+    return (long)LCD_RESET_RETRY_DELAY << (failed_inits - 1);
+}
+
+
+
+/*
+ * The render thread: wait for something to be published or the marquees
+ * to move on, take the latest state and bring the LCD up to it
+ */
+static void *render_loop(void *data) {
+    char next[LCD_LINES][LCD_COLS];
+    bool reset, switch_backlight, stop = false, armed = false;
+    bool retry = false, retry_due;      // An init after a failed write
+    struct timespec scroll_at, retry_at, now;
+    long retry_in;
+    int l;
+
+    (void)data;
+    while (!stop) {
+        retry_due = false;
+        pthread_mutex_lock(&lock);
+        while (!mailbox.flushed && !mailbox.refresh && !mailbox.reset &&
+               !mailbox.stop && mailbox.backlight == backlight) {
+            if (retry) {
+                if (pthread_cond_timedwait(&wakeup, &lock, &retry_at) == ETIMEDOUT) {
+                    retry_due = true;
+                    break;
+                }
+                continue;
+            }
+            if (failed_inits > 0 || !scrolling()) {
+                armed = false;
+                pthread_cond_wait(&wakeup, &lock);
+                continue;
+            }
+            if (!armed) {
+                clock_gettime(CLOCK_MONOTONIC, &scroll_at);
+                timespec_add_us(&scroll_at, LCD_SCROLL_INTERVAL);
+                armed = true;
+            }
+            if (pthread_cond_timedwait(&wakeup, &lock, &scroll_at) == ETIMEDOUT) {
+                scroll_step();
+                timespec_add_us(&scroll_at, LCD_SCROLL_INTERVAL);
+                // Don't catch up on steps missed by more than an interval,
+                // e.g. while a slow bus held the thread up
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                if (now.tv_sec > scroll_at.tv_sec ||
+                    (now.tv_sec == scroll_at.tv_sec && now.tv_nsec > scroll_at.tv_nsec)) {
+                    scroll_at = now;
+                    timespec_add_us(&scroll_at, LCD_SCROLL_INTERVAL);
+                }
                 break;
+            }
+        }
+        memcpy(next, mailbox.published, sizeof(next));
+        for (l = 0; l < LCD_LINES; l++) {
+            Marquee *marquee = &mailbox.published_marquee[l];
+            if (marquee->windows != NULL) {
+                memcpy(next[l], marquee->windows + marquee->pos * marquee->width, marquee->width);
+            }
+        }
+        switch_backlight = mailbox.backlight != backlight;
+        backlight = mailbox.backlight;
+        // Asked for, it starts over with the attempts
+        if (mailbox.reset) {
+            failed_inits = 0;
+            retry = false;
+        }
+        reset = mailbox.reset || (retry_due && !mailbox.stop);
+        if (reset && mailbox.bus != NULL) {
+            lcd_bus_free(bus);
+            bus = mailbox.bus;
+            mailbox.bus = NULL;
+            busy_flag = busy_flag_probed = false;
+        }
+        shown_stale = shown_stale || mailbox.refresh;
+        stop = mailbox.stop;
+        mailbox.flushed = mailbox.refresh = mailbox.reset = false;
+        mailbox.rendering = true;
+        pthread_mutex_unlock(&lock);
+
+        // While the bus is down, the frame waits for the next init
+        if (bus == NULL || (!reset && failed_inits > 0)) {
+            render_done();
+            continue;
+        }
+        if (reset) {
+            write_failed = false;
+            controller_init();
+        }
+
+        // The backlight pin follows every write, a single one switches it
+        // when there is nothing else to send
+        if (switch_backlight) {
+            batch[batch_len++] = backlight;
+        }
+        resolve_glyphs(next);
+        render(next);
+
+        retry = false;
+        if (write_failed) {
+            write_failed = false;
+            if ((retry_in = init_failed()) >= 0) {
+                clock_gettime(CLOCK_MONOTONIC, &retry_at);
+                timespec_add_us(&retry_at, retry_in);
+                retry = true;
+            }
+        } else if (failed_inits > 0) {
+            syslog(LOG_INFO, "LCD on %s: working again\n", bus->name);
+            failed_inits = 0;
+        }
+        render_done();
+    }
+    return NULL;
+}
+
+
+
+/**
+ * Initialize the LCD display on `bus` and start the render thread. If it
+ * is running already, it switches over to `bus`.
+ *
+ * @param LcdBus*   bus     Owned by the LCD from now on, NULL for none
+ */
+void lcd_init(LcdBus *new_bus) {
+    pthread_once(&wakeup_once, wakeup_init);
+    pthread_mutex_lock(&lock);
+    lcd_bus_free(mailbox.bus);
+    mailbox.bus = new_bus;
+    mailbox.reset = true;
+    mailbox.bus_down = false;       // Until the init has failed
+    mailbox.stop = false;
+    if (!render_thread_running) {
+        render_thread_running = pthread_create(&render_thread, NULL, render_loop, NULL) == 0;
+        if (!render_thread_running) {
+            syslog(LOG_ERR, "Failed to start the LCD thread\n");
         }
-        str++;
-	}
-}
-
-
-void setup_custom_chars() {
-    static const unsigned int custom_chars[8][8][5] = {{
-        { 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 0 },
-        { 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0 }
-    },
-    {
-        { 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 0 },
-        { 1, 0, 0, 0, 0 },
-        { 1, 0, 0, 0, 0 },
-        { 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0 }
-    },
-    {
-        { 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 0 },
-        { 0, 0, 1, 0, 0 },
-        { 0, 0, 1, 0, 0 },
-        { 1, 0, 1, 0, 0 },
-        { 1, 0, 1, 0, 0 },
-        { 1, 1, 1, 1, 1 },
-        { 0, 0, 0, 0, 0 }
-    },
-    {
-        { 0, 0, 0, 0, 0 },
-        { 0, 0, 0, 0, 1 },
-        { 0, 0, 0, 0, 1 },
-        { 0, 0, 1, 0, 1 },
-        { 0, 0, 1, 0, 1 },
-        { 1, 0, 1, 0, 1 },
-        { 1, 0, 1, 0, 1 },
-        { 1, 1, 1, 1, 1 }
-    },
-    {
-        { 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 1, 1 },
-        { 1, 1, 0, 1, 1 },
-        { 0, 0, 0, 0, 0 }
-    },
-    {
-        { 0, 1, 0, 0, 0 },
-        { 0, 1, 1, 0, 0 },
-        { 0, 1, 1, 1, 0 },
-        { 0, 1, 1, 1, 1 },
-        { 0, 1, 1, 1, 0 },
-        { 0, 1, 1, 0, 0 },
-        { 0, 1, 0, 0, 0 },
-        { 0, 0, 0, 0, 0 }
-    }
-    };
-
-    // Write to CG RAM
-    lcd_byte(0x40, LCD_CMD);
-
-    int i, j;
-    char byte;
-    for (i = 0; i < 5; i++) {
-        for (j = 0; j < 8; j++) {
-            byte = 
-                custom_chars[i][j][0] * 16 + 
-                custom_chars[i][j][1] * 8 + 
-                custom_chars[i][j][2] * 4 + 
-                custom_chars[i][j][3] * 2 +
-                custom_chars[i][j][4] * 1
-            ;
-            lcd_byte(byte, LCD_CHR);
-        }
-    }
-
-    // Reset: write to DD RAM
-    lcd_byte(0x80, LCD_CMD);
+    }
+    wake_render_thread();
+    pthread_mutex_unlock(&lock);
 }
 
 
+
 /**
- * Initialize LCD display
+ * Initialize the controller again and send the content anew. After
+ * the LCD has stopped answering, it starts over with the attempts.
  */
-void lcd_init() {
+void lcd_reset() {
+    pthread_mutex_lock(&lock);
+    mailbox.reset = true;
+    mailbox.bus_down = false;
+    wake_render_thread();
+    pthread_mutex_unlock(&lock);
+}
 
-    fd = i2cOpen(I2C_BUS, I2C_ADDRESS, 0);
 
-    // Init LCD
-    int i;
-    unsigned const char init_sequence[] = {
-        0x33,
-        0x32,
-        0x06,
-        0x0c,
-        0x28,
-        0x01
-    };
-    for (i = 0; i < 6; i++) {
-        lcd_byte(init_sequence[i], LCD_CMD);
-    }
-    gpioDelay(500);
 
-    setup_custom_chars();
+/**
+ * Wait until the render thread has sent everything that has been
+ * published, or found the bus down
+ */
+void lcd_sync() {
+    pthread_mutex_lock(&lock);
+    while (render_thread_running && !mailbox.bus_down &&
+           (mailbox.rendering || mailbox.flushed || mailbox.refresh ||
+            mailbox.reset || mailbox.backlight != backlight)) {
+        pthread_cond_wait(&idle, &lock);
+    }
+    pthread_mutex_unlock(&lock);
 }
 
+
+
+/**
+ * Send what has been published, stop the render thread and close the bus
+ */
 void lcd_deinit() {
-    i2cClose(fd);
+    pthread_mutex_lock(&lock);
+    mailbox.stop = true;
+    wake_render_thread();
+    pthread_mutex_unlock(&lock);
+
+    if (render_thread_running) {
+        pthread_join(render_thread, NULL);
+        render_thread_running = false;
+    }
+    lcd_bus_free(bus);
+    bus = NULL;
 }
 
@@ -1,6 +1,8 @@
 #ifndef __I2C_LCD_H__
 #define __I2C_LCD_H__
 
+#include "lcd_bus.h"
+
 #define I2C_BUS 1
 #define I2C_ADDRESS 0x27 // I2C device address
 #define LCD_CHR 1 // Mode - sending data
@@ -9,24 +11,82 @@
 #define LCD_LINE_1 0x80 
 #define LCD_LINE_2 0xc0 
 
+#define LCD_LINES 2
+#define LCD_COLS 16
+
 #define LCD_BACKLIGHT 0x08
 #define ENABLE 0b00000100 // Enable bit
+#define READ_WRITE 0b00000010 // Read/write bit
+
+// Bytes to the PCF8574 sent in one I2C write, 4 per byte to the LCD
+#define LCD_BATCH_SIZE 256
+
+// Execution times of the instructions in µs (HD44780 datasheet, fosc =
+// 270 kHz)
+#define LCD_EXEC_DEFAULT 37
+#define LCD_EXEC_DATA 41        // Writing to DDRAM or CGRAM
+#define LCD_EXEC_CLEAR 1520     // Clear display, return home
+
+// Waits in the init sequence, before the busy flag can be read
+#define LCD_DELAY_INIT_1 4100   // After the first function set
+#define LCD_DELAY_INIT_2 100    // After the second
+
+// Fastest I2C clock the PCF8574 is driven at, the driver counts on a byte
+// on the bus (9 clocks) taking at least LCD_BUS_BYTE_US
+#define LCD_BUS_MAX_KHZ 400
+#define LCD_BUS_BYTE_US (9000 / LCD_BUS_MAX_KHZ)
+
+// Read the busy flag instead of waiting out the long instructions, if R/W
+// turns out to be wired to the PCF8574; give up on it after the timeout
+// in µs
+#define LCD_READ_BUSY_FLAG 1
+#define LCD_BUSY_FLAG_TIMEOUT 10000
+
+// After a write to the LCD has failed, µs until it is initialized again,
+// doubled with every init that fails as well; give up after that many
+// until lcd_reset()
+#define LCD_RESET_RETRY_DELAY 500000
+#define LCD_RESET_RETRIES 8
+
+// Marquee for lines longer than the display: µs per step, blanks between
+// the end of the text and its start, longest text in characters
+#define LCD_SCROLL_INTERVAL 400000
+#define LCD_SCROLL_GAP 4
+#define LCD_SCROLL_MAX 256
+
+// Custom characters: codes in the framebuffer that stand for a glyph, the
+// render thread puts the ones on screen into the LCD's 8 CGRAM slots.
+// See also lcd_glyph().
+#define LCD_GLYPH_BASE 0x10
+#define LCD_GLYPHS_MAX 16
+#define LCD_CGRAM_SLOTS 8
 
-#define LCD_CHAR_WIFI_0 0
-#define LCD_CHAR_WIFI_1 1
-#define LCD_CHAR_WIFI_2 2
-#define LCD_CHAR_WIFI_3 3
-#define LCD_CHAR_PAUSE 4
-#define LCD_CHAR_PLAY 5
+#define LCD_CHAR_WIFI_0 (LCD_GLYPH_BASE + 0)
+#define LCD_CHAR_WIFI_1 (LCD_GLYPH_BASE + 1)
+#define LCD_CHAR_WIFI_2 (LCD_GLYPH_BASE + 2)
+#define LCD_CHAR_WIFI_3 (LCD_GLYPH_BASE + 3)
+#define LCD_CHAR_PAUSE (LCD_GLYPH_BASE + 4)
+#define LCD_CHAR_PLAY (LCD_GLYPH_BASE + 5)
+#define LCD_CHAR_BATTERY (LCD_GLYPH_BASE + 6)
+#define LCD_CHAR_SLEEP (LCD_GLYPH_BASE + 7)
+#define LCD_CHAR_REPEAT (LCD_GLYPH_BASE + 8)
+#define LCD_CHAR_E_ACUTE (LCD_GLYPH_BASE + 9)
+#define LCD_CHAR_E_GRAVE (LCD_GLYPH_BASE + 10)
+#define LCD_CHAR_A_GRAVE (LCD_GLYPH_BASE + 11)
+#define LCD_CHAR_C_CEDILLA (LCD_GLYPH_BASE + 12)
 
 
 
-void lcd_init();
+void lcd_init(LcdBus *bus);
+void lcd_reset();
+void lcd_sync();
 void lcd_deinit();
 void lcd_clear();
-void lcd_loc(int line);
 void lcd_puts(int line, const char *str);
-void lcd_toggle_enable(int bits);
+void lcd_put(int line, int col, char ch);
+void lcd_scroll(int line, int width, const char *str);
+char lcd_glyph(const char *name);
+void lcd_flush();
 void lcd_set_backlight(int backlight);
 void lcd_refresh();
 
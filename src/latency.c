@@ -0,0 +1,231 @@
+/**
+ * Tap-to-sound latency
+ *
+ * A tap is followed through the stages in LatencyStage by the thread
+ * handling it: the card reader starts it when it reads a new card and marks
+ * the stages as they pass, the player callbacks mark the rest on the same
+ * thread. A tap waiting for mpd is deferred, so that the thread can go on,
+ * and resumed by whichever thread gets to see mpd play. Durations go into
+ * one histogram per stage, shared by all threads and dumped to syslog
+ * along with the metrics.
+ *
+ * @package kiddyblaster
+ */
+#include <stdbool.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <syslog.h>
+
+#include "latency.h"
+#include "spi_bus.h"
+
+static const uint64_t bucket_limits[LATENCY_BUCKETS - 1] = {
+    500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000, 5000000
+};
+
+static const char *names[LATENCY_STAGES] = {
+    [LATENCY_REQA]          = "reqa",
+    [LATENCY_SELECT]        = "select",
+    [LATENCY_READ]          = "read",
+    [LATENCY_DB_LOOKUP]     = "db_lookup",
+    [LATENCY_MPD_COMMAND]   = "mpd_command",
+    [LATENCY_MPD_PLAYING]   = "mpd_playing",
+    [LATENCY_TOTAL]         = "total"
+};
+
+static LatencyHistogram histograms[LATENCY_STAGES];
+
+static uint64_t (*clock_now)() = spi_monotonic_now;
+
+typedef struct {
+    bool active;
+    uint64_t start;
+    uint64_t last;          // End of the previous stage
+} Tap;
+
+/*
+ * The tap the calling thread is following
+ */
+static __thread Tap tap;
+
+/*
+ * The tap deferred last, waiting for another thread to resume it
+ */
+static Tap deferred;
+static pthread_mutex_t deferred_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/**
+ * Take timestamps from another clock, e.g. a simulated reader's
+ *
+ * @param uint64_t (*)()    now     Returns µs
+ */
+void latency_set_clock(uint64_t (*now)()) {
+    clock_now = now;
+}
+
+
+
+uint64_t latency_now() {
+    return clock_now();
+}
+
+
+
+/**
+ * Start following a tap on the calling thread
+ *
+ * @param uint64_t  start   When the card showed up, see latency_now()
+ */
+void latency_tap_start(uint64_t start) {
+    tap.active = true;
+    tap.start = start;
+    tap.last = start;
+}
+
+
+
+/**
+ * The calling thread's tap has passed `stage`. Passing LATENCY_MPD_PLAYING
+ * completes it. Does nothing if the thread is not following a tap.
+ */
+void latency_tap_mark(LatencyStage stage) {
+    latency_tap_mark_at(stage, latency_now());
+}
+
+
+
+/**
+ * The calling thread's tap has passed `stage` at an earlier time than now,
+ * e.g. mpd's elapsed time back from when it is asked
+ *
+ * @param LatencyStage  stage
+ * @param uint64_t      at      See latency_now(), not before the previous stage
+ */
+void latency_tap_mark_at(LatencyStage stage, uint64_t at) {
+    if (!tap.active) {
+        return;
+    }
+    if (at < tap.last) {
+        at = tap.last;
+    }
+    latency_record(stage, at - tap.last);
+    tap.last = at;
+
+    if (stage == LATENCY_MPD_PLAYING) {
+        latency_record(LATENCY_TOTAL, at - tap.start);
+        tap.active = false;
+    }
+}
+
+
+
+/**
+ * Stop following the calling thread's tap, e.g. because the card was
+ * unknown or only queued. The stages it has passed stay recorded.
+ */
+void latency_tap_cancel() {
+    tap.active = false;
+}
+
+
+
+/**
+ * Hand the calling thread's tap over to latency_tap_resume() on any thread.
+ * Only the newest tap is kept, a tap deferred before it is dropped.
+ */
+void latency_tap_defer() {
+    if (!tap.active) {
+        return;
+    }
+    pthread_mutex_lock(&deferred_mutex);
+    if (!deferred.active || deferred.start <= tap.start) {
+        deferred = tap;
+    }
+    pthread_mutex_unlock(&deferred_mutex);
+    tap.active = false;
+}
+
+
+
+/**
+ * Follow the deferred tap, if any, on the calling thread
+ *
+ * @param uint64_t*     since   Set to the end of the tap's last stage
+ * @return bool         false if there is no deferred tap
+ */
+bool latency_tap_resume(uint64_t *since) {
+    pthread_mutex_lock(&deferred_mutex);
+    tap = deferred;
+    deferred.active = false;
+    pthread_mutex_unlock(&deferred_mutex);
+
+    *since = tap.last;
+    return tap.active;
+}
+
+
+
+void latency_record(LatencyStage stage, uint64_t usec) {
+    LatencyHistogram *histogram = &histograms[stage];
+    int i;
+
+    for (i = 0; i < LATENCY_BUCKETS - 1 && usec > bucket_limits[i]; i++);
+    __atomic_add_fetch(&histogram->buckets[i], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&histogram->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&histogram->total_us, usec, __ATOMIC_RELAXED);
+
+    uint64_t max = __atomic_load_n(&histogram->max_us, __ATOMIC_RELAXED);
+    while (max < usec) {
+        if (__atomic_compare_exchange_n(&histogram->max_us, &max, usec, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+
+
+void latency_get(LatencyStage stage, LatencyHistogram *histogram) {
+    int i;
+    histogram->count = __atomic_load_n(&histograms[stage].count, __ATOMIC_RELAXED);
+    histogram->total_us = __atomic_load_n(&histograms[stage].total_us, __ATOMIC_RELAXED);
+    histogram->max_us = __atomic_load_n(&histograms[stage].max_us, __ATOMIC_RELAXED);
+    for (i = 0; i < LATENCY_BUCKETS; i++) {
+        histogram->buckets[i] = __atomic_load_n(&histograms[stage].buckets[i], __ATOMIC_RELAXED);
+    }
+}
+
+
+
+/**
+ * Write the histograms to syslog, one line per stage: count, mean and max
+ * in ms, then the non-empty buckets as `<=<ms>:<count>`
+ */
+void latency_dump() {
+    LatencyHistogram histogram;
+    char line[512];
+    int stage, i, len;
+
+    for (stage = 0; stage < LATENCY_STAGES; stage++) {
+        latency_get(stage, &histogram);
+        len = snprintf(line, sizeof(line), "latency %s: n=%llu mean=%.1fms max=%.1fms",
+            names[stage],
+            (unsigned long long)histogram.count,
+            histogram.count > 0 ? histogram.total_us / 1000.0 / histogram.count : 0,
+            histogram.max_us / 1000.0
+        );
+        for (i = 0; i < LATENCY_BUCKETS && len < (int)sizeof(line); i++) {
+            if (histogram.buckets[i] == 0) {
+                continue;
+            }
+            if (i < LATENCY_BUCKETS - 1) {
+                len += snprintf(line + len, sizeof(line) - len, " <=%g:%llu", bucket_limits[i] / 1000.0, (unsigned long long)histogram.buckets[i]);
+            }
+            else {
+                len += snprintf(line + len, sizeof(line) - len, " >%g:%llu", bucket_limits[i - 1] / 1000.0, (unsigned long long)histogram.buckets[i]);
+            }
+        }
+        syslog(LOG_NOTICE, "%s\n", line);
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Stages from a card showing up on the reader to sound coming out. Every
+ * stage is timed from the end of the previous one, LATENCY_TOTAL over all.
+ */
+typedef enum {
+    LATENCY_REQA,           // Poll that first saw the card until it answers the wake-up
+    LATENCY_SELECT,
+    LATENCY_READ,           // Authenticating, reading the card id and halting the card
+    LATENCY_DB_LOOKUP,
+    LATENCY_MPD_COMMAND,    // Until mpd has taken the commands to play the card
+    LATENCY_MPD_PLAYING,    // Until mpd reports playing with elapsed time > 0
+    LATENCY_TOTAL,
+    LATENCY_STAGES
+} LatencyStage;
+
+// Histogram buckets, by upper bound in µs; the last one takes everything above
+#define LATENCY_BUCKETS 14
+
+// How long to wait for mpd to start playing a card, in ms
+#define LATENCY_PLAY_TIMEOUT 5000
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_us;
+    uint64_t max_us;
+    uint64_t buckets[LATENCY_BUCKETS];
+} LatencyHistogram;
+
+void latency_set_clock(uint64_t (*now)());
+uint64_t latency_now();
+void latency_tap_start(uint64_t start);
+void latency_tap_mark(LatencyStage stage);
+void latency_tap_mark_at(LatencyStage stage, uint64_t at);
+void latency_tap_cancel();
+void latency_tap_defer();
+bool latency_tap_resume(uint64_t *since);
+void latency_record(LatencyStage stage, uint64_t usec);
+void latency_get(LatencyStage stage, LatencyHistogram *histogram);
+void latency_dump();
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * Transport between the LCD driver and the PCF8574
+ *
+ * @package kiddyblaster
+ */
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "lcd_bus.h"
+#include "spi_bus.h"
+
+
+
+int lcd_bus_write(LcdBus *bus, const uint8_t *data, unsigned int len) {
+    if (len == 0) {
+        return 0;
+    }
+    return bus->write(bus, data, len);
+}
+
+
+
+int lcd_bus_read(LcdBus *bus, uint8_t *data) {
+    return bus->read != NULL ? bus->read(bus, data) : -1;
+}
+
+
+
+void lcd_bus_delay(LcdBus *bus, unsigned int usec) {
+    if (bus->delay != NULL) {
+        bus->delay(bus, usec);
+    }
+    else {
+        usleep(usec);
+    }
+}
+
+
+
+uint64_t lcd_bus_now(LcdBus *bus) {
+    return bus->now != NULL ? bus->now(bus) : spi_monotonic_now();
+}
+
+
+
+void lcd_bus_free(LcdBus *bus) {
+    if (bus == NULL) {
+        return;
+    }
+    if (bus->free != NULL) {
+        bus->free(bus);
+    }
+    free(bus);
+}
@@ -0,0 +1,47 @@
+/**
+ * Transport between the LCD driver and the PCF8574 the LCD hangs on
+ *
+ * The driver only ever sets the PCF8574's eight outputs, a byte at a time,
+ * so the same code drives the LCD over pigpio's I2C or a virtual HD44780
+ * that runs anywhere.
+ *
+ * @package kiddyblaster
+ */
+#ifndef __LCD_BUS_H__
+#define __LCD_BUS_H__
+
+#include <stdint.h>
+
+typedef struct LcdBus LcdBus;
+
+struct LcdBus {
+    const char *name;
+
+    // Set the outputs to each of the `len` bytes in turn, in one bus
+    // transaction; returns 0 on success
+    int (*write)(LcdBus *bus, const uint8_t *data, unsigned int len);
+
+    // Read the PCF8574's pins into `data`, returns 0 on success; NULL if
+    // the bus can't read
+    int (*read)(LcdBus *bus, uint8_t *data);
+
+    void (*delay)(LcdBus *bus, unsigned int usec);
+
+    // Microseconds on the bus' clock, NULL for CLOCK_MONOTONIC
+    uint64_t (*now)(LcdBus *bus);
+
+    void (*free)(LcdBus *bus);
+
+    void *priv;
+};
+
+int lcd_bus_write(LcdBus *bus, const uint8_t *data, unsigned int len);
+int lcd_bus_read(LcdBus *bus, uint8_t *data);
+void lcd_bus_delay(LcdBus *bus, unsigned int usec);
+uint64_t lcd_bus_now(LcdBus *bus);
+void lcd_bus_free(LcdBus *bus);
+
+// Backends
+LcdBus *lcd_i2c_new(unsigned int i2c_bus, unsigned int address);
+
+#endif
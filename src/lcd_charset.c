@@ -0,0 +1,441 @@
+/**
+ * UTF-8 to the character ROM of the HD44780 (A00, the Japanese one)
+ *
+ * ASCII is mostly where it belongs in the ROM, the half-width katakana
+ * (U+FF61 - U+FF9F) are in the same order at 0xa1 - 0xdf. Everything else
+ * the ROM has a glyph for is in `mappings`, along with transliterations
+ * for what it has not (é → e, ’ → ', … → ...). The accented Latin
+ * letters in there are generated from their Unicode decompositions, i.e.
+ * they are mapped to their base letter, except for the few that have a
+ * custom character (é, è, à, ç).
+ *
+ * @package kiddyblaster
+ */
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2c_lcd.h"
+#include "lcd_charset.h"
+
+typedef struct {
+    uint16_t code_point;
+    const char *lcd;        // LCD codes, more than one for some transliterations
+} LcdCharMapping;
+
+// Sorted by code point
+static const LcdCharMapping mappings[] = {
+    { 0x005c, "/" },        // reverse solidus
+    { 0x007e, "-" },        // tilde
+    { 0x00a0, " " },        // no-break space
+    { 0x00a1, "!" },        // ¡ inverted exclamation mark
+    { 0x00a2, "\xec" },     // ¢ cent sign
+    { 0x00a3, "\xed" },     // £ pound sign
+    { 0x00a5, "\\" },       // ¥ yen sign
+    { 0x00a6, "|" },        // ¦ broken bar
+    { 0x00a7, "S" },        // § section sign
+    { 0x00a9, "(c)" },      // © copyright sign
+    { 0x00ab, "<<" },       // « left-pointing double angle quotation mark
+    { 0x00ad, "-" },        // soft hyphen
+    { 0x00ae, "(R)" },      // ® registered sign
+    { 0x00b0, "\xdf" },     // ° degree sign
+    { 0x00b1, "+-" },       // ± plus-minus sign
+    { 0x00b2, "2" },        // ² superscript two
+    { 0x00b3, "3" },        // ³ superscript three
+    { 0x00b5, "\xe4" },     // µ micro sign
+    { 0x00b7, "\xa5" },     // · middle dot
+    { 0x00b9, "1" },        // ¹ superscript one
+    { 0x00bb, ">>" },       // » right-pointing double angle quotation mark
+    { 0x00bc, "1/4" },      // ¼ vulgar fraction one quarter
+    { 0x00bd, "1/2" },      // ½ vulgar fraction one half
+    { 0x00be, "3/4" },      // ¾ vulgar fraction three quarters
+    { 0x00bf, "?" },        // ¿ inverted question mark
+    { 0x00c0, "A" },        // À latin capital letter a with grave
+    { 0x00c1, "A" },        // Á latin capital letter a with acute
+    { 0x00c2, "A" },        // Â latin capital letter a with circumflex
+    { 0x00c3, "A" },        // Ã latin capital letter a with tilde
+    { 0x00c4, "\xe1" },     // Ä latin capital letter a with diaeresis
+    { 0x00c5, "A" },        // Å latin capital letter a with ring above
+    { 0x00c6, "AE" },       // Æ latin capital letter ae
+    { 0x00c7, "C" },        // Ç latin capital letter c with cedilla
+    { 0x00c8, "E" },        // È latin capital letter e with grave
+    { 0x00c9, "E" },        // É latin capital letter e with acute
+    { 0x00ca, "E" },        // Ê latin capital letter e with circumflex
+    { 0x00cb, "E" },        // Ë latin capital letter e with diaeresis
+    { 0x00cc, "I" },        // Ì latin capital letter i with grave
+    { 0x00cd, "I" },        // Í latin capital letter i with acute
+    { 0x00ce, "I" },        // Î latin capital letter i with circumflex
+    { 0x00cf, "I" },        // Ï latin capital letter i with diaeresis
+    { 0x00d0, "D" },        // Ð latin capital letter eth
+    { 0x00d1, "N" },        // Ñ latin capital letter n with tilde
+    { 0x00d2, "O" },        // Ò latin capital letter o with grave
+    { 0x00d3, "O" },        // Ó latin capital letter o with acute
+    { 0x00d4, "O" },        // Ô latin capital letter o with circumflex
+    { 0x00d5, "O" },        // Õ latin capital letter o with tilde
+    { 0x00d6, "\xef" },     // Ö latin capital letter o with diaeresis
+    { 0x00d7, "x" },        // × multiplication sign
+    { 0x00d8, "O" },        // Ø latin capital letter o with stroke
+    { 0x00d9, "U" },        // Ù latin capital letter u with grave
+    { 0x00da, "U" },        // Ú latin capital letter u with acute
+    { 0x00db, "U" },        // Û latin capital letter u with circumflex
+    { 0x00dc, "\xf5" },     // Ü latin capital letter u with diaeresis
+    { 0x00dd, "Y" },        // Ý latin capital letter y with acute
+    { 0x00de, "Th" },       // Þ latin capital letter thorn
+    { 0x00df, "\xe2" },     // ß latin small letter sharp s
+    { 0x00e0, (const char[]){ LCD_CHAR_A_GRAVE, 0 } }, // à latin small letter a with grave
+    { 0x00e1, "a" },        // á latin small letter a with acute
+    { 0x00e2, "a" },        // â latin small letter a with circumflex
+    { 0x00e3, "a" },        // ã latin small letter a with tilde
+    { 0x00e4, "\xe1" },     // ä latin small letter a with diaeresis
+    { 0x00e5, "a" },        // å latin small letter a with ring above
+    { 0x00e6, "ae" },       // æ latin small letter ae
+    { 0x00e7, (const char[]){ LCD_CHAR_C_CEDILLA, 0 } }, // ç latin small letter c with cedilla
+    { 0x00e8, (const char[]){ LCD_CHAR_E_GRAVE, 0 } }, // è latin small letter e with grave
+    { 0x00e9, (const char[]){ LCD_CHAR_E_ACUTE, 0 } }, // é latin small letter e with acute
+    { 0x00ea, "e" },        // ê latin small letter e with circumflex
+    { 0x00eb, "e" },        // ë latin small letter e with diaeresis
+    { 0x00ec, "i" },        // ì latin small letter i with grave
+    { 0x00ed, "i" },        // í latin small letter i with acute
+    { 0x00ee, "i" },        // î latin small letter i with circumflex
+    { 0x00ef, "i" },        // ï latin small letter i with diaeresis
+    { 0x00f0, "d" },        // ð latin small letter eth
+    { 0x00f1, "\xee" },     // ñ latin small letter n with tilde
+    { 0x00f2, "o" },        // ò latin small letter o with grave
+    { 0x00f3, "o" },        // ó latin small letter o with acute
+    { 0x00f4, "o" },        // ô latin small letter o with circumflex
+    { 0x00f5, "o" },        // õ latin small letter o with tilde
+    { 0x00f6, "\xef" },     // ö latin small letter o with diaeresis
+    { 0x00f7, "\xfd" },     // ÷ division sign
+    { 0x00f8, "o" },        // ø latin small letter o with stroke
+    { 0x00f9, "u" },        // ù latin small letter u with grave
+    { 0x00fa, "u" },        // ú latin small letter u with acute
+    { 0x00fb, "u" },        // û latin small letter u with circumflex
+    { 0x00fc, "\xf5" },     // ü latin small letter u with diaeresis
+    { 0x00fd, "y" },        // ý latin small letter y with acute
+    { 0x00fe, "th" },       // þ latin small letter thorn
+    { 0x00ff, "y" },        // ÿ latin small letter y with diaeresis
+    { 0x0100, "A" },        // Ā latin capital letter a with macron
+    { 0x0101, "a" },        // ā latin small letter a with macron
+    { 0x0102, "A" },        // Ă latin capital letter a with breve
+    { 0x0103, "a" },        // ă latin small letter a with breve
+    { 0x0104, "A" },        // Ą latin capital letter a with ogonek
+    { 0x0105, "a" },        // ą latin small letter a with ogonek
+    { 0x0106, "C" },        // Ć latin capital letter c with acute
+    { 0x0107, "c" },        // ć latin small letter c with acute
+    { 0x0108, "C" },        // Ĉ latin capital letter c with circumflex
+    { 0x0109, "c" },        // ĉ latin small letter c with circumflex
+    { 0x010a, "C" },        // Ċ latin capital letter c with dot above
+    { 0x010b, "c" },        // ċ latin small letter c with dot above
+    { 0x010c, "C" },        // Č latin capital letter c with caron
+    { 0x010d, "c" },        // č latin small letter c with caron
+    { 0x010e, "D" },        // Ď latin capital letter d with caron
+    { 0x010f, "d" },        // ď latin small letter d with caron
+    { 0x0110, "D" },        // Đ latin capital letter d with stroke
+    { 0x0111, "d" },        // đ latin small letter d with stroke
+    { 0x0112, "E" },        // Ē latin capital letter e with macron
+    { 0x0113, "e" },        // ē latin small letter e with macron
+    { 0x0114, "E" },        // Ĕ latin capital letter e with breve
+    { 0x0115, "e" },        // ĕ latin small letter e with breve
+    { 0x0116, "E" },        // Ė latin capital letter e with dot above
+    { 0x0117, "e" },        // ė latin small letter e with dot above
+    { 0x0118, "E" },        // Ę latin capital letter e with ogonek
+    { 0x0119, "e" },        // ę latin small letter e with ogonek
+    { 0x011a, "E" },        // Ě latin capital letter e with caron
+    { 0x011b, "e" },        // ě latin small letter e with caron
+    { 0x011c, "G" },        // Ĝ latin capital letter g with circumflex
+    { 0x011d, "g" },        // ĝ latin small letter g with circumflex
+    { 0x011e, "G" },        // Ğ latin capital letter g with breve
+    { 0x011f, "g" },        // ğ latin small letter g with breve
+    { 0x0120, "G" },        // Ġ latin capital letter g with dot above
+    { 0x0121, "g" },        // ġ latin small letter g with dot above
+    { 0x0122, "G" },        // Ģ latin capital letter g with cedilla
+    { 0x0123, "g" },        // ģ latin small letter g with cedilla
+    { 0x0124, "H" },        // Ĥ latin capital letter h with circumflex
+    { 0x0125, "h" },        // ĥ latin small letter h with circumflex
+    { 0x0126, "H" },        // Ħ latin capital letter h with stroke
+    { 0x0127, "h" },        // ħ latin small letter h with stroke
+    { 0x0128, "I" },        // Ĩ latin capital letter i with tilde
+    { 0x0129, "i" },        // ĩ latin small letter i with tilde
+    { 0x012a, "I" },        // Ī latin capital letter i with macron
+    { 0x012b, "i" },        // ī latin small letter i with macron
+    { 0x012c, "I" },        // Ĭ latin capital letter i with breve
+    { 0x012d, "i" },        // ĭ latin small letter i with breve
+    { 0x012e, "I" },        // Į latin capital letter i with ogonek
+    { 0x012f, "i" },        // į latin small letter i with ogonek
+    { 0x0130, "I" },        // İ latin capital letter i with dot above
+    { 0x0131, "i" },        // ı latin small letter dotless i
+    { 0x0132, "IJ" },       // Ĳ latin capital ligature ij
+    { 0x0133, "ij" },       // ĳ latin small ligature ij
+    { 0x0134, "J" },        // Ĵ latin capital letter j with circumflex
+    { 0x0135, "j" },        // ĵ latin small letter j with circumflex
+    { 0x0136, "K" },        // Ķ latin capital letter k with cedilla
+    { 0x0137, "k" },        // ķ latin small letter k with cedilla
+    { 0x0138, "k" },        // ĸ latin small letter kra
+    { 0x0139, "L" },        // Ĺ latin capital letter l with acute
+    { 0x013a, "l" },        // ĺ latin small letter l with acute
+    { 0x013b, "L" },        // Ļ latin capital letter l with cedilla
+    { 0x013c, "l" },        // ļ latin small letter l with cedilla
+    { 0x013d, "L" },        // Ľ latin capital letter l with caron
+    { 0x013e, "l" },        // ľ latin small letter l with caron
+    { 0x013f, "L" },        // Ŀ latin capital letter l with middle dot
+    { 0x0140, "l" },        // ŀ latin small letter l with middle dot
+    { 0x0141, "L" },        // Ł latin capital letter l with stroke
+    { 0x0142, "l" },        // ł latin small letter l with stroke
+    { 0x0143, "N" },        // Ń latin capital letter n with acute
+    { 0x0144, "n" },        // ń latin small letter n with acute
+    { 0x0145, "N" },        // Ņ latin capital letter n with cedilla
+    { 0x0146, "n" },        // ņ latin small letter n with cedilla
+    { 0x0147, "N" },        // Ň latin capital letter n with caron
+    { 0x0148, "n" },        // ň latin small letter n with caron
+    { 0x0149, "'n" },       // ŉ latin small letter n preceded by apostrophe
+    { 0x014a, "N" },        // Ŋ latin capital letter eng
+    { 0x014b, "n" },        // ŋ latin small letter eng
+    { 0x014c, "O" },        // Ō latin capital letter o with macron
+    { 0x014d, "o" },        // ō latin small letter o with macron
+    { 0x014e, "O" },        // Ŏ latin capital letter o with breve
+    { 0x014f, "o" },        // ŏ latin small letter o with breve
+    { 0x0150, "O" },        // Ő latin capital letter o with double acute
+    { 0x0151, "o" },        // ő latin small letter o with double acute
+    { 0x0152, "OE" },       // Œ latin capital ligature oe
+    { 0x0153, "oe" },       // œ latin small ligature oe
+    { 0x0154, "R" },        // Ŕ latin capital letter r with acute
+    { 0x0155, "r" },        // ŕ latin small letter r with acute
+    { 0x0156, "R" },        // Ŗ latin capital letter r with cedilla
+    { 0x0157, "r" },        // ŗ latin small letter r with cedilla
+    { 0x0158, "R" },        // Ř latin capital letter r with caron
+    { 0x0159, "r" },        // ř latin small letter r with caron
+    { 0x015a, "S" },        // Ś latin capital letter s with acute
+    { 0x015b, "s" },        // ś latin small letter s with acute
+    { 0x015c, "S" },        // Ŝ latin capital letter s with circumflex
+    { 0x015d, "s" },        // ŝ latin small letter s with circumflex
+    { 0x015e, "S" },        // Ş latin capital letter s with cedilla
+    { 0x015f, "s" },        // ş latin small letter s with cedilla
+    { 0x0160, "S" },        // Š latin capital letter s with caron
+    { 0x0161, "s" },        // š latin small letter s with caron
+    { 0x0162, "T" },        // Ţ latin capital letter t with cedilla
+    { 0x0163, "t" },        // ţ latin small letter t with cedilla
+    { 0x0164, "T" },        // Ť latin capital letter t with caron
+    { 0x0165, "t" },        // ť latin small letter t with caron
+    { 0x0166, "T" },        // Ŧ latin capital letter t with stroke
+    { 0x0167, "t" },        // ŧ latin small letter t with stroke
+    { 0x0168, "U" },        // Ũ latin capital letter u with tilde
+    { 0x0169, "u" },        // ũ latin small letter u with tilde
+    { 0x016a, "U" },        // Ū latin capital letter u with macron
+    { 0x016b, "u" },        // ū latin small letter u with macron
+    { 0x016c, "U" },        // Ŭ latin capital letter u with breve
+    { 0x016d, "u" },        // ŭ latin small letter u with breve
+    { 0x016e, "U" },        // Ů latin capital letter u with ring above
+    { 0x016f, "u" },        // ů latin small letter u with ring above
+    { 0x0170, "U" },        // Ű latin capital letter u with double acute
+    { 0x0171, "u" },        // ű latin small letter u with double acute
+    { 0x0172, "U" },        // Ų latin capital letter u with ogonek
+    { 0x0173, "u" },        // ų latin small letter u with ogonek
+    { 0x0174, "W" },        // Ŵ latin capital letter w with circumflex
+    { 0x0175, "w" },        // ŵ latin small letter w with circumflex
+    { 0x0176, "Y" },        // Ŷ latin capital letter y with circumflex
+    { 0x0177, "y" },        // ŷ latin small letter y with circumflex
+    { 0x0178, "Y" },        // Ÿ latin capital letter y with diaeresis
+    { 0x0179, "Z" },        // Ź latin capital letter z with acute
+    { 0x017a, "z" },        // ź latin small letter z with acute
+    { 0x017b, "Z" },        // Ż latin capital letter z with dot above
+    { 0x017c, "z" },        // ż latin small letter z with dot above
+    { 0x017d, "Z" },        // Ž latin capital letter z with caron
+    { 0x017e, "z" },        // ž latin small letter z with caron
+    { 0x017f, "s" },        // ſ latin small letter long s
+    { 0x03a3, "\xf6" },     // Σ greek capital letter sigma
+    { 0x03a9, "\xf4" },     // Ω greek capital letter omega
+    { 0x03b1, "\xe0" },     // α greek small letter alpha
+    { 0x03b2, "\xe2" },     // β greek small letter beta
+    { 0x03b5, "\xe3" },     // ε greek small letter epsilon
+    { 0x03b8, "\xf2" },     // θ greek small letter theta
+    { 0x03bc, "\xe4" },     // μ greek small letter mu
+    { 0x03c0, "\xf7" },     // π greek small letter pi
+    { 0x03c1, "\xe6" },     // ρ greek small letter rho
+    { 0x03c3, "\xe5" },     // σ greek small letter sigma
+    { 0x2010, "-" },        // ‐ hyphen
+    { 0x2011, "-" },        // ‑ non-breaking hyphen
+    { 0x2012, "-" },        // ‒ figure dash
+    { 0x2013, "-" },        // – en dash
+    { 0x2014, "-" },        // — em dash
+    { 0x2015, "-" },        // ― horizontal bar
+    { 0x2018, "'" },        // ‘ left single quotation mark
+    { 0x2019, "'" },        // ’ right single quotation mark
+    { 0x201a, "'" },        // ‚ single low-9 quotation mark
+    { 0x201b, "'" },        // ‛ single high-reversed-9 quotation mark
+    { 0x201c, "\"" },       // “ left double quotation mark
+    { 0x201d, "\"" },       // ” right double quotation mark
+    { 0x201e, "\"" },       // „ double low-9 quotation mark
+    { 0x201f, "\"" },       // ‟ double high-reversed-9 quotation mark
+    { 0x2022, "\xa5" },     // • bullet
+    { 0x2026, "..." },      // … horizontal ellipsis
+    { 0x2032, "'" },        // ′ prime
+    { 0x2033, "\"" },       // ″ double prime
+    { 0x2039, "<" },        // ‹ single left-pointing angle quotation mark
+    { 0x203a, ">" },        // › single right-pointing angle quotation mark
+    { 0x20ac, "EUR" },      // € euro sign
+    { 0x2122, "TM" },       // ™ trade mark sign
+    { 0x2126, "\xf4" },     // Ω ohm sign
+    { 0x2190, "\x7f" },     // ← leftwards arrow
+    { 0x2191, "^" },        // ↑ upwards arrow
+    { 0x2192, "~" },        // → rightwards arrow
+    { 0x2193, "v" },        // ↓ downwards arrow
+    { 0x2212, "-" },        // − minus sign
+    { 0x221a, "\xe8" },     // √ square root
+    { 0x221e, "\xf3" },     // ∞ infinity
+    { 0x2588, "\xff" },     // █ full block
+    { 0x266a, "\xa5" },     // ♪ eighth note
+    { 0x3001, "\xa4" },     // 、 ideographic comma
+    { 0x3002, "\xa1" },     // 。 ideographic full stop
+    { 0x300c, "\xa2" },     // 「 left corner bracket
+    { 0x300d, "\xa3" },     // 」 right corner bracket
+    { 0x30fb, "\xa5" },     // ・ katakana middle dot
+    { 0x30fc, "\xb0" },     // ー katakana-hiragana prolonged sound mark
+    { 0x4e07, "\xfb" },     // 万 cjk unified ideograph-4e07
+    { 0x5186, "\xfc" },     // 円 cjk unified ideograph-5186
+    { 0x5343, "\xfa" },     // 千 cjk unified ideograph-5343
+};
+
+
+
+static int compare_mappings(const void *key, const void *mapping) {
+    return (int)*(const uint32_t *)key - (int)((const LcdCharMapping *)mapping)->code_point;
+}
+
+
+
+/**
+ * Find the LCD codes for a code point outside of ASCII and the katakana
+ *
+ * @param uint32_t  code_point
+ * @return const char*  LCD codes, NULL if there is no mapping
+ */
+const char *lcd_charset_lookup(uint32_t code_point) {
+    const LcdCharMapping *mapping = bsearch(&code_point, mappings,
+        sizeof(mappings) / sizeof(mappings[0]), sizeof(mappings[0]), compare_mappings);
+    return mapping != NULL ? mapping->lcd : NULL;
+}
+
+
+
+/**
+ * What a character of the ROM shows, as a code point
+ *
+ * @param unsigned char     code    0x20 - 0xff
+ * @return uint32_t         0xfffd for the codes with nothing in the table
+ */
+uint32_t lcd_charset_code_point(unsigned char code) {
+    int i;
+
+    if (code >= 0x20 && code < 0x80 && code != '\\' && code != '~' && code != 0x7f) {
+        return code;
+    }
+    if (code >= 0xa1 && code <= 0xdf && code != 0xa5 && code != 0xb0 && code != 0xdf) {
+        return code - 0xa1 + 0xff61;
+    }
+
+    // The table has the glyph's own code point last, after the letters
+    // that are shown with it (e.g. Ä before ä)
+    for (i = sizeof(mappings) / sizeof(mappings[0]) - 1; i >= 0; i--) {
+        if ((unsigned char)mappings[i].lcd[0] == code && mappings[i].lcd[1] == '\0') {
+            return mappings[i].code_point;
+        }
+    }
+    return 0xfffd;
+}
+
+
+
+/**
+ * Decode the UTF-8 sequence at `*str` and move past it. Invalid sequences
+ * are skipped a byte at a time and decode to 0xfffd.
+ */
+uint32_t lcd_charset_decode(const unsigned char **str) {
+    const unsigned char *s = *str;
+    uint32_t code_point, min;
+    int n, i;
+
+    if (s[0] < 0x80) {
+        *str = s + 1;
+        return s[0];
+    }
+    else if ((s[0] & 0xe0) == 0xc0) {
+        n = 1;
+        code_point = s[0] & 0x1f;
+        min = 0x80;
+    }
+    else if ((s[0] & 0xf0) == 0xe0) {
+        n = 2;
+        code_point = s[0] & 0x0f;
+        min = 0x800;
+    }
+    else if ((s[0] & 0xf8) == 0xf0) {
+        n = 3;
+        code_point = s[0] & 0x07;
+        min = 0x10000;
+    }
+    else {
+        *str = s + 1;
+        return 0xfffd;
+    }
+
+    for (i = 1; i <= n; i++) {
+        if ((s[i] & 0xc0) != 0x80) {
+            *str = s + 1;
+            return 0xfffd;
+        }
+        code_point = (code_point << 6) | (s[i] & 0x3f);
+    }
+    *str = s + n + 1;
+
+    // Overlong, surrogate or out of range
+    if (code_point < min || (code_point >= 0xd800 && code_point < 0xe000) || code_point > 0x10ffff) {
+        return 0xfffd;
+    }
+    return code_point;
+}
+
+
+
+/**
+ * Translate a UTF-8 string to LCD codes. The codes of the custom
+ * characters (LCD_CHAR_*) pass through unchanged.
+ *
+ * @param const char*   str     UTF-8, NUL terminated
+ * @param char*         out     Receives the LCD codes, not NUL terminated
+ * @param int           max     Size of `out`
+ * @return int          Number of codes in `out`
+ */
+int lcd_charset_transcode(const char *str, char *out, int max) {
+    const unsigned char *s = (const unsigned char *)str;
+    static const char umlauts[] = "aouAOU", umlaut_codes[] = "\xe1\xef\xf5\xe1\xef\xf5";
+    int len = 0;
+
+    while (*s && len < max) {
+        uint32_t code_point = lcd_charset_decode(&s);
+        const char *lcd;
+
+        if (code_point < 0x80 && code_point != '\\' && code_point != '~') {
+            bool glyph = code_point >= LCD_GLYPH_BASE && code_point < LCD_GLYPH_BASE + LCD_GLYPHS_MAX;
+            out[len++] = code_point >= 0x20 || glyph ? code_point : ' ';
+        }
+        else if (code_point >= 0x300 && code_point < 0x370) {
+            // Combining marks go, except for an umlaut's dots on a, o, u
+            const char *umlaut;
+            if (code_point == 0x308 && len > 0 && (umlaut = strchr(umlauts, out[len - 1])) != NULL) {
+                out[len - 1] = umlaut_codes[umlaut - umlauts];
+            }
+        }
+        else if (code_point >= 0xff61 && code_point <= 0xff9f) {
+            out[len++] = code_point - 0xff61 + 0xa1;
+        }
+        else if ((lcd = lcd_charset_lookup(code_point)) != NULL) {
+            while (*lcd && len < max) {
+                out[len++] = *lcd++;
+            }
+        }
+        else {
+            out[len++] = LCD_CHARSET_UNKNOWN;
+        }
+    }
+    return len;
+}
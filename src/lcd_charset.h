@@ -0,0 +1,14 @@
+#ifndef __LCD_CHARSET_H__
+#define __LCD_CHARSET_H__
+
+#include <stdint.h>
+
+// Shown for what can't be decoded or has no glyph
+#define LCD_CHARSET_UNKNOWN '?'
+
+int lcd_charset_transcode(const char *str, char *out, int max);
+const char *lcd_charset_lookup(uint32_t code_point);
+uint32_t lcd_charset_code_point(unsigned char code);
+uint32_t lcd_charset_decode(const unsigned char **str);
+
+#endif
@@ -0,0 +1,105 @@
+/**
+ * LCD transport over pigpio's I2C
+ *
+ * @package kiddyblaster
+ */
+#include <stdlib.h>
+#include <syslog.h>
+#include <pigpio.h>
+
+#include "lcd_bus.h"
+
+typedef struct {
+    unsigned int i2c_bus;
+    unsigned int address;
+    int handle;             // -1 while closed
+} LcdI2cPriv;
+
+
+
+static int i2c_open(LcdI2cPriv *priv) {
+    priv->handle = i2cOpen(priv->i2c_bus, priv->address, 0);
+    return priv->handle;
+}
+
+
+
+/*
+ * A failed write closes the device, in case the handle has gone bad, and
+ * the next one opens it again. It is not retried: part of it may have
+ * made it to the LCD, the driver has to initialize the controller anew.
+ * It logs the failure, once for all the writes that fail after it.
+ */
+static int i2c_write(LcdBus *bus, const uint8_t *data, unsigned int len) {
+    LcdI2cPriv *priv = bus->priv;
+
+    if (priv->handle < 0 && i2c_open(priv) < 0) {
+        return -1;
+    }
+    if (i2cWriteDevice(priv->handle, (char *)data, len) != 0) {
+        i2cClose(priv->handle);
+        priv->handle = -1;
+        return -1;
+    }
+    return 0;
+}
+
+
+
+static int i2c_read(LcdBus *bus, uint8_t *data) {
+    LcdI2cPriv *priv = bus->priv;
+    int value;
+
+    if (priv->handle < 0 || (value = i2cReadByte(priv->handle)) < 0) {
+        return -1;
+    }
+    *data = value;
+    return 0;
+}
+
+
+
+static void i2c_delay(LcdBus *bus, unsigned int usec) {
+    (void)bus;
+    gpioDelay(usec);
+}
+
+
+
+static void i2c_free(LcdBus *bus) {
+    LcdI2cPriv *priv = bus->priv;
+    if (priv->handle >= 0) {
+        i2cClose(priv->handle);
+    }
+    free(priv);
+}
+
+
+
+/**
+ * Open the PCF8574 at `address` on I2C bus `i2c_bus`, pigpio must be
+ * initialized
+ *
+ * @param unsigned int  i2c_bus     e.g. 1 for /dev/i2c-1
+ * @param unsigned int  address     7 bit address
+ * @return LcdBus*      NULL if the device could not be opened
+ */
+LcdBus *lcd_i2c_new(unsigned int i2c_bus, unsigned int address) {
+    LcdI2cPriv *priv = malloc(sizeof(LcdI2cPriv));
+    priv->i2c_bus = i2c_bus;
+    priv->address = address;
+    if (i2c_open(priv) < 0) {
+        syslog(LOG_ERR, "Failed to open the LCD at 0x%02x on I2C bus %u\n", address, i2c_bus);
+        free(priv);
+        return NULL;
+    }
+
+    LcdBus *bus = calloc(1, sizeof(LcdBus));
+    bus->name = "i2c";
+    bus->write = i2c_write;
+    bus->read = i2c_read;
+    bus->delay = i2c_delay;
+    bus->free = i2c_free;
+    bus->priv = priv;
+    return bus;
+}
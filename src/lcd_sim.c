@@ -0,0 +1,382 @@
+/**
+ * Virtual HD44780 behind a PCF8574
+ *
+ * The PCF8574 is wired as on the usual backpacks: P0 RS, P1 R/W, P2 E,
+ * P3 backlight, P4 - P7 D4 - D7. The controller latches D4 - D7 (and RS)
+ * on the falling edge of E, a whole instruction in 8 bit mode, a nibble
+ * in 4 bit mode. It powers up in 8 bit mode, as after the first function
+ * set of the init sequence.
+ *
+ * With R/W high and E high the controller drives the busy flag and the
+ * address counter onto the data lines, a nibble per E pulse in 4 bit mode,
+ * and reading the PCF8574 sees them on the pins it keeps high. With R/W
+ * tied to ground instead, every E pulse writes.
+ *
+ * @package kiddyblaster
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "i2c_lcd.h"
+#include "lcd_charset.h"
+#include "lcd_sim.h"
+
+// Execution times in µs (HD44780 datasheet, fosc = 270 kHz), they scale
+// with the controller's oscillator
+#define SIM_OSC_KHZ 270
+#define SIM_TIME_CLEAR 1520
+#define SIM_TIME_DEFAULT 37
+#define SIM_TIME_DATA 41
+
+// Waits the init sequence needs after the first and second function set
+#define SIM_TIME_INIT_1 4100
+#define SIM_TIME_INIT_2 100
+
+#define SIM_DDRAM_SIZE 0x80
+
+typedef struct {
+    uint64_t now;
+    unsigned int bus_khz;
+    unsigned int osc_khz;
+    bool rw_wired;              // R/W is on P1, not tied to ground
+
+    uint8_t outputs;            // Of the PCF8574
+    bool four_bit;
+    bool low_nibble;            // The next nibble completes a byte
+    uint8_t high_nibble;
+    bool read_low_nibble;       // The next read nibble is the low one
+    int function_sets;          // Seen in 8 bit mode, for the init waits
+    uint64_t busy_until;
+
+    // Controller state
+    uint8_t ddram[SIM_DDRAM_SIZE];
+    uint8_t cgram[64];
+    uint8_t address;            // Address counter
+    bool cgram_selected;        // The address counter points into CGRAM
+    bool increment;
+    bool display_on;
+    bool two_lines;
+
+    LcdSimStats stats;
+} LcdSim;
+
+
+
+/*
+ * Run an instruction (RS low) or write data (RS high) that has been
+ * latched at sim->now
+ */
+static void execute(LcdSim *sim, uint8_t value, bool rs) {
+    unsigned int time = SIM_TIME_DEFAULT, osc_khz = sim->osc_khz;
+
+    if (sim->now < sim->busy_until) {
+        sim->stats.busy_violations++;
+    }
+
+    if (rs) {
+        if (sim->cgram_selected) {
+            sim->cgram[sim->address & 0x3f] = value & 0x1f;
+        }
+        else {
+            sim->ddram[sim->address & 0x7f] = value;
+        }
+        sim->address += sim->increment ? 1 : -1;
+        sim->stats.characters++;
+        time = SIM_TIME_DATA;
+    }
+    else {
+        sim->stats.instructions++;
+        if (value & 0x80) {
+            sim->address = value & 0x7f;
+            sim->cgram_selected = false;
+        }
+        else if (value & 0x40) {
+            sim->address = value & 0x3f;
+            sim->cgram_selected = true;
+        }
+        else if (value & 0x20) {
+            sim->four_bit = !(value & 0x10);
+            sim->two_lines = value & 0x08;
+            if (!sim->four_bit && sim->function_sets < 2) {
+                time = ++sim->function_sets == 1 ? SIM_TIME_INIT_1 : SIM_TIME_INIT_2;
+                osc_khz = SIM_OSC_KHZ;  // Fixed waits
+            }
+        }
+        else if (value & 0x10) {
+            // Cursor or display shift, not used
+        }
+        else if (value & 0x08) {
+            sim->display_on = value & 0x04;
+        }
+        else if (value & 0x04) {
+            sim->increment = value & 0x02;
+        }
+        else if (value & 0x02) {
+            sim->address = 0;
+            sim->cgram_selected = false;
+            time = SIM_TIME_CLEAR;
+        }
+        else if (value & 0x01) {
+            memset(sim->ddram, ' ', sizeof(sim->ddram));
+            sim->address = 0;
+            sim->cgram_selected = false;
+            sim->increment = true;
+            time = SIM_TIME_CLEAR;
+        }
+    }
+    sim->busy_until = sim->now + (uint64_t)time * SIM_OSC_KHZ / osc_khz;
+}
+
+
+
+/*
+ * The PCF8574's outputs change to `outputs`
+ */
+static void set_outputs(LcdSim *sim, uint8_t outputs) {
+    bool falling_edge = (sim->outputs & ENABLE) && !(outputs & ENABLE);
+    uint8_t nibble = outputs & 0xf0;
+
+    sim->outputs = outputs;
+    if (!falling_edge) {
+        return;
+    }
+    if ((outputs & READ_WRITE) && sim->rw_wired) {
+        sim->read_low_nibble = sim->four_bit && !sim->read_low_nibble;
+        return;
+    }
+
+    if (!sim->four_bit) {
+        execute(sim, nibble, outputs & LCD_CHR);
+    }
+    else if (!sim->low_nibble) {
+        sim->high_nibble = nibble;
+        sim->low_nibble = true;
+    }
+    else {
+        sim->low_nibble = false;
+        execute(sim, sim->high_nibble | (nibble >> 4), outputs & LCD_CHR);
+    }
+}
+
+
+
+/*
+ * A write takes 9 clocks (8 bits and the ack) per byte after the address
+ */
+static int sim_write(LcdBus *bus, const uint8_t *data, unsigned int len) {
+    LcdSim *sim = bus->priv;
+    unsigned int i;
+
+    sim->now += 9000 / sim->bus_khz;
+    for (i = 0; i < len; i++) {
+        sim->now += 9000 / sim->bus_khz;
+        set_outputs(sim, data[i]);
+    }
+    sim->stats.writes++;
+    sim->stats.bytes += len + 1;
+    return 0;
+}
+
+
+
+/*
+ * Reading takes the address and a byte. The pins the PCF8574 keeps high
+ * read what the controller drives onto them.
+ */
+static int sim_read(LcdBus *bus, uint8_t *data) {
+    LcdSim *sim = bus->priv;
+    uint8_t lines = 0xf0;
+
+    sim->now += 2 * 9000 / sim->bus_khz;
+    if (sim->rw_wired && (sim->outputs & READ_WRITE) && (sim->outputs & ENABLE) && !(sim->outputs & LCD_CHR)) {
+        lines = (sim->now < sim->busy_until ? 0x80 : 0x00) | (sim->address & 0x7f);
+        if (sim->four_bit && sim->read_low_nibble) {
+            lines <<= 4;
+        }
+        lines &= 0xf0;
+    }
+    *data = (sim->outputs & 0x0f) | (sim->outputs & lines);
+    sim->stats.reads++;
+    sim->stats.bytes += 2;
+    return 0;
+}
+
+
+
+static void sim_delay(LcdBus *bus, unsigned int usec) {
+    LcdSim *sim = bus->priv;
+    sim->now += usec;
+}
+
+
+
+static uint64_t sim_now(LcdBus *bus) {
+    LcdSim *sim = bus->priv;
+    return sim->now;
+}
+
+
+
+static void sim_free(LcdBus *bus) {
+    free(bus->priv);
+}
+
+
+
+/**
+ * A virtual LCD, powered up with garbage in DDRAM like a real one
+ *
+ * @param unsigned int  bus_khz     I2C clock the bus time is taken from
+ */
+LcdBus *lcd_sim_new(unsigned int bus_khz) {
+    LcdSim *sim = calloc(1, sizeof(LcdSim));
+    sim->bus_khz = bus_khz > 0 ? bus_khz : 100;
+    sim->osc_khz = SIM_OSC_KHZ;
+    sim->rw_wired = true;
+    sim->increment = true;
+    memset(sim->ddram, 0xff, sizeof(sim->ddram));
+
+    LcdBus *bus = calloc(1, sizeof(LcdBus));
+    bus->name = "sim";
+    bus->write = sim_write;
+    bus->read = sim_read;
+    bus->delay = sim_delay;
+    bus->now = sim_now;
+    bus->free = sim_free;
+    bus->priv = sim;
+    return bus;
+}
+
+
+
+/**
+ * Run the controller's oscillator at `osc_khz` instead of the nominal
+ * 270 kHz, the execution times scale with it
+ */
+void lcd_sim_set_oscillator(LcdBus *bus, unsigned int osc_khz) {
+    LcdSim *sim = bus->priv;
+    sim->osc_khz = osc_khz > 0 ? osc_khz : SIM_OSC_KHZ;
+}
+
+
+
+/**
+ * Whether R/W is wired to the PCF8574. If not, it is tied to ground and
+ * the busy flag can't be read: the pins read back as the PCF8574 keeps
+ * them.
+ */
+void lcd_sim_set_rw_wired(LcdBus *bus, bool wired) {
+    LcdSim *sim = bus->priv;
+    sim->rw_wired = wired;
+}
+
+
+
+LcdSimStats lcd_sim_get_stats(LcdBus *bus) {
+    LcdSim *sim = bus->priv;
+    return sim->stats;
+}
+
+
+
+/**
+ * The character codes a line shows
+ *
+ * @param LcdBus*           bus
+ * @param int               line    LCD_LINE_1 or LCD_LINE_2
+ * @param unsigned char*    codes   Receives LCD_COLS codes
+ */
+void lcd_sim_get_line(LcdBus *bus, int line, unsigned char *codes) {
+    LcdSim *sim = bus->priv;
+    memcpy(codes, sim->ddram + (line & 0x7f), LCD_COLS);
+}
+
+
+
+bool lcd_sim_get_backlight(LcdBus *bus) {
+    LcdSim *sim = bus->priv;
+    return sim->outputs & LCD_BACKLIGHT;
+}
+
+
+
+/*
+ * A character code as UTF-8, custom characters as the slot's number
+ */
+static void put_code(FILE *out, unsigned char code) {
+    uint32_t cp;
+
+    if (code < 0x10) {
+        fputc('0' + (code & 0x07), out);
+        return;
+    }
+    cp = lcd_charset_code_point(code);
+    if (cp < 0x80) {
+        fputc(cp, out);
+    }
+    else if (cp < 0x800) {
+        fprintf(out, "%c%c", 0xc0 | (cp >> 6), 0x80 | (cp & 0x3f));
+    }
+    else {
+        fprintf(out, "%c%c%c", 0xe0 | (cp >> 12), 0x80 | ((cp >> 6) & 0x3f), 0x80 | (cp & 0x3f));
+    }
+}
+
+
+
+/**
+ * Draw the display as text: the two lines in a frame, followed by the
+ * custom characters they use (shown as their slot number)
+ */
+void lcd_sim_render(LcdBus *bus, FILE *out) {
+    LcdSim *sim = bus->priv;
+    static const int lines[] = { LCD_LINE_1, LCD_LINE_2 };
+    bool used[LCD_CGRAM_SLOTS] = { false };
+    int l, col, s, row, bit;
+
+    fprintf(out, "+----------------+\n");
+    for (l = 0; l < LCD_LINES; l++) {
+        fputc('|', out);
+        for (col = 0; col < LCD_COLS; col++) {
+            unsigned char code = sim->display_on ? sim->ddram[(lines[l] & 0x7f) + col] : ' ';
+            if (code < 0x10) {
+                used[code & 0x07] = true;
+            }
+            put_code(out, code);
+        }
+        fprintf(out, "|\n");
+    }
+    fprintf(out, "+----------------+ backlight %s\n", lcd_sim_get_backlight(bus) ? "on" : "off");
+
+    for (row = 0; row < 8; row++) {
+        for (s = 0; s < LCD_CGRAM_SLOTS; s++) {
+            if (!used[s]) {
+                continue;
+            }
+            fprintf(out, row == 0 ? "%d " : "  ", s);
+            for (bit = 4; bit >= 0; bit--) {
+                fputc(sim->cgram[s * 8 + row] & (1 << bit) ? '#' : '.', out);
+            }
+            fputc(' ', out);
+        }
+        if (memchr(used, true, sizeof(used)) != NULL) {
+            fputc('\n', out);
+        }
+    }
+}
+
+
+
+/**
+ * Render the display into a file
+ *
+ * @return int      0 on success
+ */
+int lcd_sim_snapshot(LcdBus *bus, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (out == NULL) {
+        return -1;
+    }
+    lcd_sim_render(bus, out);
+    return fclose(out);
+}
@@ -0,0 +1,40 @@
+/**
+ * Virtual HD44780 behind a PCF8574
+ *
+ * Decodes what the driver puts on the PCF8574's outputs the way the LCD
+ * does: the 8 and 4 bit interface, instructions, DDRAM and CGRAM with the
+ * address counter, and the execution time of every instruction, so writes
+ * that come in while the controller is still busy are caught. Time is
+ * virtual: bytes on the bus and delays advance a clock instead of
+ * sleeping.
+ *
+ * @package kiddyblaster
+ */
+#ifndef __LCD_SIM_H__
+#define __LCD_SIM_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "lcd_bus.h"
+
+typedef struct {
+    unsigned long writes;           // Bus transactions
+    unsigned long reads;            // Bus transactions reading a byte
+    unsigned long bytes;            // On the bus, including the address
+    unsigned long instructions;
+    unsigned long characters;       // Written to DDRAM or CGRAM
+    unsigned long busy_violations;  // Nibbles latched while the controller was busy
+} LcdSimStats;
+
+LcdBus *lcd_sim_new(unsigned int bus_khz);
+void lcd_sim_set_oscillator(LcdBus *bus, unsigned int osc_khz);
+void lcd_sim_set_rw_wired(LcdBus *bus, bool wired);
+LcdSimStats lcd_sim_get_stats(LcdBus *bus);
+void lcd_sim_get_line(LcdBus *bus, int line, unsigned char *codes);
+bool lcd_sim_get_backlight(LcdBus *bus);
+
+void lcd_sim_render(LcdBus *bus, FILE *out);
+int lcd_sim_snapshot(LcdBus *bus, const char *path);
+
+#endif
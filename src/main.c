@@ -23,6 +23,7 @@
 #include <sys/stat.h>
 #include <signal.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <mpd/client.h>
 #include <mpd/connection.h>
@@ -35,6 +36,8 @@
 #include "card.h"
 #include "network_info.h"
 #include "browser.h"
+#include "metrics.h"
+#include "latency.h"
 
 /* typedef void (*sighandler_t)(int); */
 
@@ -45,6 +48,13 @@
 
 #define SLEEP_TIMER 60 * 60
 
+// Pause playback when the card is taken off the reader
+#define PAUSE_ON_CARD_REMOVAL false
+
+// Browse the directories below mpd's music directory instead of mpd's
+// database, scanning them on all cores and following them with inotify
+/* #define BROWSER_MUSIC_DIR "/home/pi/Music" */
+
 // Timer NRs for different gpioSetTimer calls
 enum {
     TIMER_NR_BACKLIGHT,
@@ -54,6 +64,15 @@ enum {
 
 #define BACKLIGHT_OFF_TIMEOUT 60 * 1000
 
+// Holding PREV or NEXT in select mode: ms until it repeats, ms between
+// repeats, and repeats by one directory before it jumps by initials
+#define SELECT_REPEAT_DELAY 500
+#define SELECT_REPEAT_INTERVAL 150
+#define SELECT_REPEAT_BY_INITIAL 8
+
+// Button events waiting for the UI thread, more are dropped
+#define BUTTON_EVENTS_MAX 32
+
 // Globals
 int timer = 0;  // seconds 
 int micros;     // dummy, unused but we need it to pass to gpioTime()
@@ -61,14 +80,50 @@ bool is_sleeping = false;
 int current_song = 0;
 bool running = true;
 bool select_mode = false;
-Browser *browser;
+volatile sig_atomic_t dump_metrics = false;
+Browser *browser;   // Only used on the UI thread, see ui_loop()
+
+// The card that has been played last, -1 for none
+static int playing_card_id = -1;
+
+// The card reader playing cards and, if connected, the one queueing them
+enum {
+    READER_PLAY,
+    READER_QUEUE,
+    N_READERS
+};
+CardReader *card_readers[N_READERS];
+int n_card_readers = 0;
+
+/*
+ * The buttons are handled and the display is drawn on one thread, see
+ * ui_loop(): the pigpio alerts only queue the button events and the other
+ * threads only ask for a redraw, so none of them waits for mpd
+ */
+typedef struct {
+    int pin;
+    int level;
+    uint32_t tick;
+} ButtonEvent;
+
+static struct {
+    ButtonEvent events[BUTTON_EVENTS_MAX];  // Ring buffer
+    int head;
+    int count;
+    bool redraw;
+    bool stop;
+} ui;
+static pthread_mutex_t ui_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ui_wakeup = PTHREAD_COND_INITIALIZER;
+static pthread_t ui_thread;
 
 
 
 // Prototypes
 void update_lcd();
+static void draw_lcd();
+static void update_selection_lcd();
 /* static void start_daemon(const char*, int); */
-static void read_directories(const char *path, int depth);
 static void display_network_info();
 /* static void read_directories(const char *path, int depth); */
 
@@ -95,11 +150,47 @@ static void backlight_off() {
 
 
 
+/**
+ * Complete the tap waiting for its card to play, going back by mpd's
+ * elapsed time to when the first song has started. Gives up on it once
+ * mpd has taken longer than LATENCY_PLAY_TIMEOUT or has got past the
+ * first song.
+ */
+static void check_tap_playing() {
+    uint64_t since, now;
+    int song_nr, elapsed_ms;
+
+    if (!latency_tap_resume(&since)) {
+        return;
+    }
+    elapsed_ms = player_get_elapsed_ms(&song_nr);
+    now = latency_now();
+
+    if (elapsed_ms > 0) {
+        if (song_nr == 0 && now - since <= (elapsed_ms + LATENCY_PLAY_TIMEOUT) * 1000ULL) {
+            latency_tap_mark_at(LATENCY_MPD_PLAYING, now - elapsed_ms * 1000ULL);
+        }
+        else {
+            latency_tap_cancel();
+        }
+    }
+    else if (now - since < LATENCY_PLAY_TIMEOUT * 1000ULL) {
+        latency_tap_defer();
+    }
+    else {
+        latency_tap_cancel();
+    }
+}
+
+
+
 /**
  * Callback which is called periodically to update
  * the LCD display in case a new track has started
  */
 static void check_new_song() {
+    check_tap_playing();
+
     // Only check, if player is actually playing...
     if (!player_is_playing()) {
         return;
@@ -135,6 +226,7 @@ static void goto_sleep() {
     syslog(LOG_NOTICE, "ZZ Going to sleep\n");
     lcd_clear();
     lcd_puts(LCD_LINE_1, "Gute Nacht  [ZZ]");
+    lcd_flush();
     lcd_set_backlight(false);
     player_pause();
 }
@@ -142,33 +234,92 @@ static void goto_sleep() {
 
 
 
-static void on_button_pressed(int pin, int level, uint32_t tick) {
+/*
+ * PREV or NEXT is held in select mode: step a directory at a time at
+ * first, then an initial at a time
+ */
+static void repeat_selection(int pin, int repeats) {
+    if (repeats == 0) {
+        gpioSetWatchdog(pin, SELECT_REPEAT_INTERVAL);
+    }
+
+    if (repeats < SELECT_REPEAT_BY_INITIAL) {
+        if (pin == BUTTON_3_PIN) {
+            browser_next(browser);
+        }
+        else {
+            browser_previous(browser);
+        }
+    }
+    else {
+        if (pin == BUTTON_3_PIN) {
+            browser_next_initial(browser);
+        }
+        else {
+            browser_previous_initial(browser);
+        }
+    }
+    update_selection_lcd();
+}
+
+
+
+/*
+ * A button has been pressed, released or held (PI_TIMEOUT), on the UI
+ * thread
+ */
+static void handle_button(int pin, int level, uint32_t tick) {
     uint32_t duration;
     static uint32_t t0;
+    static int repeats;
     bool do_update_lcd = true;
 
+    // Still held, see repeat_selection()
+    if (level == PI_TIMEOUT) {
+        if (select_mode) {
+            repeat_selection(pin, repeats++);
+        }
+        else {
+            gpioSetWatchdog(pin, 0);
+        }
+        return;
+    }
+
     if (level == 0) {
         // button pressed, start counting ...
         t0 = tick;
+        repeats = 0;
+        if (select_mode && (pin == BUTTON_2_PIN || pin == BUTTON_3_PIN)) {
+            gpioSetWatchdog(pin, SELECT_REPEAT_DELAY);
+        }
     }
     else {
         // button has been released
         duration = (tick - t0) / 1000;
         t0 = tick;
+        gpioSetWatchdog(pin, 0);
 
+        /*
+         * Held to scroll through the directories, which is done
+         */
+        if (repeats > 0) {
+            do_update_lcd = false;
+        }
         /*
          * Short button press (less than 700 ms)
          */
-        if (duration < 700) {
+        else if (duration < 700) {
             switch (pin) {
                 case BUTTON_1_PIN:
                     if (select_mode) {
                         select_mode = false;
+                        browser_save(browser);
                         const gchar *uri = browser_get_selected_directory(browser);
                         if (uri != NULL) {
                             syslog(LOG_NOTICE, "Playing URI: %s\n", uri);
                             player_play_uri(uri);
-                            update_lcd();
+                            playing_card_id = -1;
+                            draw_lcd();
                         }
                         else {
                             syslog(LOG_WARNING, "Failed to get selected path fromr file browser");
@@ -182,7 +333,15 @@ static void on_button_pressed(int pin, int level, uint32_t tick) {
 
                 case BUTTON_2_PIN:
                     if (select_mode) {
-                        browser_previous(browser);
+                        // Before the first directory is the one above
+                        if (browser_get_position(browser) <= 1) {
+                            browser_up(browser);
+                        }
+                        else {
+                            browser_previous(browser);
+                        }
+                        update_selection_lcd();
+                        do_update_lcd = false;
                     }
                     else {
                         syslog(LOG_NOTICE, "<< PREV\n");
@@ -193,6 +352,8 @@ static void on_button_pressed(int pin, int level, uint32_t tick) {
                 case BUTTON_3_PIN:
                     if (select_mode) {
                         browser_next(browser);
+                        update_selection_lcd();
+                        do_update_lcd = false;
                     }
                     else {
                         syslog(LOG_NOTICE, ">> NEXT\n");
@@ -207,14 +368,20 @@ static void on_button_pressed(int pin, int level, uint32_t tick) {
         else if (duration < 5000) {
             switch (pin) {
                 case BUTTON_1_PIN:
-                    // Re-play current playlist from start
-                    player_replay_playlist();
+                    if (select_mode) {
+                        browser_enter(browser);
+                        update_selection_lcd();
+                        do_update_lcd = false;
+                    }
+                    else {
+                        // Re-play current playlist from start
+                        player_replay_playlist();
+                    }
                     break;
 
                 case BUTTON_2_PIN:
                     // Re-init LCD
-                    lcd_deinit();
-                    lcd_init();
+                    lcd_reset();
                     break;
 
                 case BUTTON_3_PIN:
@@ -233,6 +400,8 @@ static void on_button_pressed(int pin, int level, uint32_t tick) {
                     syslog(LOG_NOTICE, ".. SHUTDOWN\n");
                     lcd_clear();
                     lcd_puts(LCD_LINE_1, "Tschüß..!");
+                    lcd_flush();
+                    lcd_deinit();
                     sync();
                     reboot(LINUX_REBOOT_CMD_POWER_OFF);
                     break;
@@ -262,7 +431,7 @@ static void on_button_pressed(int pin, int level, uint32_t tick) {
         //}
 
         if (do_update_lcd) {
-            update_lcd();
+            draw_lcd();
         }
         lcd_set_backlight(true);
         gpioSetTimerFunc(TIMER_NR_BACKLIGHT, BACKLIGHT_OFF_TIMEOUT, &backlight_off);
@@ -271,122 +440,323 @@ static void on_button_pressed(int pin, int level, uint32_t tick) {
 
 
 
-/**
- * Update the LCD display
+/*
+ * Put the selection of select mode into the frame: the name in the first
+ * line if it is another one or `redraw` is set, where it is in the second
  */
-void update_lcd() {
-    if (select_mode) {
-        lcd_clear();
-        const gchar *uri = browser_get_selected_directory(browser);
-        if (uri != NULL) {
-            lcd_puts(LCD_LINE_1, uri);
-        }
-        lcd_puts(LCD_LINE_2, "SEL     ↑     ↓ ");
+static void show_selection(bool redraw) {
+    static gchar shown_name[256];
+    char str[LCD_COLS + 1];
+    const gchar *name = browser_get_selected_name(browser);
+
+    if (name == NULL) {
+        name = "";
+    }
+    if (redraw || strcmp(name, shown_name) != 0) {
+        // Leave the last two cells to the indicators
+        lcd_scroll(LCD_LINE_1, LCD_COLS - 2, name);
+        g_strlcpy(shown_name, name, sizeof(shown_name));
     }
-    else {
-        struct mpd_connection *mpd;
-        char str[17], states[] = { '?', '.', LCD_CHAR_PLAY, LCD_CHAR_PAUSE };
-        int n, m;
-
-        mpd = mpd_connection_new("localhost", 6600, 0);
-        if (mpd == NULL || mpd_connection_get_error(mpd) != MPD_ERROR_SUCCESS) {
-            syslog(LOG_ERR, "Failed to connect to mpd\n");
-            return;
-        }
 
-        struct mpd_status *status = mpd_run_status(mpd);
-        if (status == NULL) {
-            syslog(LOG_ERR, "Failed to get mpd status\n");
-            return;
-        }
+    // How deep we are, where among the directories there and whether
+    // the selected one can be entered (long press on PLAY, up is PREV on
+    // the first one)
+    snprintf(str, sizeof(str), "SEL%.*s %d/%d%*s", browser_get_depth(browser), ">>>>",
+             browser_get_position(browser), browser_get_count(browser), LCD_COLS, "");
+    lcd_puts(LCD_LINE_2, str);
+    if (browser_selected_has_children(browser)) {
+        lcd_put(LCD_LINE_2, LCD_COLS - 1, '>');
+    }
+}
+
 
-        int state = mpd_status_get_state(status);
-        int song_id = mpd_status_get_song_id(status);
 
-        struct mpd_song *song = mpd_run_get_queue_song_id(mpd, song_id);
-        char *title;
-        if (song) {
-            title = (char*)mpd_song_get_tag(song, MPD_TAG_TITLE, 0);
+/*
+ * The selection has changed, show it and leave the rest of the screen
+ */
+static void update_selection_lcd() {
+    show_selection(false);
+    lcd_flush();
+}
 
-            n = mpd_status_get_song_pos(status) + 1;
-            m = mpd_status_get_queue_length(status);
 
-            mpd_status_free(status);
-            mpd_connection_free(mpd);
 
-            snprintf(str, sizeof(str), "%c %02u/%02u         ", states[state], n, m);
-            lcd_puts(LCD_LINE_1, str);
+/*
+ * Put what mpd is playing into the frame, leave it as it is if mpd can't
+ * be asked
+ */
+static void show_player() {
+    struct mpd_connection *mpd;
+    char str[17], states[] = { '?', '.', LCD_CHAR_PLAY, LCD_CHAR_PAUSE };
+    int n, m;
 
-            snprintf(str, sizeof(str), "%-16s", title);
-            lcd_puts(LCD_LINE_2, str);
-        }
+    if ((mpd = player_connection_get()) == NULL) {
+        return;
+    }
+
+    struct mpd_status *status = mpd_run_status(mpd);
+    if (status == NULL) {
+        syslog(LOG_ERR, "Failed to get mpd status\n");
+        player_connection_release(mpd);
+        return;
+    }
+
+    int state = mpd_status_get_state(status);
+    int song_id = mpd_status_get_song_id(status);
+
+    struct mpd_song *song = mpd_run_get_queue_song_id(mpd, song_id);
+    const char *title;
+    if (song) {
+        title = mpd_song_get_tag(song, MPD_TAG_TITLE, 0);
+
+        n = mpd_status_get_song_pos(status) + 1;
+        m = mpd_status_get_queue_length(status);
+
+        snprintf(str, sizeof(str), "%c %02u/%02u         ", states[state], n, m);
+        lcd_puts(LCD_LINE_1, str);
+
+        lcd_scroll(LCD_LINE_2, LCD_COLS, title != NULL ? title : "");
+        mpd_song_free(song);
     }
+    mpd_status_free(status);
+    player_connection_release(mpd);
+}
 
+
+
+/*
+ * Draw the LCD display, on the UI thread
+ */
+static void draw_lcd() {
+    if (select_mode) {
+        lcd_clear();
+        show_selection(true);
+    }
+    else {
+        show_player();
+    }
+
+    // The indicators go on without mpd, a reader being down matters most
+    // when nothing plays
     wifi_info_t wifi_info;
-    puts("about to call get_wifi_info()");
-    get_wifi_info(&wifi_info);
+    network_info_get(&wifi_info);
 
     int level = wifi_info.link_quality / 25;
     if (level > 3) {
         level = 3;
     }
-    lcd_loc(0x8f);
-    lcd_byte(level, LCD_CHR);
+    lcd_put(LCD_LINE_1, 15, LCD_CHAR_WIFI_0 + level);
+
+    // A card reader is down and being recovered
+    int i;
+    for (i = 0; i < n_card_readers; i++) {
+        if (!card_reader_is_healthy(card_readers[i])) {
+            lcd_put(LCD_LINE_1, 14, '!');
+            break;
+        }
+    }
+    lcd_flush();
+}
+
+
+
+
+
+/**
+ * Have the LCD display brought up to date, from any thread
+ */
+void update_lcd() {
+    pthread_mutex_lock(&ui_lock);
+    ui.redraw = true;
+    pthread_cond_signal(&ui_wakeup);
+    pthread_mutex_unlock(&ui_lock);
+}
+
+
+
+/*
+ * pigpio's alert for the buttons, queues the event for the UI thread
+ */
+static void on_button_pressed(int pin, int level, uint32_t tick) {
+    pthread_mutex_lock(&ui_lock);
+    if (ui.count < BUTTON_EVENTS_MAX) {
+        ui.events[(ui.head + ui.count++) % BUTTON_EVENTS_MAX] = (ButtonEvent){ pin, level, tick };
+        pthread_cond_signal(&ui_wakeup);
+    }
+    pthread_mutex_unlock(&ui_lock);
 }
 
 
 
+/*
+ * The UI thread: handle the button events in the order they have come
+ * in, then redraw if asked to
+ */
+static void *ui_loop(void *data) {
+    ButtonEvent event;
+
+    (void)data;
+    pthread_mutex_lock(&ui_lock);
+    while (!ui.stop) {
+        if (ui.count > 0) {
+            event = ui.events[ui.head];
+            ui.head = (ui.head + 1) % BUTTON_EVENTS_MAX;
+            ui.count--;
+            pthread_mutex_unlock(&ui_lock);
+            handle_button(event.pin, event.level, event.tick);
+            pthread_mutex_lock(&ui_lock);
+        }
+        else if (ui.redraw) {
+            ui.redraw = false;
+            pthread_mutex_unlock(&ui_lock);
+            draw_lcd();
+            pthread_mutex_lock(&ui_lock);
+        }
+        else {
+            pthread_cond_wait(&ui_wakeup, &ui_lock);
+        }
+    }
+    pthread_mutex_unlock(&ui_lock);
+    return NULL;
+}
+
+
 
 static void display_network_info() {
+    wifi_info_t wifi_info;
+    char buf[LCD_COLS + 1];
+
     syslog(LOG_NOTICE, "Displaying network info");
+    network_info_get(&wifi_info);
     lcd_clear();
-    wifi_info_t wifi_info;
-    get_wifi_info(&wifi_info);
-    char buf[17];
-    snprintf(buf, sizeof(buf), "%03u,%03u,%03u", wifi_info.link_quality, wifi_info.signal_level, wifi_info.noise_level);
-    syslog(LOG_NOTICE, buf);
+
+    if (wifi_info.link_up) {
+        snprintf(buf, sizeof(buf), "%u%% %d/%d dBm", wifi_info.link_quality, wifi_info.signal_level, wifi_info.noise_level);
+    }
+    else {
+        snprintf(buf, sizeof(buf), "Kein WLAN");
+    }
+    syslog(LOG_NOTICE, "%s", buf);
     lcd_puts(LCD_LINE_1, buf);
 
-    char *ip_addr = get_ip_address("wlan0");
-    syslog(LOG_NOTICE, ip_addr);
-    snprintf(buf, sizeof(buf), "%-16s", ip_addr);
-    syslog(LOG_NOTICE, buf);
+    snprintf(buf, sizeof(buf), "%-16s", wifi_info.ip_address);
+    syslog(LOG_NOTICE, "%s", buf);
     lcd_puts(LCD_LINE_2, buf);
-    free(ip_addr);
+    lcd_flush();
 }
 
 
-static void on_card_detected(int card_id) {
+/**
+ * Play the card's directory or queue it up behind what is playing. The card
+ * that is playing already is left alone instead of starting over.
+ */
+static void play_card(int card_id, bool enqueue) {
+
+    if (!enqueue && card_id == playing_card_id && player_is_playing()) {
+        syslog(LOG_NOTICE, "Card #%d is already playing\n", card_id);
+        metrics_inc(METRIC_RETRIGGERS_SUPPRESSED);
+        return;
+    }
 
     Card *card = card_read(card_id);
+    latency_tap_mark(LATENCY_DB_LOOKUP);
     if (card != NULL) {
-        syslog(LOG_NOTICE, "Card #%u has been detected: %s!\n", card_id, card->name);
+        syslog(LOG_NOTICE, "Card #%d has been detected: %s!\n", card_id, card->name);
         if (card->uri[strlen(card->uri) - 1] == '/') {
             card->uri[strlen(card->uri)] = '\0';
         }
 
-        syslog(LOG_NOTICE, "Calling player_play_uri(%s)\n", card->uri);
-        player_play_uri(card->uri);
+        if (enqueue) {
+            player_enqueue_uri(card->uri);
+        }
+        else {
+            syslog(LOG_NOTICE, "Calling player_play_uri(%s)\n", card->uri);
+            player_play_uri(card->uri);
+            playing_card_id = card_id;
+            latency_tap_mark(LATENCY_MPD_COMMAND);
+            // The song check tells when mpd has started, see check_tap_playing()
+            latency_tap_defer();
+        }
         lcd_set_backlight(true);
         update_lcd();
     }
     else {
-        syslog(LOG_ERR, "No card found with id #%u\n", card_id);
+        syslog(LOG_ERR, "No card found with id #%d\n", card_id);
     }
 }
 
 
 
+static void on_card_arrived(int card_id) {
+    // Cards put on top of ones already lying on the reader queue up
+    // behind them, in the order they have been tapped
+    play_card(card_id, card_reader_cards_present(card_readers[READER_PLAY]) > 1);
+}
+
+
+
+static void on_queue_card_arrived(int card_id) {
+    play_card(card_id, true);
+}
+
+
+
+static void on_card_removed(int card_id) {
+    if (PAUSE_ON_CARD_REMOVAL) {
+        syslog(LOG_NOTICE, "Card #%d has been removed, pausing\n", card_id);
+        player_pause();
+        update_lcd();
+    }
+}
+
+
+
+/*
+ * A card taken off and put back goes on where it has been paused, and is
+ * left alone if it is still playing. Any other card, e.g. one played
+ * before the one playing now, is played again.
+ */
+static bool on_card_returned(int card_id) {
+    int state;
+
+    if (card_id != playing_card_id) {
+        return false;
+    }
+    state = player_get_state();
+    if (state == MPD_STATE_PAUSE) {
+        syslog(LOG_NOTICE, "Card #%d is back, resuming\n", card_id);
+        player_toggle();
+        update_lcd();
+    }
+    return state == MPD_STATE_PLAY || state == MPD_STATE_PAUSE;
+}
+
+
+
+static void on_reader_health_changed(bool healthy) {
+    syslog(healthy ? LOG_NOTICE : LOG_ERR, "Card reader is %s\n", healthy ? "back" : "down");
+    update_lcd();
+}
+
+
+
 
 
 void clean_up() {
     syslog(LOG_INFO, "Cleaning up before exit");
     lcd_clear();
     lcd_puts(LCD_LINE_1, "***  BYE!  ***");
+    lcd_flush();
     lcd_set_backlight(false);
+    lcd_deinit();
     player_pause();
     gpioTerminate();
-    free(browser);
+    browser_save(browser);
+    browser_free(browser);
+    player_close();
+    network_info_stop();
+    metrics_dump();
+    latency_dump();
 }
 
 
@@ -397,6 +767,21 @@ void on_sigterm(int signum) {
 }
 
 
+// Called on signal SIGUSR1, the main loop writes the metrics to syslog
+void on_sigusr1(int signum) {
+    dump_metrics = true;
+}
+
+
+// Called on signal SIGUSR2, calibrates the card reader with the card lying on it
+void on_sigusr2(int signum) {
+    int i;
+    for (i = 0; i < n_card_readers; i++) {
+        card_reader_request_calibration(card_readers[i]);
+    }
+}
+
+
 int main() {
 
     // Setup pigpio lib
@@ -415,6 +800,12 @@ int main() {
     sigaction(SIGHUP, &action, NULL);
     sigaction(SIGINT, &action, NULL);
 
+    action.sa_handler = on_sigusr1;
+    sigaction(SIGUSR1, &action, NULL);
+
+    action.sa_handler = on_sigusr2;
+    sigaction(SIGUSR2, &action, NULL);
+
 
     // Register clean-up function
     /* atexit(clean_up); */
@@ -432,15 +823,55 @@ int main() {
 	// Handled in mpd.conf with `restore_paused "yes"`
     // player_pause();
 
+    // Follow the network in the background, for the LCD to show
+    network_info_start(NETWORK_INTERFACE);
+
     // Init LCD display
-    lcd_init();
+    lcd_init(lcd_i2c_new(I2C_BUS, I2C_ADDRESS));
     /* update_lcd(); */
     lcd_clear();
     update_lcd();
     syslog(LOG_INFO, "*** KIDDYBLASTER STARTING UP ***");
 
-    // Init MFRC522 card reader
-    card_reader_init();
+    // Before anything that can browse runs: the buttons, the readers and
+    // the timers. Without a saved index, the file system is scanned here.
+#ifdef BROWSER_MUSIC_DIR
+    browser = browser_new(BROWSER_MUSIC_DIR);
+#else
+    browser = browser_new_mpd();
+#endif
+
+    // Init the MFRC522 card readers, the second one is optional
+    static CardReaderConfig card_reader_config = {
+        .on_card_arrived = on_card_arrived,
+        .on_card_still_present = NULL,
+        .on_card_removed = on_card_removed,
+        .removal_debounce = CARD_REMOVAL_DEBOUNCE,
+        .on_health_changed = on_reader_health_changed,
+        .on_card_returned = on_card_returned,
+        .cooldown = CARD_READER_COOLDOWN
+    };
+    static CardReaderConfig queue_reader_config = {
+        .on_card_arrived = on_queue_card_arrived,
+        .on_card_still_present = NULL,
+        .on_card_removed = NULL,
+        .removal_debounce = CARD_REMOVAL_DEBOUNCE,
+        .on_health_changed = on_reader_health_changed,
+        .on_card_returned = NULL,
+        .cooldown = CARD_READER_COOLDOWN
+    };
+    CardReader *queue_reader = card_reader_new("queue", CARD_READER_2_SPI_DEVICE, CARD_READER_2_RESET_GPIO, &queue_reader_config);
+    card_readers[READER_PLAY] = card_reader_new("play", CARD_READER_SPI_DEVICE, CARD_READER_RESET_GPIO, &card_reader_config);
+    if (queue_reader != NULL && card_reader_is_healthy(queue_reader)) {
+        card_readers[READER_QUEUE] = queue_reader;
+        n_card_readers = 2;
+    }
+    else {
+        syslog(LOG_NOTICE, "No second card reader on %s\n", CARD_READER_2_SPI_DEVICE);
+        card_reader_free(queue_reader);
+        n_card_readers = 1;
+    }
+    card_reader_schedule(card_readers, n_card_readers);
 
     // Setup buttons
     gpioSetMode(BUTTON_1_PIN, PI_INPUT);
@@ -458,6 +889,12 @@ int main() {
     gpioGlitchFilter(BUTTON_2_PIN, 100000);
     gpioGlitchFilter(BUTTON_3_PIN, 100000);
 
+    // The buttons are handled and the display drawn on a thread of its own
+    if (pthread_create(&ui_thread, NULL, ui_loop, NULL) != 0) {
+        syslog(LOG_ERR, "Failed to start the UI thread\n");
+        exit(-1);
+    }
+
     // Register callbacks on button press
     gpioSetAlertFunc(BUTTON_1_PIN, &on_button_pressed);
     gpioSetAlertFunc(BUTTON_2_PIN, &on_button_pressed);
@@ -474,11 +911,12 @@ int main() {
     reset_timer();
 
 
-    // Start an own thread for reading RFID cards
-    pthread_t *card_reader;
-    card_reader = gpioStartThread(read_cards, &on_card_detected);
-
-    browser = browser_new("/home/pi/Music");
+    // Start an own thread for every RFID card reader
+    pthread_t *card_reader_threads[N_READERS];
+    int i;
+    for (i = 0; i < n_card_readers; i++) {
+        card_reader_threads[i] = gpioStartThread(read_cards, card_readers[i]);
+    }
 
     // Start an endless loop
     while (running) {
@@ -486,6 +924,11 @@ int main() {
         /* gpioDelay(5000000); */
         gpioSleep(PI_TIME_RELATIVE, 5, 0);
 
+        if (dump_metrics) {
+            dump_metrics = false;
+            metrics_dump();
+            latency_dump();
+        }
 
         if (is_sleeping) {
             continue;
@@ -497,7 +940,6 @@ int main() {
             continue;
         }
 
-        puts("about to call update_lcd()");
         update_lcd();
 
         seconds_left = SLEEP_TIMER - (now - timer);
@@ -510,7 +952,14 @@ int main() {
 
     // Clean-up and terminate
     syslog(LOG_NOTICE, "Terminating\n");
-    gpioStopThread(card_reader);
+    for (i = 0; i < n_card_readers; i++) {
+        gpioStopThread(card_reader_threads[i]);
+    }
+    pthread_mutex_lock(&ui_lock);
+    ui.stop = true;
+    pthread_cond_signal(&ui_wakeup);
+    pthread_mutex_unlock(&ui_lock);
+    pthread_join(ui_thread, NULL);
     clean_up();
     closelog();
     return 0;
@@ -0,0 +1,76 @@
+/**
+ * Runtime metrics
+ *
+ * Plain counters indexed by Metric, updated atomically so the card reader
+ * thread, pigpio callbacks and the main loop can all report into them.
+ *
+ * @package kiddyblaster
+ */
+#include <stdbool.h>
+#include <syslog.h>
+
+#include "metrics.h"
+
+static uint64_t values[METRIC_COUNT];
+
+static const char *names[METRIC_COUNT] = {
+    [METRIC_READER_POLLS]               = "reader_polls",
+    [METRIC_READER_READ_ATTEMPTS]       = "reader_read_attempts",
+    [METRIC_READER_READ_FAILURES]       = "reader_read_failures",
+    [METRIC_READER_CARDS_READ]          = "reader_cards_read",
+    [METRIC_READER_TAPS_TO_PLAY_TOTAL]  = "reader_taps_to_play_total",
+    [METRIC_READER_HEALTH_CHECKS]       = "reader_health_checks",
+    [METRIC_READER_HEALTH_FAILURES]     = "reader_health_failures",
+    [METRIC_READER_SELF_TEST_FAILURES]  = "reader_self_test_failures",
+    [METRIC_READER_RECOVERY_ATTEMPTS]   = "reader_recovery_attempts",
+    [METRIC_READER_RECOVERIES]          = "reader_recoveries",
+    [METRIC_READER_RECOVERY_MS_TOTAL]   = "reader_recovery_ms_total",
+    [METRIC_READER_RECOVERY_MS_MAX]     = "reader_recovery_ms_max",
+    [METRIC_RETRIGGERS_SUPPRESSED]      = "retriggers_suppressed",
+    [METRIC_LCD_I2C_BYTES]              = "lcd_i2c_bytes",
+    [METRIC_LCD_CGRAM_UPLOADS]          = "lcd_cgram_uploads"
+};
+
+
+
+void metrics_inc(Metric metric) {
+    __atomic_add_fetch(&values[metric], 1, __ATOMIC_RELAXED);
+}
+
+
+
+void metrics_add(Metric metric, uint64_t value) {
+    __atomic_add_fetch(&values[metric], value, __ATOMIC_RELAXED);
+}
+
+
+
+/**
+ * Raise a metric to `value` if it is below
+ */
+void metrics_max(Metric metric, uint64_t value) {
+    uint64_t current = __atomic_load_n(&values[metric], __ATOMIC_RELAXED);
+    while (current < value) {
+        if (__atomic_compare_exchange_n(&values[metric], &current, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+}
+
+
+
+uint64_t metrics_get(Metric metric) {
+    return __atomic_load_n(&values[metric], __ATOMIC_RELAXED);
+}
+
+
+
+/**
+ * Write all metrics to syslog, one line each
+ */
+void metrics_dump() {
+    int i;
+    for (i = 0; i < METRIC_COUNT; i++) {
+        syslog(LOG_NOTICE, "metric %s=%llu\n", names[i], (unsigned long long)metrics_get(i));
+    }
+}
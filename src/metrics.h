@@ -0,0 +1,34 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <stdint.h>
+
+/*
+ * Counters shared by all threads, dumped to syslog on SIGUSR1 and at exit
+ */
+typedef enum {
+    METRIC_READER_POLLS,
+    METRIC_READER_READ_ATTEMPTS,        // Authenticating and reading a new card
+    METRIC_READER_READ_FAILURES,
+    METRIC_READER_CARDS_READ,
+    METRIC_READER_TAPS_TO_PLAY_TOTAL,   // Read attempts it took until cards could be played
+    METRIC_READER_HEALTH_CHECKS,
+    METRIC_READER_HEALTH_FAILURES,      // Checks that found the reader not responding
+    METRIC_READER_SELF_TEST_FAILURES,
+    METRIC_READER_RECOVERY_ATTEMPTS,    // Reset and re-init of the PCD
+    METRIC_READER_RECOVERIES,           // Outages that ended with a working reader
+    METRIC_READER_RECOVERY_MS_TOTAL,    // Time from detecting an outage to a working reader
+    METRIC_READER_RECOVERY_MS_MAX,
+    METRIC_RETRIGGERS_SUPPRESSED,       // Cards put back or tapped again that did not restart playback
+    METRIC_LCD_I2C_BYTES,               // Bytes on the I2C bus to the LCD
+    METRIC_LCD_CGRAM_UPLOADS,           // Custom characters written to the LCD
+    METRIC_COUNT
+} Metric;
+
+void metrics_inc(Metric metric);
+void metrics_add(Metric metric, uint64_t value);
+void metrics_max(Metric metric, uint64_t value);
+uint64_t metrics_get(Metric metric);
+void metrics_dump();
+
+#endif
@@ -5,12 +5,11 @@
  */
 
 #include "mfrc522.h"
-#include "bcm2835.h"
+#include "spi_bus.h"
 #include <linux/types.h>
 #include <stdio.h>
 #include <stdbool.h>
-
-#define RSTPIN RPI_V2_GPIO_P1_22
+#include <stdlib.h>
 
 // Firmware data for self-test
 // Reference values based on firmware version; taken from 16.1.1 in spec.
@@ -41,37 +40,78 @@ const byte MFRC522_firmware_referenceV2_0[] = {
 
 
 // Member variables
-Uid uid;								// Used by PICC_ReadCardSerial().
+static __thread MFRC522 *pcd;			// The reader the calling thread talks to, see mfrc522_use()
 
 /**
  * Constructor.
- * Prepares the output pins.
+ * Use the given SPI bus to talk to an MFRC522, see spi_bus.h for the backends.
+ * The reader takes ownership of the bus, it is released by mfrc522_free().
  */
-void mfrc522_init() {
-  
-  if (!bcm2835_init()) {
-    printf("Failed to initialize. This tool needs root access, use sudo.\n");
+MFRC522 *mfrc522_new(SpiBus *bus) {
+  MFRC522 *reader = calloc(1, sizeof(MFRC522));
+  reader->bus = bus;
+  return reader;
+} // End mfrc522_new()
+
+/**
+ * Destructor, releases the SPI bus.
+ */
+void mfrc522_free(MFRC522 *reader) {
+  if (reader == NULL) {
+    return;
+  }
+  if (pcd == reader) {
+    pcd = NULL;
+  }
+  spi_bus_free(reader->bus);
+  free(reader);
+} // End mfrc522_free()
+
+/**
+ * All following calls of the calling thread go to this reader. Every
+ * thread talks to one reader at a time, so several readers can be driven
+ * from their own threads at the same time.
+ */
+void mfrc522_use(MFRC522 *reader) {
+  pcd = reader;
+} // End mfrc522_use()
+
+/**
+ * Returns the reader the calling thread talks to, NULL if none.
+ */
+MFRC522 *mfrc522_current() {
+  return pcd;
+} // End mfrc522_current()
+
+/**
+ * Use the given SPI bus to talk to a single MFRC522: creates a reader for
+ * the calling thread, or hands the bus to the one it already uses.
+ * The driver takes ownership of the bus, it is released by mfrc522_close().
+ */
+void mfrc522_init(SpiBus *new_bus) {
+  if (pcd == NULL) {
+    pcd = mfrc522_new(new_bus);
+    return;
   }
-  bcm2835_gpio_fsel(RSTPIN, BCM2835_GPIO_FSEL_OUTP);
-  bcm2835_gpio_write(RSTPIN, LOW);
-  // Set SPI bus to work with MFRC522 chip.
-  mfrc522_set_spi_config();
+  if (pcd->bus != NULL && pcd->bus != new_bus) {
+    spi_bus_free(pcd->bus);
+  }
+  pcd->bus = new_bus;
 } // End constructor
 
 /**
- * Set SPI bus to work with MFRC522 chip.
- * Please call this function if you have changed the SPI config since the MFRC522 constructor was run.
+ * Returns the SPI bus the driver is talking to.
  */
-void mfrc522_set_spi_config() {
-  
-  bcm2835_spi_begin();
-  bcm2835_spi_setBitOrder(BCM2835_SPI_BIT_ORDER_MSBFIRST);      // The default
-  bcm2835_spi_setDataMode(BCM2835_SPI_MODE0);                   // The default
-  bcm2835_spi_setClockDivider(BCM2835_SPI_CLOCK_DIVIDER_64);    // ~ 4 MHz
-  bcm2835_spi_chipSelect(BCM2835_SPI_CS0);                      // The default
-  bcm2835_spi_setChipSelectPolarity(BCM2835_SPI_CS0, LOW);      // the default
-	
-} // End setSPIConfig()
+SpiBus *mfrc522_get_bus() {
+  return pcd != NULL ? pcd->bus : NULL;
+} // End mfrc522_get_bus()
+
+/**
+ * Releases the reader of the calling thread and its SPI bus.
+ */
+void mfrc522_close() {
+  mfrc522_free(pcd);
+} // End mfrc522_close()
 
 /////////////////////////////////////////////////////////////////////////////////////
 // Basic interface functions for communicating with the MFRC522
@@ -83,10 +123,10 @@ void mfrc522_set_spi_config() {
  */
 void mfrc522_pcd_write_register(byte reg, byte value) {
 
-  char data[2];
+  byte data[2];
   data[0] = reg & 0x7E;
   data[1] = value;
-  bcm2835_spi_transfern(data, 2);
+  spi_bus_frame(pcd->bus, data, NULL, 2);
   
 } // End PCD_WriteRegister()
 
@@ -95,23 +135,82 @@ void mfrc522_pcd_write_register(byte reg, byte value) {
  * The interface is described in the datasheet section 8.1.2.
  */
 void mfrc522_pcd_write_register_multi(byte reg, byte count, byte *values) {
-    byte index;
-  for (index = 0; index < count; index++) {
-  	mfrc522_pcd_write_register(reg, values[index]);
-	}
+  // All bytes following the address byte within one frame go to the same register
+  byte data[1 + 255];
+  data[0] = reg & 0x7E;
+  memcpy(&data[1], values, count);
+  spi_bus_frame(pcd->bus, data, NULL, count + 1);
 
 } // End PCD_WriteRegister()
 
+/*
+ * Register accesses collected to go over the bus with one transfer, so a
+ * whole register sequence costs a single ioctl on spidev.
+ */
+#define MFRC522_BATCH_FRAMES 16
+
+typedef struct {
+  SpiTransfer xfers[MFRC522_BATCH_FRAMES];
+  byte frames[MFRC522_BATCH_FRAMES][2];
+  byte data[1 + 255];						// For one multi-byte FIFO write
+  byte fifo[1 + 64];						// For one multi-byte FIFO read
+  unsigned int count;
+} RegisterBatch;
+
+static void batch_write(RegisterBatch *batch, byte reg, byte value) {
+  byte *frame = batch->frames[batch->count];
+  frame[0] = reg & 0x7E;
+  frame[1] = value;
+  batch->xfers[batch->count++] = (SpiTransfer){ frame, NULL, 2 };
+}
+
+static void batch_write_multi(RegisterBatch *batch, byte reg, byte count, byte *values) {
+  if (count == 0) {
+    return;
+  }
+  batch->data[0] = reg & 0x7E;
+  memcpy(&batch->data[1], values, count);
+  batch->xfers[batch->count++] = (SpiTransfer){ batch->data, NULL, count + 1 };
+}
+
+/*
+ * Returns where the value will be found after batch_run()
+ */
+static byte *batch_read(RegisterBatch *batch, byte reg) {
+  byte *frame = batch->frames[batch->count];
+  frame[0] = 0x80 | (reg & 0x7E);
+  frame[1] = 0;
+  batch->xfers[batch->count++] = (SpiTransfer){ frame, frame, 2 };
+  return &frame[1];
+}
+
+/*
+ * Reads `count` bytes from the FIFO, returns where they will be found after batch_run()
+ */
+static byte *batch_read_fifo(RegisterBatch *batch, byte count) {
+  byte *frame = batch->fifo;
+  memset(frame, 0x80 | (FIFODataReg & 0x7E), count);
+  frame[count] = 0;
+  batch->xfers[batch->count++] = (SpiTransfer){ frame, frame, count + 1 };
+  return &frame[1];
+}
+
+static void batch_run(RegisterBatch *batch) {
+  spi_bus_transfer(pcd->bus, batch->xfers, batch->count);
+  batch->count = 0;
+}
+
 /**
  * Reads a byte from the specified register in the MFRC522 chip.
  * The interface is described in the datasheet section 8.1.2.
  */
 byte mfrc522_pcd_read_register(byte reg) {
   
-  char data[2];
+  byte data[2];
   data[0] = 0x80 | ((reg) & 0x7E);
-  bcm2835_spi_transfern(data,2);
-  return (byte)data[1];
+  data[1] = 0;
+  spi_bus_frame(pcd->bus, data, data, 2);
+  return data[1];
 } // End PCD_ReadRegister()
 
 /**
@@ -126,29 +225,25 @@ void mfrc522_pcd_read_register_multi(byte reg,		///< The register to read from.
   if (count == 0) {
     return;
   }
-  //Serial.print(F("Reading ")); 	Serial.print(count); Serial.println(F(" bytes from register."));
   byte address = 0x80 | (reg & 0x7E);		// MSB == 1 is for reading. LSB is not used in address. Datasheet section 8.1.2.3.
-  byte index = 0;							// Index in values array.
-  count--;								// One read is performed outside of the loop
-  bcm2835_spi_transfer(address);
-  while (index < count) {
-    if (index == 0 && rxAlign) {		// Only update bit positions rxAlign..7 in values[0]
-      // Create bit mask for bit positions rxAlign..7
-      byte i, mask = 0;
-      for (i = rxAlign; i <= 7; i++) {
-	mask |= (1 << i);
-      }
-      // Read value and tell that we want to read the same address again.
-      byte value = bcm2835_spi_transfer(address);
-      // Apply mask to both current value of values[0] and the new data in value.
-      values[0] = (values[index] & ~mask) | (value & mask);
+  byte tx[1 + 255], rx[1 + 255];
+  // One frame: the address is repeated for every byte to read, the final 0 stops reading.
+  memset(tx, address, count);
+  tx[count] = 0;
+  spi_bus_frame(pcd->bus, tx, rx, count + 1);
+  if (rxAlign) {		// Only update bit positions rxAlign..7 in values[0]
+    // Create bit mask for bit positions rxAlign..7
+    byte i, mask = 0;
+    for (i = rxAlign; i <= 7; i++) {
+      mask |= (1 << i);
     }
-    else { // Normal case
-      values[index] = bcm2835_spi_transfer(address);
-    }
-    index++;
+    // Apply mask to both current value of values[0] and the new data.
+    values[0] = (values[0] & ~mask) | (rx[1] & mask);
+    memcpy(&values[1], &rx[2], count - 1);
+  }
+  else {
+    memcpy(values, &rx[1], count);
   }
-  values[index] = bcm2835_spi_transfer(0);			// Read the final byte. Send 0 to stop reading.
 } // End PCD_ReadRegister()
 
 /**
@@ -183,11 +278,13 @@ byte mfrc522_pcd_calculate_crc(	byte *data,		///< In: Pointer to the data to tra
 				byte length,	///< In: The number of bytes to transfer.
 				byte *result	///< Out: Pointer to result buffer. Result is written to result[0..1], low byte first.
 				) {
-  mfrc522_pcd_write_register(CommandReg, PCD_Idle);		// Stop any active command.
-  mfrc522_pcd_write_register(DivIrqReg, 0x04);				// Clear the CRCIRq interrupt request bit
-  mfrc522_pcd_set_register_bit_mask(FIFOLevelReg, 0x80);		// FlushBuffer = 1, FIFO initialization
-  mfrc522_pcd_write_register_multi(FIFODataReg, length, data);	// Write data to the FIFO
-  mfrc522_pcd_write_register(CommandReg, PCD_CalcCRC);		// Start the calculation
+  RegisterBatch batch = { .count = 0 };
+  batch_write(&batch, CommandReg, PCD_Idle);		// Stop any active command.
+  batch_write(&batch, DivIrqReg, 0x04);				// Clear the CRCIRq interrupt request bit
+  batch_write(&batch, FIFOLevelReg, 0x80);			// FlushBuffer = 1, FIFO initialization (the other bits are read only)
+  batch_write_multi(&batch, FIFODataReg, length, data);	// Write data to the FIFO
+  batch_write(&batch, CommandReg, PCD_CalcCRC);		// Start the calculation
+  batch_run(&batch);
 	
   // Wait for the CRC calculation to complete. Each iteration of the while-loop takes 17.73�s.
   word i = 5000;
@@ -201,11 +298,14 @@ byte mfrc522_pcd_calculate_crc(	byte *data,		///< In: Pointer to the data to tra
       return STATUS_TIMEOUT;
     }
   }
-  mfrc522_pcd_write_register(CommandReg, PCD_Idle);		// Stop calculating CRC for new content in the FIFO.
+  batch_write(&batch, CommandReg, PCD_Idle);		// Stop calculating CRC for new content in the FIFO.
 	
   // Transfer the result from the registers to the result buffer
-  result[0] = mfrc522_pcd_read_register(CRCResultRegL);
-  result[1] = mfrc522_pcd_read_register(CRCResultRegH);
+  byte *low = batch_read(&batch, CRCResultRegL);
+  byte *high = batch_read(&batch, CRCResultRegH);
+  batch_run(&batch);
+  result[0] = *low;
+  result[1] = *high;
   return STATUS_OK;
 } // End PCD_CalculateCRC()
 
@@ -218,10 +318,10 @@ byte mfrc522_pcd_calculate_crc(	byte *data,		///< In: Pointer to the data to tra
  * Initializes the MFRC522 chip.
  */
 void mfrc522_pcd_init() {
-  if (bcm2835_gpio_lev(RSTPIN) == LOW) {	//The MFRC522 chip is in power down mode.
-    bcm2835_gpio_write(RSTPIN, HIGH);		// Exit power down mode. This triggers a hard reset.
+  if (!spi_bus_get_reset(pcd->bus)) {	//The MFRC522 chip is in power down mode.
+    spi_bus_set_reset(pcd->bus, 1);		// Exit power down mode. This triggers a hard reset.
     // Section 8.8.2 in the datasheet says the oscillator start-up time is the start up time of the crystal + 37,74�s. Let us be generous: 50ms.
-    delay(50);
+    spi_bus_delay(pcd->bus, 50);
   }
   else { // Perform a soft reset
     mfrc522_pcd_reset();
@@ -230,13 +330,15 @@ void mfrc522_pcd_init() {
   // When communicating with a PICC we need a timeout if something goes wrong.
   // f_timer = 13.56 MHz / (2*TPreScaler+1) where TPreScaler = [TPrescaler_Hi:TPrescaler_Lo].
   // TPrescaler_Hi are the four low bits in TModeReg. TPrescaler_Lo is TPrescalerReg.
-  mfrc522_pcd_write_register(TModeReg, 0x80);			// TAuto=1; timer starts automatically at the end of the transmission in all communication modes at all speeds
-  mfrc522_pcd_write_register(TPrescalerReg, 0xA9);		// TPreScaler = TModeReg[3..0]:TPrescalerReg, ie 0x0A9 = 169 => f_timer=40kHz, ie a timer period of 25�s.
-  mfrc522_pcd_write_register(TReloadRegH, 0x03);		// Reload timer with 0x3E8 = 1000, ie 25ms before timeout.
-  mfrc522_pcd_write_register(TReloadRegL, 0xE8);
-	
-  mfrc522_pcd_write_register(TxASKReg, 0x40);		// Default 0x00. Force a 100 % ASK modulation independent of the ModGsPReg register setting
-  mfrc522_pcd_write_register(ModeReg, 0x3D);		// Default 0x3F. Set the preset value for the CRC coprocessor for the CalcCRC command to 0x6363 (ISO 14443-3 part 6.2.4)
+  RegisterBatch batch = { .count = 0 };
+  batch_write(&batch, TModeReg, 0x80);			// TAuto=1; timer starts automatically at the end of the transmission in all communication modes at all speeds
+  batch_write(&batch, TPrescalerReg, 0xA9);		// TPreScaler = TModeReg[3..0]:TPrescalerReg, ie 0x0A9 = 169 => f_timer=40kHz, ie a timer period of 25�s.
+  batch_write(&batch, TReloadRegH, 0x03);		// Reload timer with 0x3E8 = 1000, ie 25ms before timeout.
+  batch_write(&batch, TReloadRegL, 0xE8);
+	
+  batch_write(&batch, TxASKReg, 0x40);		// Default 0x00. Force a 100 % ASK modulation independent of the ModGsPReg register setting
+  batch_write(&batch, ModeReg, 0x3D);		// Default 0x3F. Set the preset value for the CRC coprocessor for the CalcCRC command to 0x6363 (ISO 14443-3 part 6.2.4)
+  batch_run(&batch);
   mfrc522_pcd_antenna_on();						// Enable the antenna driver pins TX1 and TX2 (they were disabled by the reset)
 } // End PCD_Init()
 
@@ -248,10 +350,13 @@ void mfrc522_pcd_reset() {
   // The datasheet does not mention how long the SoftRest command takes to complete.
   // But the MFRC522 might have been in soft power-down mode (triggered by bit 4 of CommandReg) 
   // Section 8.8.2 in the datasheet says the oscillator start-up time is the start up time of the crystal + 37,74�s. Let us be generous: 50ms.
-  delay(50);
+  spi_bus_delay(pcd->bus, 50);
   // Wait for the PowerDown bit in CommandReg to be cleared
-  while (mfrc522_pcd_read_register(CommandReg) & (1<<4)) {
+  // Give up after a while, a dead SPI link reads all bits set.
+  byte retries = 10;
+  while ((mfrc522_pcd_read_register(CommandReg) & (1<<4)) && --retries > 0) {
     // PCD still restarting - unlikely after waiting 50ms, but better safe than sorry.
+    spi_bus_delay(pcd->bus, 10);
   }
 } // End PCD_Reset()
 
@@ -389,6 +494,31 @@ byte mfrc522_pcd_transceive_data(	byte *sendData,		///< Pointer to the data to t
   return mfrc522_pcd_communicate_with_picc(PCD_Transceive, waitIRq, sendData, sendLen, backData, backLen, validBits, rxAlign, checkCRC);
 } // End PCD_TransceiveData()
 
+/**
+ * Waits for a command started with PCD_CommunicateWithPICC() to complete.
+ *
+ * @return STATUS_OK on success, STATUS_TIMEOUT if the PICC did not answer.
+ */
+static byte mfrc522_pcd_wait_for_irq(byte waitIRq	///< The bits in the ComIrqReg register that signal successful completion of the command.
+				     ) {
+  // In PCD_Init() we set the TAuto flag in TModeReg. This means the timer automatically starts when the PCD stops transmitting.
+  // Each iteration of the do-while-loop takes 17.86s.
+  unsigned int i = 2000;
+  byte n;
+  while (1) {
+    n = mfrc522_pcd_read_register(ComIrqReg);	// ComIrqReg[7..0] bits are: Set1 TxIRq RxIRq IdleIRq HiAlertIRq LoAlertIRq ErrIRq TimerIRq
+    if (n & waitIRq) {					// One of the interrupts that signal success has been set.
+      return STATUS_OK;
+    }
+    if (n & 0x01) {						// Timer interrupt - nothing received in 25ms
+      return STATUS_TIMEOUT;
+    }
+    if (--i == 0) {						// The emergency break. If all other condions fail we will eventually terminate on this one after 35.7ms. Communication with the MFRC522 might be down.
+      return STATUS_TIMEOUT;
+    }
+  }
+} // End PCD_WaitForIRq()
+
 /**
  * Transfers data to the MFRC522 FIFO, executes a command, waits for completion and transfers data back from the FIFO.
  * CRC validation can only be done if backData and backLen are specified.
@@ -406,54 +536,51 @@ byte mfrc522_pcd_communicate_with_picc(	byte command,		///< The command to execu
 					bool checkCRC		///< In: true => The last two bytes of the response is assumed to be a CRC_A that must be validated.
 					) {
   byte n, _validBits;
-  unsigned int i;
 	
   // Prepare values for BitFramingReg
   byte txLastBits = validBits ? *validBits : 0;
   byte bitFraming = (rxAlign << 4) + txLastBits;		// RxAlign = BitFramingReg[6..4]. TxLastBits = BitFramingReg[2..0]
 	
-  mfrc522_pcd_write_register(CommandReg, PCD_Idle);			// Stop any active command.
-  mfrc522_pcd_write_register(ComIrqReg, 0x7F);					// Clear all seven interrupt request bits
-  mfrc522_pcd_set_register_bit_mask(FIFOLevelReg, 0x80);			// FlushBuffer = 1, FIFO initialization
-  mfrc522_pcd_write_register_multi(FIFODataReg, sendLen, sendData);	// Write sendData to the FIFO
-  mfrc522_pcd_write_register(BitFramingReg, bitFraming);		// Bit adjustments
-  mfrc522_pcd_write_register(CommandReg, command);				// Execute the command
+  // The whole setup goes over the bus with one transfer
+  RegisterBatch batch = { .count = 0 };
+  batch_write(&batch, CommandReg, PCD_Idle);			// Stop any active command.
+  batch_write(&batch, ComIrqReg, 0x7F);					// Clear all seven interrupt request bits
+  batch_write(&batch, FIFOLevelReg, 0x80);				// FlushBuffer = 1, FIFO initialization (the other bits are read only)
+  batch_write_multi(&batch, FIFODataReg, sendLen, sendData);	// Write sendData to the FIFO
+  batch_write(&batch, BitFramingReg, bitFraming);		// Bit adjustments
+  batch_write(&batch, CommandReg, command);				// Execute the command
   if (command == PCD_Transceive) {
-    mfrc522_pcd_set_register_bit_mask(BitFramingReg, 0x80);	// StartSend=1, transmission of data starts
+    batch_write(&batch, BitFramingReg, bitFraming | 0x80);	// StartSend=1, transmission of data starts
   }
+  batch_run(&batch);
 	
   // Wait for the command to complete.
-  // In PCD_Init() we set the TAuto flag in TModeReg. This means the timer automatically starts when the PCD stops transmitting.
-  // Each iteration of the do-while-loop takes 17.86�s.
-  i = 2000;
-  while (1) {
-    n = mfrc522_pcd_read_register(ComIrqReg);	// ComIrqReg[7..0] bits are: Set1 TxIRq RxIRq IdleIRq HiAlertIRq LoAlertIRq ErrIRq TimerIRq
-    if (n & waitIRq) {					// One of the interrupts that signal success has been set.
-      break;
-    }
-    if (n & 0x01) {						// Timer interrupt - nothing received in 25ms
-      return STATUS_TIMEOUT;
-    }
-    if (--i == 0) {						// The emergency break. If all other condions fail we will eventually terminate on this one after 35.7ms. Communication with the MFRC522 might be down.
-      return STATUS_TIMEOUT;
-    }
+  n = mfrc522_pcd_wait_for_irq(waitIRq);
+  if (n != STATUS_OK) {
+    return n;
   }
 	
+  // Error flags, FIFO level and valid bits are read with one transfer
+  byte *errorReg = batch_read(&batch, ErrorReg);
+  byte *fifoLevel = batch_read(&batch, FIFOLevelReg);
+  byte *control = batch_read(&batch, ControlReg);
+  batch_run(&batch);
+
   // Stop now if any errors except collisions were detected.
-  byte errorRegValue = mfrc522_pcd_read_register(ErrorReg); // ErrorReg[7..0] bits are: WrErr TempErr reserved BufferOvfl CollErr CRCErr ParityErr ProtocolErr
+  byte errorRegValue = *errorReg; // ErrorReg[7..0] bits are: WrErr TempErr reserved BufferOvfl CollErr CRCErr ParityErr ProtocolErr
   if (errorRegValue & 0x13) {	 // BufferOvfl ParityErr ProtocolErr
     return STATUS_ERROR;
   }	
 
   // If the caller wants data back, get it from the MFRC522.
   if (backData && backLen) {
-    n = mfrc522_pcd_read_register(FIFOLevelReg);			// Number of bytes in the FIFO
+    n = *fifoLevel;										// Number of bytes in the FIFO
     if (n > *backLen) {
       return STATUS_NO_ROOM;
     }
     *backLen = n;											// Number of bytes returned
     mfrc522_pcd_read_register_multi(FIFODataReg, n, backData, rxAlign);	// Get received data from FIFO
-    _validBits = mfrc522_pcd_read_register(ControlReg) & 0x07;		// RxLastBits[2:0] indicates the number of valid bits in the last received byte. If this value is 000b, the whole byte is valid.
+    _validBits = *control & 0x07;		// RxLastBits[2:0] indicates the number of valid bits in the last received byte. If this value is 000b, the whole byte is valid.
     if (validBits) {
       *validBits = _validBits;
     }
@@ -711,9 +838,9 @@ byte mfrc522_picc_select(	Uid *uid,			///< Pointer to Uid struct. Normally outpu
 	}
 	// Choose the PICC with the bit set.
 	currentLevelKnownBits = collisionPos;
-	count			= (currentLevelKnownBits - 1) % 8; // The bit to modify
+	count			= currentLevelKnownBits % 8; // Known bits in the last, incomplete byte
 	index			= 1 + (currentLevelKnownBits / 8) + (count ? 1 : 0); // First byte is index 0.
-	buffer[index]	|= (1 << count);
+	buffer[index]	|= (1 << ((currentLevelKnownBits - 1) % 8)); // The bit to modify
       }
       else if (result != STATUS_OK) {
 	return result;
@@ -889,6 +1016,239 @@ byte mfrc522_mifare_read(	byte blockAddr, 	///< MIFARE Classic: The block (0-0xf
   return mfrc522_pcd_transceive_data(buffer, 4, buffer, bufferSize, NULL, 0, false);
 } // End MIFARE_Read()
 
+/*
+ * CRC_A (ISO/IEC 14443-3, init 0x6363) calculated on the host, which saves
+ * the round trips to the CRC coprocessor when building command frames.
+ */
+static void mfrc522_crc_a(const byte *data, byte length, byte *result) {
+  word crc = 0x6363;
+  byte i;
+  for (i = 0; i < length; i++) {
+    byte b = data[i] ^ (crc & 0xff);
+    b ^= b << 4;
+    crc = (crc >> 8) ^ ((word)b << 8) ^ ((word)b << 3) ^ (b >> 4);
+  }
+  result[0] = crc & 0xff;
+  result[1] = crc >> 8;
+} // End CRC_A()
+
+/*
+ * One command of a pipelined sequence, see MIFARE_RunPipeline()
+ */
+typedef struct {
+  byte command;			// PCD_MFAuthent or PCD_Transceive
+  byte data[12];			// Authentication: command, block, key and UID. Read: command, block and CRC_A
+  byte length;
+  byte *out;				// Read: where the 16 data bytes go
+} MIFARE_Step;
+
+static void mfrc522_batch_step(RegisterBatch *batch, MIFARE_Step *step) {
+  batch_write(batch, CommandReg, PCD_Idle);				// Stop any active command.
+  batch_write(batch, ComIrqReg, 0x7F);					// Clear all seven interrupt request bits
+  batch_write(batch, FIFOLevelReg, 0x80);				// FlushBuffer = 1, FIFO initialization
+  batch_write_multi(batch, FIFODataReg, step->length, step->data);
+  batch_write(batch, BitFramingReg, 0);
+  batch_write(batch, CommandReg, step->command);
+  if (step->command == PCD_Transceive) {
+    batch_write(batch, BitFramingReg, 0x80);			// StartSend=1, transmission of data starts
+  }
+}
+
+/*
+ * Runs authentications and reads back to back. The answer to one command is
+ * fetched from the FIFO with the same transfer that starts the next one, so
+ * apart from polling for completion every command costs one transfer. On a
+ * failure the command started already is simply abandoned.
+ *
+ * @return STATUS_OK on success, STATUS_??? otherwise.
+ */
+static byte mfrc522_mifare_run_pipeline(MIFARE_Step *steps, unsigned int count) {
+  RegisterBatch batch = { .count = 0 };
+  unsigned int i;
+  byte result;
+
+  if (count == 0) {
+    return STATUS_OK;
+  }
+  mfrc522_batch_step(&batch, &steps[0]);
+  batch_run(&batch);
+
+  for (i = 0; i < count; i++) {
+    MIFARE_Step *step = &steps[i];
+    bool read = (step->command == PCD_Transceive);
+
+    result = mfrc522_pcd_wait_for_irq(read ? 0x30 : 0x10);	// RxIRq and IdleIRq for reads, IdleIRq for authentication
+    if (result != STATUS_OK) {
+      return result;
+    }
+
+    byte *errorReg = batch_read(&batch, ErrorReg);
+    byte *fifoLevel = NULL, *control = NULL, *answer = NULL;
+    if (read) {
+      fifoLevel = batch_read(&batch, FIFOLevelReg);
+      control = batch_read(&batch, ControlReg);
+      answer = batch_read_fifo(&batch, 18);				// 16 bytes data and CRC_A, unless it is a NAK
+    }
+    if (i + 1 < count) {
+      mfrc522_batch_step(&batch, &steps[i + 1]);
+    }
+    batch_run(&batch);
+
+    if (*errorReg & 0x13) {								// BufferOvfl ParityErr ProtocolErr
+      return STATUS_ERROR;
+    }
+    if (!read) {
+      continue;
+    }
+    if (*errorReg & 0x08) {								// CollErr
+      return STATUS_COLLISION;
+    }
+    if (*fifoLevel == 1 && (*control & 0x07) == 4) {
+      return STATUS_MIFARE_NACK;
+    }
+    byte crc[2];
+    mfrc522_crc_a(answer, 16, crc);
+    if (*fifoLevel != 18 || (*control & 0x07) != 0 || answer[16] != crc[0] || answer[17] != crc[1]) {
+      return STATUS_CRC_WRONG;
+    }
+    memcpy(step->out, answer, 16);
+  }
+  return STATUS_OK;
+} // End MIFARE_RunPipeline()
+
+/*
+ * First block and number of blocks of a MIFARE Classic sector
+ */
+static bool mfrc522_mifare_sector_blocks(byte sector, byte *firstBlock, byte *blocks) {
+  if (sector < 32) {			// Sectors 0..31 have 4 blocks each
+    *blocks = 4;
+    *firstBlock = sector * 4;
+  }
+  else if (sector < 40) {		// Sectors 32..39 have 16 blocks each
+    *blocks = 16;
+    *firstBlock = 128 + (sector - 32) * 16;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Reads consecutive blocks from the active PICC, 16 bytes each and without CRC_A.
+ * 
+ * For MIFARE Classic the sector(s) containing the blocks must be authenticated before calling this function.
+ * The reads are pipelined, see MIFARE_ReadSectors(). Checks the CRC_A of every block.
+ * 
+ * @return STATUS_OK on success, STATUS_??? otherwise.
+ */
+byte mfrc522_mifare_read_blocks(	byte firstBlock,	///< The first block to read
+					byte count,			///< The number of blocks to read
+					byte *buffer,		///< The buffer to store the data in
+					unsigned int *bufferSize	///< In: Buffer size, at least 16 * count bytes. Out: The number of bytes returned.
+					) {
+  MIFARE_Step steps[16];
+  byte i;
+
+  if (buffer == NULL || count > 16 || *bufferSize < count * 16) {
+    return STATUS_NO_ROOM;
+  }
+  for (i = 0; i < count; i++) {
+    steps[i].command = PCD_Transceive;
+    steps[i].data[0] = PICC_CMD_MF_READ;
+    steps[i].data[1] = firstBlock + i;
+    mfrc522_crc_a(steps[i].data, 2, &steps[i].data[2]);
+    steps[i].length = 4;
+    steps[i].out = buffer + i * 16;
+  }
+  byte result = mfrc522_mifare_run_pipeline(steps, count);
+  *bufferSize = (result == STATUS_OK) ? count * 16 : 0;
+  return result;
+} // End MIFARE_ReadBlocks()
+
+/**
+ * Reads the data blocks, i.e. all but the sector trailer, of several MIFARE Classic sectors
+ * into one buffer, in the order given.
+ * 
+ * The PICC must be selected. Every sector is authenticated once with its Key A, then all its
+ * blocks are read, the authentication of the next sector follows right away. The READ frames
+ * carry a CRC_A calculated on the host and the commands are pipelined: the answer to one is
+ * fetched from the FIFO with the same SPI transfer that starts the next.
+ * 
+ * Remember to call PCD_StopCrypto1() afterwards.
+ * 
+ * @return STATUS_OK on success, STATUS_??? otherwise. Probably STATUS_TIMEOUT if a key is wrong.
+ */
+byte mfrc522_mifare_read_sectors(	MIFARE_SectorKey *sectors,	///< The sectors to read with their Key A, e.g. a table kept by the caller.
+					byte count,			///< Number of sectors
+					Uid *uid,			///< The selected PICC, the first 4 bytes of the UID are used.
+					byte *buffer,		///< The buffer to store the data in
+					unsigned int *bufferSize	///< In: Buffer size. Out: The number of bytes returned.
+					) {
+  MIFARE_Step *steps;
+  unsigned int n_steps = 0, size = 0;
+  byte s, i, firstBlock, blocks;
+
+  // Authentication plus up to 15 data blocks per sector
+  if (buffer == NULL || count == 0 || count > 40 || (steps = malloc(count * 16 * sizeof(MIFARE_Step))) == NULL) {
+    return STATUS_INVALID;
+  }
+
+  for (s = 0; s < count; s++) {
+    if (!mfrc522_mifare_sector_blocks(sectors[s].sector, &firstBlock, &blocks)) {
+      free(steps);
+      return STATUS_INVALID;
+    }
+    if (size + (blocks - 1) * 16 > *bufferSize) {
+      free(steps);
+      return STATUS_NO_ROOM;
+    }
+
+    MIFARE_Step *auth = &steps[n_steps++];
+    auth->command = PCD_MFAuthent;
+    auth->data[0] = PICC_CMD_MF_AUTH_KEY_A;
+    auth->data[1] = firstBlock;
+    memcpy(&auth->data[2], sectors[s].key.keyByte, MF_KEY_SIZE);
+    memcpy(&auth->data[8], uid->uidByte, 4);
+    auth->length = 12;
+    auth->out = NULL;
+
+    for (i = 0; i < blocks - 1; i++) {
+      MIFARE_Step *read = &steps[n_steps++];
+      read->command = PCD_Transceive;
+      read->data[0] = PICC_CMD_MF_READ;
+      read->data[1] = firstBlock + i;
+      mfrc522_crc_a(read->data, 2, &read->data[2]);
+      read->length = 4;
+      read->out = buffer + size;
+      size += 16;
+    }
+  }
+
+  byte result = mfrc522_mifare_run_pipeline(steps, n_steps);
+  free(steps);
+  *bufferSize = (result == STATUS_OK) ? size : 0;
+  return result;
+} // End MIFARE_ReadSectors()
+
+/**
+ * Reads the data blocks of one MIFARE Classic sector under a single authentication,
+ * see MIFARE_ReadSectors().
+ * 
+ * @return STATUS_OK on success, STATUS_??? otherwise.
+ */
+byte mfrc522_mifare_read_sector(	byte sector,		///< The sector, 0..39
+					MIFARE_Key *key,	///< Key A of the sector
+					Uid *uid,			///< The selected PICC
+					byte *buffer,		///< The buffer to store the data in, 48 bytes for sectors 0..31, 240 for 32..39
+					unsigned int *bufferSize	///< In: Buffer size. Out: The number of bytes returned.
+					) {
+  MIFARE_SectorKey sectorKey;
+  sectorKey.sector = sector;
+  sectorKey.key = *key;
+  return mfrc522_mifare_read_sectors(&sectorKey, 1, uid, buffer, bufferSize);
+} // End MIFARE_ReadSector()
+
 /**
  * Writes 16 bytes to the active PICC.
  * 
@@ -1648,7 +2008,7 @@ bool mfrc522_mifare_set_uid(byte *newUid, byte uidSize, bool logErrors) {
 	
   // Authenticate for reading
   MIFARE_Key key = {{0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF}};
-  byte status = mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, (byte)1, &key, &uid);
+  byte status = mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, (byte)1, &key, &pcd->uid);
   if (status != STATUS_OK) {
 		
     if (status == STATUS_TIMEOUT) {
@@ -1664,7 +2024,7 @@ bool mfrc522_mifare_set_uid(byte *newUid, byte uidSize, bool logErrors) {
 	return false;
       }
 			
-      status = mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, (byte)1, &key, &uid);
+      status = mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, (byte)1, &key, &pcd->uid);
       if (status != STATUS_OK) {
 	// We tried, time to give up
 	if (logErrors) {
@@ -1783,7 +2143,66 @@ bool mfrc522_picc_is_new_card_present() {
  * @return bool
  */
 bool mfrc522_picc_read_card_serial() {
-  byte result = mfrc522_picc_select(&uid, 0);
+  byte result = mfrc522_picc_select(&pcd->uid, 0);
   return (result == STATUS_OK);
 } // End PICC_ReadCardSerial()
+
+/**
+ * Finds all PICCs in the field.
+ * Switching the RF field off and on resets every PICC, also halted ones, to IDLE. Then one PICC after the
+ * other is woken up with REQA, selected through the anticollision loop and halted, so it does not answer
+ * REQA anymore, until there is no answer.
+ * All PICCs found are left in state HALT, use PICC_WakeupA() and PICC_Select() with the known UID to talk
+ * to one of them.
+ * 
+ * @return The number of PICCs found, at most max.
+ */
+byte mfrc522_picc_enumerate(	Uid *uids,		///< Out: The UIDs in the order they have been selected.
+				byte max		///< Size of uids
+				) {
+  byte found = 0, errors = 0, i;
+  byte atqa[2], atqaSize;
+  Uid current;
+
+  // REQA, anticollision and HLTA are answered after ~90us, and HLTA only succeeds by timing out:
+  // use 2ms (80 timer ticks of 25us) instead of the 25ms set up in PCD_Init() while enumerating.
+  mfrc522_pcd_write_register(TReloadRegH, 0x00);
+  mfrc522_pcd_write_register(TReloadRegL, 0x50);
+
+  // RF reset: at least 5.1ms without field (ISO/IEC 14443-3 6.2.2), PICCs are ready 5ms after the field is back
+  mfrc522_pcd_antenna_off();
+  spi_bus_delay(pcd->bus, 6);
+  mfrc522_pcd_antenna_on();
+  spi_bus_delay(pcd->bus, 5);
+
+  while (found < max && errors < 3) {
+    atqaSize = sizeof(atqa);
+    byte result = mfrc522_picc_request_a(atqa, &atqaSize);
+    if (result == STATUS_TIMEOUT) {
+      break;					// Nobody left in IDLE
+    }
+    if ((result != STATUS_OK && result != STATUS_COLLISION) || mfrc522_picc_select(&current, 0) != STATUS_OK) {
+      errors++;
+      continue;
+    }
+    mfrc522_picc_halt_a();
+
+    // A PICC that missed the HLTA answers again, list it only once
+    for (i = 0; i < found; i++) {
+      if (uids[i].size == current.size && memcmp(uids[i].uidByte, current.uidByte, current.size) == 0) {
+	break;
+      }
+    }
+    if (i == found) {
+      uids[found++] = current;
+    }
+    else {
+      errors++;
+    }
+  }
+
+  mfrc522_pcd_write_register(TReloadRegH, 0x03);
+  mfrc522_pcd_write_register(TReloadRegL, 0xE8);
+  return found;
+} // End PICC_Enumerate()
  
@@ -19,6 +19,8 @@
 #include <string.h>
 #include <stdbool.h>
 
+#include "spi_bus.h"
+
 typedef uint8_t byte;
 typedef uint16_t word;
 
@@ -199,7 +201,19 @@ typedef struct {
 typedef struct {
     byte		keyByte[MF_KEY_SIZE];
 } MIFARE_Key;
+
+// A MIFARE Classic sector with the Key A to read it
+typedef struct {
+    byte		sector;
+    MIFARE_Key	key;
+} MIFARE_SectorKey;
 	
+
+// One MFRC522 and what the driver keeps for it
+typedef struct {
+    SpiBus		*bus;
+    Uid			uid;			// Used by PICC_ReadCardSerial().
+} MFRC522;
 	
 // Size of the MFRC522 FIFO
 static const byte FIFO_SIZE = 64;		// The FIFO is 64 bytes.
@@ -207,8 +221,13 @@ static const byte FIFO_SIZE = 64;		// The FIFO is 64 bytes.
 /////////////////////////////////////////////////////////////////////////////////////
 // Functions for setting up the Raspberry Pi
 /////////////////////////////////////////////////////////////////////////////////////
-void mfrc522_init();
-void mfrc522_set_spi_config();
+MFRC522 *mfrc522_new(SpiBus *bus);
+void mfrc522_free(MFRC522 *reader);
+void mfrc522_use(MFRC522 *reader);
+MFRC522 *mfrc522_current();
+void mfrc522_init(SpiBus *bus);
+SpiBus *mfrc522_get_bus();
+void mfrc522_close();
 /////////////////////////////////////////////////////////////////////////////////////
 // Basic interface functions for communicating with the MFRC522
 /////////////////////////////////////////////////////////////////////////////////////
@@ -249,6 +268,9 @@ byte mfrc522_picc_halt_a();
 byte mfrc522_pcd_authenticate(byte command, byte blockAddr, MIFARE_Key *key, Uid *uid);
 void mfrc522_pcd_stop_crypto_1();
 byte mfrc522_mifare_read(byte blockAddr, byte *buffer, byte *bufferSize);
+byte mfrc522_mifare_read_blocks(byte firstBlock, byte count, byte *buffer, unsigned int *bufferSize);
+byte mfrc522_mifare_read_sector(byte sector, MIFARE_Key *key, Uid *uid, byte *buffer, unsigned int *bufferSize);
+byte mfrc522_mifare_read_sectors(MIFARE_SectorKey *sectors, byte count, Uid *uid, byte *buffer, unsigned int *bufferSize);
 byte mfrc522_mifare_write(byte blockAddr, byte *buffer, byte bufferSize);
 byte mfrc522_mifare_decrement(byte blockAddr, long delta);
 byte mfrc522_mifare_increment(byte blockAddr, long delta);
@@ -283,6 +305,7 @@ bool mfrc522_mifare_unbrick_uid_sector(bool logErrors);
 /////////////////////////////////////////////////////////////////////////////////////
 bool mfrc522_picc_is_new_card_present();
 bool mfrc522_picc_read_card_serial();
+byte mfrc522_picc_enumerate(Uid *uids, byte max);
 
 byte mfrc522_mifare_two_step_helper(byte command, byte blockAddr, long data);
 
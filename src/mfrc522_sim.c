@@ -0,0 +1,899 @@
+/**
+ * Simulated MFRC522 on a virtual SPI bus
+ *
+ * @package kiddyblaster
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "mfrc522_sim.h"
+
+// Register index from the SPI address byte / PCD_Register enum
+#define REG(r) (((r) >> 1) & 0x3F)
+
+// ComIrqReg bits
+#define IRQ_TX      0x40
+#define IRQ_RX      0x20
+#define IRQ_IDLE    0x10
+#define IRQ_TIMER   0x01
+
+// Cost of SPI traffic: ~4 MHz clock, a chip select gap per frame and the
+// host's overhead (syscall, driver setup) per transfer
+#define SIM_SPI_BYTE_NS         2000
+#define SIM_FRAME_OVERHEAD_US   1
+#define SIM_TRANSFER_OVERHEAD_US 10
+
+// ISO 14443-A at 106 kbit/s: 9 bit times per byte (parity) of 9.44 us,
+// plus the frame delay time between command and answer
+#define SIM_RF_BIT_NS           9440
+#define SIM_RF_FDT_US           90
+#define SIM_AUTH_US             1500
+
+extern const byte MFRC522_firmware_referenceV2_0[];
+
+typedef struct {
+    byte regs[64];
+    byte fifo[64];
+    unsigned int fifo_len;
+    byte internal_buffer[25];
+    SimTag *tags[MFRC522_SIM_MAX_TAGS];
+    unsigned int n_tags;
+    uint64_t now;
+    Mfrc522SimStats stats;
+    int noise_db;           // Receiver gain above which answers drown in noise, 0 for none
+    uint32_t random;        // State of the xorshift generator deciding about lost answers
+} Mfrc522Sim;
+
+// RxGain[2:0] in RFCfgReg to dB, see table 98 in the datasheet
+static const int rx_gain_db[8] = { 18, 23, 18, 23, 33, 38, 43, 48 };
+
+
+
+static uint16_t crc_a(const byte *data, unsigned int len) {
+    uint16_t crc = 0x6363;
+    unsigned int i;
+    for (i = 0; i < len; i++) {
+        byte b = data[i] ^ (crc & 0xff);
+        b ^= b << 4;
+        crc = (crc >> 8) ^ ((uint16_t)b << 8) ^ ((uint16_t)b << 3) ^ (b >> 4);
+    }
+    return crc;
+}
+
+
+
+static bool crc_ok(const byte *data, unsigned int len) {
+    if (len < 3) {
+        return false;
+    }
+    uint16_t crc = crc_a(data, len - 2);
+    return data[len - 2] == (crc & 0xff) && data[len - 1] == (crc >> 8);
+}
+
+
+
+static void append_crc(byte *data, unsigned int len) {
+    uint16_t crc = crc_a(data, len);
+    data[len] = crc & 0xff;
+    data[len + 1] = crc >> 8;
+}
+
+
+
+/*
+ * Without the RF field the tags lose power and start over in IDLE
+ */
+static void field_off(Mfrc522Sim *sim) {
+    unsigned int i;
+    for (i = 0; i < sim->n_tags; i++) {
+        SimTag *tag = sim->tags[i];
+        tag->state = SIM_TAG_IDLE;
+        tag->halted = false;
+        tag->cascade_level = 1;
+        tag->auth_sector = -1;
+        tag->pending_write = -1;
+    }
+}
+
+
+
+static void soft_reset(Mfrc522Sim *sim) {
+    memset(sim->regs, 0, sizeof(sim->regs));
+    sim->regs[REG(CommandReg)] = 0x20;
+    sim->regs[REG(WaterLevelReg)] = 0x08;
+    sim->regs[REG(ControlReg)] = 0x10;
+    sim->regs[REG(CollReg)] = 0x80;
+    sim->regs[REG(ModeReg)] = 0x3F;
+    sim->regs[REG(TxControlReg)] = 0x80;
+    sim->regs[REG(TxSelReg)] = 0x10;
+    sim->regs[REG(RxSelReg)] = 0x84;
+    sim->regs[REG(RxThresholdReg)] = 0x84;
+    sim->regs[REG(DemodReg)] = 0x4D;
+    sim->regs[REG(RFCfgReg)] = 0x48;
+    sim->regs[REG(GsNReg)] = 0x88;
+    sim->regs[REG(CWGsPReg)] = 0x20;
+    sim->regs[REG(ModGsPReg)] = 0x20;
+    sim->regs[REG(VersionReg)] = 0x92;
+    sim->fifo_len = 0;
+    field_off(sim);
+}
+
+
+
+/**
+ * Duration of the timer as configured in TModeReg, TPrescalerReg and TReloadReg
+ */
+static uint64_t timer_duration(Mfrc522Sim *sim) {
+    unsigned int prescaler = ((sim->regs[REG(TModeReg)] & 0x0F) << 8) | sim->regs[REG(TPrescalerReg)];
+    unsigned int reload = (sim->regs[REG(TReloadRegH)] << 8) | sim->regs[REG(TReloadRegL)];
+
+    if (!(sim->regs[REG(TModeReg)] & 0x80)) {
+        // TAuto off, the driver runs into its emergency break
+        return 36000;
+    }
+    return (uint64_t)(reload + 1) * (2 * prescaler + 1) * 1000000 / 13560000;
+}
+
+
+
+static void fifo_push(Mfrc522Sim *sim, byte value) {
+    if (sim->fifo_len >= sizeof(sim->fifo)) {
+        sim->regs[REG(ErrorReg)] |= 0x10;   // BufferOvfl
+        return;
+    }
+    sim->fifo[sim->fifo_len++] = value;
+}
+
+
+
+static byte fifo_pop(Mfrc522Sim *sim) {
+    if (sim->fifo_len == 0) {
+        return 0;
+    }
+    byte value = sim->fifo[0];
+    memmove(sim->fifo, sim->fifo + 1, --sim->fifo_len);
+    return value;
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+// Tags
+/////////////////////////////////////////////////////////////////////////////////////
+
+static bool uid_complete_at(SimTag *tag, byte level) {
+    return (tag->uid.size == 4 && level == 1) || (tag->uid.size == 7 && level == 2) || level == 3;
+}
+
+
+
+/**
+ * The 5 bytes (4 UID bytes or cascade tag + 3 UID bytes, then BCC) a tag
+ * answers with in the given cascade level
+ */
+static void cascade_bytes(SimTag *tag, byte level, byte *out) {
+    const byte *u = tag->uid.uidByte;
+
+    if (uid_complete_at(tag, level)) {
+        memcpy(out, u + (level - 1) * 3, 4);
+    }
+    else {
+        out[0] = PICC_CMD_CT;
+        memcpy(out + 1, u + (level - 1) * 3, 3);
+    }
+    out[4] = out[0] ^ out[1] ^ out[2] ^ out[3];
+}
+
+
+
+static int bit_at(const byte *data, unsigned int bit) {
+    return (data[bit / 8] >> (bit % 8)) & 1;
+}
+
+
+
+static void tag_fall_back(SimTag *tag) {
+    tag->state = tag->halted ? SIM_TAG_HALT : SIM_TAG_IDLE;
+    tag->auth_sector = -1;
+    tag->pending_write = -1;
+}
+
+
+
+static SimTag *active_tag(Mfrc522Sim *sim) {
+    unsigned int i;
+    for (i = 0; i < sim->n_tags; i++) {
+        if (sim->tags[i]->in_field && sim->tags[i]->state == SIM_TAG_ACTIVE) {
+            return sim->tags[i];
+        }
+    }
+    return NULL;
+}
+
+
+
+/*
+ * Answer of the PICCs to one frame. `bits` == 0 means no answer.
+ */
+typedef struct {
+    byte data[18];
+    unsigned int bits;
+    int collision;          // Bit position of the first collision, -1 if none
+} Answer;
+
+
+
+static void answer_bytes(Answer *answer, const byte *data, unsigned int len) {
+    memcpy(answer->data, data, len);
+    answer->bits = len * 8;
+}
+
+
+
+static void answer_ack(Answer *answer, bool ack) {
+    answer->data[0] = ack ? MF_ACK : 0x04;
+    answer->bits = 4;
+}
+
+
+
+static void request(Mfrc522Sim *sim, byte command, Answer *answer) {
+    unsigned int i, bit;
+    bool first = true;
+
+    for (i = 0; i < sim->n_tags; i++) {
+        SimTag *tag = sim->tags[i];
+        if (!tag->in_field) {
+            continue;
+        }
+        if (tag->state == SIM_TAG_READY || tag->state == SIM_TAG_ACTIVE) {
+            // Not a valid command in these states
+            tag_fall_back(tag);
+            continue;
+        }
+        if (tag->state == SIM_TAG_HALT && command != PICC_CMD_WUPA) {
+            continue;
+        }
+
+        tag->halted = (tag->state == SIM_TAG_HALT);
+        tag->state = SIM_TAG_READY;
+        tag->cascade_level = 1;
+
+        if (first) {
+            answer_bytes(answer, tag->atqa, 2);
+            first = false;
+            continue;
+        }
+        for (bit = 0; bit < 16; bit++) {
+            if (bit_at(answer->data, bit) != bit_at(tag->atqa, bit)) {
+                answer->collision = bit;
+                break;
+            }
+        }
+    }
+}
+
+
+
+static void anticollision(Mfrc522Sim *sim, const byte *frame, unsigned int bits, Answer *answer) {
+    byte level = (frame[0] - PICC_CMD_SEL_CL1) / 2 + 1;
+    byte nvb = frame[1];
+    unsigned int known = ((nvb >> 4) - 2) * 8 + (nvb & 0x0F);
+    unsigned int i, bit;
+    bool select = (nvb == 0x70);
+    bool first = true;
+    byte cln[5], answer_cln[5];
+
+    if (select ? (bits != 72 || !crc_ok(frame, 9)) : (bits != 16 + known)) {
+        return;
+    }
+
+    for (i = 0; i < sim->n_tags; i++) {
+        SimTag *tag = sim->tags[i];
+        if (!tag->in_field || tag->state == SIM_TAG_IDLE || tag->state == SIM_TAG_HALT) {
+            continue;
+        }
+        if (tag->state == SIM_TAG_ACTIVE || tag->cascade_level != level) {
+            tag_fall_back(tag);
+            continue;
+        }
+
+        cascade_bytes(tag, level, cln);
+
+        if (select) {
+            if (memcmp(cln, frame + 2, 5) != 0) {
+                tag_fall_back(tag);
+                continue;
+            }
+            byte sak[3];
+            if (uid_complete_at(tag, level)) {
+                sak[0] = tag->uid.sak;
+                tag->state = SIM_TAG_ACTIVE;
+                tag->auth_sector = -1;
+                tag->pending_write = -1;
+            }
+            else {
+                sak[0] = 0x04;
+                tag->cascade_level++;
+            }
+            append_crc(sak, 1);
+            answer_bytes(answer, sak, 3);
+            continue;
+        }
+
+        // Anticollision: only tags matching the known bits answer
+        for (bit = 0; bit < known; bit++) {
+            if (bit_at(cln, bit) != bit_at(frame + 2, bit)) {
+                break;
+            }
+        }
+        if (bit < known) {
+            continue;
+        }
+
+        if (first) {
+            memcpy(answer_cln, cln, 5);
+            answer->collision = -1;
+            first = false;
+            continue;
+        }
+        for (bit = known; bit < 40; bit++) {
+            if (bit_at(answer_cln, bit) != bit_at(cln, bit)) {
+                if (answer->collision < 0 || (int)bit < answer->collision) {
+                    answer->collision = bit;
+                }
+                break;
+            }
+        }
+    }
+
+    if (select || first) {
+        return;
+    }
+
+    // ValuesAfterColl=0: all bits received after a collision are cleared
+    if (answer->collision >= 0) {
+        for (bit = answer->collision; bit < 40; bit++) {
+            answer_cln[bit / 8] &= ~(1 << (bit % 8));
+        }
+    }
+
+    // The answer starts with the byte holding the first unknown bit
+    answer_bytes(answer, answer_cln + known / 8, 5 - known / 8);
+}
+
+
+
+static void mifare_command(Mfrc522Sim *sim, const byte *frame, unsigned int len, Answer *answer) {
+    SimTag *tag = active_tag(sim);
+    byte buffer[18];
+    unsigned int i;
+
+    if (tag == NULL || !crc_ok(frame, len)) {
+        return;
+    }
+
+    bool classic = (tag->type == SIM_TAG_MIFARE_1K);
+    bool crypto = (sim->regs[REG(Status2Reg)] & 0x08) != 0;
+
+    if (tag->pending_write >= 0) {
+        if (len != 18) {
+            tag_fall_back(tag);
+            answer_ack(answer, false);
+            return;
+        }
+        if (classic) {
+            memcpy(tag->memory + tag->pending_write * 16, frame, 16);
+        }
+        else {
+            memcpy(tag->memory + tag->pending_write * 4, frame, 4);
+        }
+        tag->pending_write = -1;
+        answer_ack(answer, true);
+        return;
+    }
+
+    switch (frame[0]) {
+        case PICC_CMD_HLTA:
+            tag->halted = true;
+            tag->state = SIM_TAG_HALT;
+            tag->auth_sector = -1;
+            return;
+
+        case PICC_CMD_MF_READ:
+            if (classic) {
+                if (!crypto || frame[1] >= 64 || tag->auth_sector != frame[1] / 4) {
+                    tag_fall_back(tag);
+                    answer_ack(answer, false);
+                    return;
+                }
+                memcpy(buffer, tag->memory + frame[1] * 16, 16);
+            }
+            else {
+                for (i = 0; i < 16; i++) {
+                    buffer[i] = tag->memory[(frame[1] * 4 + i) % 64];
+                }
+            }
+            append_crc(buffer, 16);
+            answer_bytes(answer, buffer, 18);
+            return;
+
+        case PICC_CMD_MF_WRITE:
+            if (classic ? (!crypto || frame[1] >= 64 || tag->auth_sector != frame[1] / 4) : frame[1] >= 16) {
+                tag_fall_back(tag);
+                answer_ack(answer, false);
+                return;
+            }
+            tag->pending_write = frame[1];
+            answer_ack(answer, true);
+            return;
+
+        case PICC_CMD_UL_WRITE:
+            if (classic || len != 8 || frame[1] < 2 || frame[1] >= 16) {
+                answer_ack(answer, false);
+                return;
+            }
+            memcpy(tag->memory + frame[1] * 4, frame + 2, 4);
+            answer_ack(answer, true);
+            return;
+
+        default:
+            tag_fall_back(tag);
+            answer_ack(answer, false);
+            return;
+    }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+// PCD commands
+/////////////////////////////////////////////////////////////////////////////////////
+
+/*
+ * Whether the reader fails to hear an answer with the current receiver gain:
+ * every dB below what the weakest tag in the field needs, or above the noise
+ * level, loses 10% of the answers.
+ */
+static bool answer_lost(Mfrc522Sim *sim) {
+    int gain = rx_gain_db[(sim->regs[REG(RFCfgReg)] >> 4) & 0x07];
+    int needed = 0, percent = 0;
+    unsigned int i;
+
+    for (i = 0; i < sim->n_tags; i++) {
+        if (sim->tags[i]->in_field && sim->tags[i]->signal_db > needed) {
+            needed = sim->tags[i]->signal_db;
+        }
+    }
+    if (gain < needed) {
+        percent += (needed - gain) * 10;
+    }
+    if (sim->noise_db > 0 && gain > sim->noise_db) {
+        percent += (gain - sim->noise_db) * 10;
+    }
+    if (percent == 0) {
+        return false;
+    }
+
+    sim->random ^= sim->random << 13;
+    sim->random ^= sim->random >> 17;
+    sim->random ^= sim->random << 5;
+    return (int)(sim->random % 100) < percent;
+}
+
+
+
+static void transceive(Mfrc522Sim *sim) {
+    byte frame[64];
+    unsigned int len = sim->fifo_len;
+    byte tx_last_bits = sim->regs[REG(BitFramingReg)] & 0x07;
+    unsigned int bits = tx_last_bits ? (len - 1) * 8 + tx_last_bits : len * 8;
+    Answer answer;
+    unsigned int i;
+
+    memcpy(frame, sim->fifo, len);
+    sim->fifo_len = 0;
+    memset(&answer, 0, sizeof(answer));
+    answer.collision = -1;
+
+    sim->stats.rf_exchanges++;
+    sim->regs[REG(ErrorReg)] = 0;
+    sim->regs[REG(CollReg)] |= 0x20;       // CollPosNotValid
+    sim->regs[REG(BitFramingReg)] &= 0x7F; // StartSend
+    sim->now += SIM_RF_FDT_US + (uint64_t)bits * 9 / 8 * SIM_RF_BIT_NS / 1000;
+
+    if ((sim->regs[REG(TxControlReg)] & 0x03) == 0) {
+        // Antenna off, nobody hears us
+    }
+    else if (bits == 7 && (frame[0] == PICC_CMD_REQA || frame[0] == PICC_CMD_WUPA)) {
+        request(sim, frame[0], &answer);
+    }
+    else if (len >= 2 && (frame[0] == PICC_CMD_SEL_CL1 || frame[0] == PICC_CMD_SEL_CL2 || frame[0] == PICC_CMD_SEL_CL3)) {
+        anticollision(sim, frame, bits, &answer);
+    }
+    else {
+        mifare_command(sim, frame, len, &answer);
+    }
+
+    if (answer.bits > 0 && answer_lost(sim)) {
+        answer.bits = 0;
+    }
+
+    if (answer.bits == 0) {
+        sim->stats.timeouts++;
+        sim->now += timer_duration(sim);
+        sim->regs[REG(ComIrqReg)] |= IRQ_TX | IRQ_TIMER;
+        return;
+    }
+
+    sim->now += (uint64_t)answer.bits * 9 / 8 * SIM_RF_BIT_NS / 1000;
+    for (i = 0; i < (answer.bits + 7) / 8; i++) {
+        fifo_push(sim, answer.data[i]);
+    }
+    sim->regs[REG(ControlReg)] = (sim->regs[REG(ControlReg)] & ~0x07) | (answer.bits % 8);
+    if (answer.collision >= 0) {
+        sim->regs[REG(ErrorReg)] |= 0x08;  // CollErr
+        sim->regs[REG(CollReg)] = (sim->regs[REG(CollReg)] & 0x80) | ((answer.collision + 1) & 0x1F);
+    }
+    sim->regs[REG(ComIrqReg)] |= IRQ_TX | IRQ_RX;
+}
+
+
+
+static void authenticate(Mfrc522Sim *sim) {
+    SimTag *tag = active_tag(sim);
+    byte data[12];
+    unsigned int len = sim->fifo_len;
+
+    memcpy(data, sim->fifo, len < 12 ? len : 12);
+    sim->fifo_len = 0;
+    sim->stats.rf_exchanges++;
+
+    if (tag != NULL && len == 12 && tag->type == SIM_TAG_MIFARE_1K && data[1] < 64 &&
+        memcmp(data + 8, tag->uid.uidByte, 4) == 0) {
+        byte *trailer = tag->memory + (data[1] / 4 * 4 + 3) * 16;
+        const byte *key = (data[0] == PICC_CMD_MF_AUTH_KEY_A) ? trailer : trailer + 10;
+        if (memcmp(data + 2, key, MF_KEY_SIZE) == 0) {
+            sim->now += SIM_AUTH_US;
+            tag->auth_sector = data[1] / 4;
+            sim->regs[REG(Status2Reg)] |= 0x08;    // MFCrypto1On
+            sim->regs[REG(ComIrqReg)] |= IRQ_IDLE;
+            sim->regs[REG(CommandReg)] &= ~0x0F;
+            return;
+        }
+    }
+
+    // Wrong key or no card: the card goes silent, the timer runs out
+    if (tag != NULL) {
+        tag_fall_back(tag);
+    }
+    sim->stats.timeouts++;
+    sim->now += timer_duration(sim);
+    sim->regs[REG(ComIrqReg)] |= IRQ_TIMER;
+}
+
+
+
+static void calc_crc(Mfrc522Sim *sim) {
+    if (sim->regs[REG(AutoTestReg)] == 0x09) {
+        // Digital self test: the FIFO receives the firmware reference bytes
+        sim->fifo_len = 0;
+        unsigned int i;
+        for (i = 0; i < 64; i++) {
+            fifo_push(sim, MFRC522_firmware_referenceV2_0[i]);
+        }
+    }
+    else {
+        uint16_t crc = crc_a(sim->fifo, sim->fifo_len);
+        sim->fifo_len = 0;
+        sim->regs[REG(CRCResultRegL)] = crc & 0xff;
+        sim->regs[REG(CRCResultRegH)] = crc >> 8;
+    }
+    sim->regs[REG(DivIrqReg)] |= 0x04;        // CRCIRq
+}
+
+
+
+static void write_register(Mfrc522Sim *sim, byte reg, byte value) {
+    switch (reg) {
+        case REG(CommandReg):
+            sim->regs[reg] = value;
+            switch (value & 0x0F) {
+                case PCD_Mem:
+                    memcpy(sim->internal_buffer, sim->fifo, sim->fifo_len < 25 ? sim->fifo_len : 25);
+                    sim->fifo_len = 0;
+                    sim->regs[reg] &= ~0x0F;
+                    break;
+                case PCD_CalcCRC:
+                    calc_crc(sim);
+                    break;
+                case PCD_MFAuthent:
+                    authenticate(sim);
+                    break;
+                case PCD_SoftReset:
+                    soft_reset(sim);
+                    break;
+            }
+            break;
+
+        case REG(FIFODataReg):
+            fifo_push(sim, value);
+            break;
+
+        case REG(FIFOLevelReg):
+            if (value & 0x80) {
+                sim->fifo_len = 0;
+                sim->regs[REG(ErrorReg)] &= ~0x10;
+            }
+            break;
+
+        case REG(ComIrqReg):
+        case REG(DivIrqReg):
+            // Set1/Set2: 1 sets, 0 clears the marked bits
+            if (value & 0x80) {
+                sim->regs[reg] |= value & 0x7F;
+            }
+            else {
+                sim->regs[reg] &= ~value;
+            }
+            break;
+
+        case REG(BitFramingReg):
+            sim->regs[reg] = value;
+            if ((value & 0x80) && (sim->regs[REG(CommandReg)] & 0x0F) == PCD_Transceive) {
+                transceive(sim);
+            }
+            break;
+
+        case REG(TxControlReg):
+            if ((value & 0x03) == 0) {
+                field_off(sim);
+            }
+            sim->regs[reg] = value;
+            break;
+
+        case REG(ErrorReg):
+        case REG(Status1Reg):
+        case REG(VersionReg):
+            // Read only
+            break;
+
+        default:
+            sim->regs[reg] = value;
+            break;
+    }
+}
+
+
+
+static byte read_register(Mfrc522Sim *sim, byte reg) {
+    switch (reg) {
+        case REG(FIFODataReg):
+            return fifo_pop(sim);
+        case REG(FIFOLevelReg):
+            return sim->fifo_len;
+        default:
+            return sim->regs[reg];
+    }
+}
+
+
+
+/////////////////////////////////////////////////////////////////////////////////////
+// SpiBus backend
+/////////////////////////////////////////////////////////////////////////////////////
+
+static int sim_transfer(SpiBus *bus, SpiTransfer *xfers, unsigned int count) {
+    Mfrc522Sim *sim = bus->priv;
+    unsigned int i, j;
+
+    sim->stats.transfers++;
+    sim->now += SIM_TRANSFER_OVERHEAD_US;
+
+    for (i = 0; i < count; i++) {
+        byte tx[256], rx[256];
+        unsigned int len = xfers[i].len;
+
+        if (len == 0 || len > sizeof(tx)) {
+            return -1;
+        }
+        // tx and rx may be the same buffer
+        memcpy(tx, xfers[i].tx, len);
+        memset(rx, 0, len);
+
+        sim->stats.frames++;
+        sim->stats.bytes += len;
+        sim->now += SIM_FRAME_OVERHEAD_US + (uint64_t)len * SIM_SPI_BYTE_NS / 1000;
+
+        if (tx[0] & 0x80) {
+            // Read: every byte but the last addresses the register clocked
+            // out with the next byte
+            for (j = 1; j < len; j++) {
+                rx[j] = read_register(sim, REG(tx[j - 1]));
+            }
+        }
+        else {
+            for (j = 1; j < len; j++) {
+                write_register(sim, REG(tx[0]), tx[j]);
+            }
+        }
+
+        if (xfers[i].rx != NULL) {
+            memcpy(xfers[i].rx, rx, len);
+        }
+    }
+    return 0;
+}
+
+
+
+static void sim_delay(SpiBus *bus, unsigned int millis) {
+    Mfrc522Sim *sim = bus->priv;
+    sim->now += (uint64_t)millis * 1000;
+}
+
+
+
+static uint64_t sim_now(SpiBus *bus) {
+    Mfrc522Sim *sim = bus->priv;
+    return sim->now;
+}
+
+
+
+static void sim_free(SpiBus *bus) {
+    Mfrc522Sim *sim = bus->priv;
+    unsigned int i;
+    for (i = 0; i < sim->n_tags; i++) {
+        free(sim->tags[i]);
+    }
+    free(sim);
+}
+
+
+
+/**
+ * Create a simulated MFRC522 with an empty field
+ *
+ * @return SpiBus*  Bus to hand to mfrc522_init(), free with spi_bus_free()
+ */
+SpiBus *mfrc522_sim_new() {
+    Mfrc522Sim *sim = calloc(1, sizeof(Mfrc522Sim));
+    soft_reset(sim);
+    sim->random = 2463534242u;
+
+    SpiBus *bus = calloc(1, sizeof(SpiBus));
+    bus->name = "sim";
+    bus->transfer = sim_transfer;
+    bus->delay = sim_delay;
+    bus->now = sim_now;
+    bus->free = sim_free;
+    bus->priv = sim;
+    return bus;
+}
+
+
+
+/**
+ * Place a factory fresh tag in the field
+ *
+ * @param SpiBus*       bus         The simulator's bus
+ * @param SimTagType    type
+ * @param const byte*   uid         4 bytes for MIFARE 1K, 7 bytes for Ultralight
+ * @param byte          uid_size
+ * @return SimTag*      NULL if the field is full, owned by the simulator
+ */
+SimTag *mfrc522_sim_add_tag(SpiBus *bus, SimTagType type, const byte *uid, byte uid_size) {
+    Mfrc522Sim *sim = bus->priv;
+    unsigned int i;
+
+    if (sim->n_tags >= MFRC522_SIM_MAX_TAGS || (uid_size != 4 && uid_size != 7)) {
+        return NULL;
+    }
+
+    SimTag *tag = calloc(1, sizeof(SimTag));
+    tag->type = type;
+    tag->uid.size = uid_size;
+    memcpy(tag->uid.uidByte, uid, uid_size);
+    tag->in_field = true;
+    tag->state = SIM_TAG_IDLE;
+    tag->auth_sector = -1;
+    tag->pending_write = -1;
+
+    if (type == SIM_TAG_MIFARE_1K) {
+        static const byte trailer[16] = {
+            0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x07, 0x80, 0x69, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+        };
+        tag->uid.sak = 0x08;
+        tag->atqa[0] = 0x04;
+        memcpy(tag->memory, uid, uid_size);
+        tag->memory[uid_size] = uid[0] ^ uid[1] ^ uid[2] ^ uid[3];
+        tag->memory[5] = tag->uid.sak;
+        tag->memory[6] = tag->atqa[0];
+        for (i = 0; i < 16; i++) {
+            memcpy(tag->memory + (i * 4 + 3) * 16, trailer, 16);
+        }
+    }
+    else {
+        tag->uid.sak = 0x00;
+        tag->atqa[0] = 0x44;
+        memcpy(tag->memory, uid, 3);
+        tag->memory[3] = PICC_CMD_CT ^ uid[0] ^ uid[1] ^ uid[2];
+        memcpy(tag->memory + 4, uid + 3, 4);
+        tag->memory[8] = uid[3] ^ uid[4] ^ uid[5] ^ uid[6];
+    }
+
+    sim->tags[sim->n_tags++] = tag;
+    return tag;
+}
+
+
+
+void mfrc522_sim_remove_tag(SpiBus *bus, SimTag *tag) {
+    Mfrc522Sim *sim = bus->priv;
+    unsigned int i;
+
+    for (i = 0; i < sim->n_tags; i++) {
+        if (sim->tags[i] == tag) {
+            memmove(&sim->tags[i], &sim->tags[i + 1], (sim->n_tags - i - 1) * sizeof(SimTag*));
+            sim->n_tags--;
+            free(tag);
+            return;
+        }
+    }
+}
+
+
+
+/**
+ * Write raw data to the tag's memory, starting at a block (1K) or page (Ultralight)
+ */
+void mfrc522_sim_tag_write(SimTag *tag, byte block, const byte *data, unsigned int len) {
+    unsigned int offset = block * (tag->type == SIM_TAG_MIFARE_1K ? 16 : 4);
+    if (offset + len > sizeof(tag->memory)) {
+        return;
+    }
+    memcpy(tag->memory + offset, data, len);
+}
+
+
+
+/**
+ * Change key A or B of a MIFARE Classic sector
+ *
+ * @param byte key_type     PICC_CMD_MF_AUTH_KEY_A or PICC_CMD_MF_AUTH_KEY_B
+ */
+void mfrc522_sim_tag_set_key(SimTag *tag, byte sector, byte key_type, const MIFARE_Key *key) {
+    if (tag->type != SIM_TAG_MIFARE_1K || sector >= 16) {
+        return;
+    }
+    byte *trailer = tag->memory + (sector * 4 + 3) * 16;
+    memcpy(key_type == PICC_CMD_MF_AUTH_KEY_A ? trailer : trailer + 10, key->keyByte, MF_KEY_SIZE);
+}
+
+
+
+/**
+ * Make receiver gains above `noise_db` lose answers, 0 to turn off
+ */
+void mfrc522_sim_set_noise(SpiBus *bus, int noise_db) {
+    Mfrc522Sim *sim = bus->priv;
+    sim->noise_db = noise_db;
+}
+
+
+
+/**
+ * Let time pass on the simulator's clock, e.g. the poll interval
+ */
+void mfrc522_sim_advance(SpiBus *bus, uint64_t usec) {
+    Mfrc522Sim *sim = bus->priv;
+    sim->now += usec;
+}
+
+
+
+Mfrc522SimStats mfrc522_sim_get_stats(SpiBus *bus) {
+    Mfrc522Sim *sim = bus->priv;
+    return sim->stats;
+}
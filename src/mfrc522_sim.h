@@ -0,0 +1,69 @@
+/**
+ * Simulated MFRC522 on a virtual SPI bus
+ *
+ * Emulates the register interface of the MFRC522 (FIFO, interrupt flags,
+ * timer, CRC coprocessor, self test) and the ISO 14443-3 state machine of
+ * MIFARE Classic 1K and Ultralight tags placed in its field, so the reader
+ * stack can run and be benchmarked off the Pi. Time is virtual: SPI frames,
+ * RF exchanges, timeouts and delays advance a clock instead of sleeping.
+ *
+ * Crypto1 is not emulated, authenticated traffic is sent in the clear.
+ *
+ * @package kiddyblaster
+ */
+#ifndef __MFRC522_SIM_H__
+#define __MFRC522_SIM_H__
+
+#include "mfrc522.h"
+#include "spi_bus.h"
+
+#define MFRC522_SIM_MAX_TAGS 8
+
+typedef enum {
+    SIM_TAG_MIFARE_1K,
+    SIM_TAG_MIFARE_ULTRALIGHT
+} SimTagType;
+
+typedef enum {
+    SIM_TAG_IDLE,
+    SIM_TAG_READY,
+    SIM_TAG_ACTIVE,
+    SIM_TAG_HALT
+} SimTagState;
+
+typedef struct {
+    SimTagType type;
+    Uid uid;
+    byte atqa[2];
+    byte memory[1024];      // 1K: 64 blocks of 16 bytes, Ultralight: 16 pages of 4 bytes
+    bool in_field;
+    int signal_db;          // Receiver gain the tag needs to be heard reliably, 0 for any
+
+    // ISO 14443-3 state, maintained by the simulation
+    SimTagState state;
+    bool halted;            // Came from HALT, falls back there instead of IDLE
+    byte cascade_level;
+    int auth_sector;        // -1 if not authenticated
+    int pending_write;      // Block address of a two-step write, -1 if none
+} SimTag;
+
+typedef struct {
+    unsigned long transfers;
+    unsigned long frames;
+    unsigned long bytes;
+    unsigned long rf_exchanges;
+    unsigned long timeouts;
+} Mfrc522SimStats;
+
+SpiBus *mfrc522_sim_new();
+
+SimTag *mfrc522_sim_add_tag(SpiBus *bus, SimTagType type, const byte *uid, byte uid_size);
+void mfrc522_sim_remove_tag(SpiBus *bus, SimTag *tag);
+void mfrc522_sim_tag_write(SimTag *tag, byte block, const byte *data, unsigned int len);
+void mfrc522_sim_tag_set_key(SimTag *tag, byte sector, byte key_type, const MIFARE_Key *key);
+
+void mfrc522_sim_set_noise(SpiBus *bus, int noise_db);
+void mfrc522_sim_advance(SpiBus *bus, uint64_t usec);
+Mfrc522SimStats mfrc522_sim_get_stats(SpiBus *bus);
+
+#endif
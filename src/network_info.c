@@ -1,196 +1,389 @@
 /**
  * kiddyblaster/src/network_info.c
  *
+ * Keeps the state of the network interface in memory for the LCD to show
+ * at no cost. A thread listens to the kernel's rtnetlink messages about
+ * links and addresses, and reads the signal quality with the wireless
+ * extensions whenever the link changes and every NETWORK_POLL_INTERVAL
+ * seconds.
+ *
  * @author Johannes Braun <johannes.braun@hannenz.de>
  * @package kiddyblaster
  * @version 2020-06-07
  */
 
+#include <errno.h>
+#include <net/if.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <regex.h>
 #include <string.h>
-#include <sys/types.h>
-#include <ifaddrs.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
 #include <syslog.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #include <linux/wireless.h>
-#include <stdbool.h>
 
 #include "network_info.h"
 
+// Sequence numbers of the dumps asked for, addresses after links
+enum {
+    SEQ_LINKS = 1,
+    SEQ_ADDRESSES,
+    N_SEQS
+};
+
+// What the LCD reads, written by the monitor thread only
+static wifi_info_t cache;
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static char interface[IFNAMSIZ];
+static unsigned int ifindex;        // 0 as long as the interface has not been seen
+static unsigned int max_quality;    // The driver's, 0 until known
+
+static int netlink_fd = -1;
+static int wireless_fd = -1;
+static int stop_fd = -1;
+static pthread_t monitor_thread;
+static bool monitor_running = false;
+
+// The kernel runs one dump per socket at a time and turns down another
+// with EBUSY, so the dumps wanted wait for the one running to be done
+static bool dump_wanted[N_SEQS];
+static int dump_running;            // Its sequence number, 0 for none
+
+
+
+static void send_dump(int seq) {
+    struct sockaddr_nl kernel = { .nl_family = AF_NETLINK };
+    int type = seq == SEQ_LINKS ? RTM_GETLINK : RTM_GETADDR;
+    struct {
+        struct nlmsghdr header;
+        struct rtgenmsg gen;
+    } request;
+
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg));
+    request.header.nlmsg_type = type;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = seq;
+    request.gen.rtgen_family = type == RTM_GETADDR ? AF_INET : AF_UNSPEC;
+
+    if (sendto(netlink_fd, &request, request.header.nlmsg_len, 0, (struct sockaddr *)&kernel, sizeof(kernel)) < 0) {
+        syslog(LOG_WARNING, "Failed to ask for the network state: %s\n", strerror(errno));
+        return;
+    }
+    dump_running = seq;
+}
 
 
-int get_wifi_info(wifi_info_t *wifi) {
 
-    struct ifaddrs *ifaddr, *ifa;
+/*
+ * Send the next dump wanted, links before addresses, unless one is running
+ */
+static void next_dump() {
+    int seq;
 
-    if (getifaddrs(&ifaddr) == -1) {
-        perror("Error getting interface address");
-        return -1;
+    for (seq = SEQ_LINKS; seq < N_SEQS && dump_running == 0; seq++) {
+        if (dump_wanted[seq]) {
+            dump_wanted[seq] = false;
+            send_dump(seq);
+        }
     }
+}
 
-    /* if (ifaddr == NULL) { */
-    /*     syslog(LOG_WARNING, "ifaddr is NULL"); */
-    /*     perror("ifaddr is NULL"); */
-    /*     return -1; */
-    /* } */
 
-    bool wlan0_found = false;
-    for (ifa = ifaddr; ifa != NULL; ifa = ifa->ifa_next) {
-        printf("ifa->name: %s\n", ifa->ifa_name);
-        if (strcmp(ifa->ifa_name, "wlan0") == 0) {
-            wlan0_found = true;
-            break;
-        }
-    }
 
-    char essid[IW_ESSID_MAX_SIZE + 1];
-    struct iwreq request;
-    struct iw_statistics iwstats;
-    int sock;
+/*
+ * Ask the kernel for all links (SEQ_LINKS) or addresses (SEQ_ADDRESSES),
+ * the answers come in like the changes
+ */
+static void request_dump(int seq) {
+    dump_wanted[seq] = true;
+    next_dump();
+}
 
-    if (wlan0_found) {
-        strncpy(request.ifr_name, ifa->ifa_name, IFNAMSIZ);
-    }
 
-    sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock == -1) {
-        return 1;
-    }
 
-    if (ioctl(sock, SIOCGIWNAME, &request) == 0) {
-        // we are not interested 
+/*
+ * The dump `seq` is done or has failed
+ */
+static void dump_done(int seq) {
+    if (seq != dump_running) {
+        return;
+    }
+    dump_running = 0;
+    if (seq == SEQ_LINKS) {
+        dump_wanted[SEQ_ADDRESSES] = true;
     }
+    next_dump();
+}
 
-    freeifaddrs(ifaddr);
 
-    request.u.essid.pointer = essid;
-    if (ioctl(sock, SIOCGIWESSID, &request) == -1) {
-        perror("ioctl() failed when trying to get ESSID");
-        return -1;
-    }
-    
-    printf("ESSID: %s\n", request.u.essid.pointer);
 
-    memset(&iwstats, 0, sizeof(iwstats));
-    request.u.data.pointer = &iwstats;
-    request.u.data.length = sizeof(struct iw_statistics);
-    request.u.data.flags = 1;
+static void on_link(struct nlmsghdr *header, wifi_info_t *info) {
+    struct ifinfomsg *link = NLMSG_DATA(header);
+    struct rtattr *attr;
+    const char *name = NULL;
+    int len = IFLA_PAYLOAD(header), operstate = -1;
 
-    if (ioctl(sock, SIOCGIWSTATS, &request) == -1) {
-        perror("Can't open socket to obtain iwstats");
-        return -1;
+    for (attr = IFLA_RTA(link); RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+        if (attr->rta_type == IFLA_IFNAME) {
+            name = RTA_DATA(attr);
+        }
+        else if (attr->rta_type == IFLA_OPERSTATE) {
+            operstate = *(unsigned char *)RTA_DATA(attr);
+        }
+    }
+    if (name == NULL || strcmp(name, interface) != 0) {
+        return;
     }
 
-    printf("Signal level: %d\n", iwstats.qual.updated);
+    if (header->nlmsg_type == RTM_DELLINK) {
+        ifindex = 0;
+        info->link_up = false;
+        info->ip_address[0] = '\0';
+        return;
+    }
+    ifindex = link->ifi_index;
 
-    return 0;
+    // Drivers that don't track the state leave it unknown
+    if (operstate >= 0 && operstate != IF_OPER_UNKNOWN) {
+        info->link_up = operstate == IF_OPER_UP;
+    }
+    else {
+        info->link_up = (link->ifi_flags & IFF_RUNNING) != 0;
+    }
 }
 
 
-int _get_wifi_info(wifi_info_t *wifi) {
 
-    FILE *fp;
-    static const char* cmd = "iwconfig wlan0 | grep -i quality";
-    char line[200], msgbuf[200];
-    int i, reti;
-    regex_t regex;
+static void on_address(struct nlmsghdr *header, wifi_info_t *info) {
+    struct ifaddrmsg *address = NLMSG_DATA(header);
+    struct rtattr *attr;
+    const void *addr = NULL;
+    char str[INET_ADDRSTRLEN];
+    int len = IFA_PAYLOAD(header);
 
-    fp = popen(cmd, "r");
-    if (fp == NULL) {
-        return -1;
+    if (address->ifa_family != AF_INET || address->ifa_index != ifindex) {
+        return;
     }
-
-    if (fgets(line, sizeof(line), fp) == NULL) {
-        fprintf(stderr, "Failed to read from stream\n");
-        return -1;
+    for (attr = IFA_RTA(address); RTA_OK(attr, len); attr = RTA_NEXT(attr, len)) {
+        // The local address, which is the same as IFA_ADDRESS but on
+        // point-to-point links
+        if (attr->rta_type == IFA_LOCAL || (attr->rta_type == IFA_ADDRESS && addr == NULL)) {
+            addr = RTA_DATA(attr);
+        }
+    }
+    if (addr == NULL || inet_ntop(AF_INET, addr, str, sizeof(str)) == NULL) {
+        return;
     }
 
-    // Compile regex
-    reti = regcomp(&regex, "[[:digit:]]+/[[:digit:]]+", REG_EXTENDED);
-    if (reti) {
-        fprintf(stderr, "Regex compilation failed\n");
-        return -1;
+    if (header->nlmsg_type == RTM_NEWADDR) {
+        memcpy(info->ip_address, str, sizeof(str));
+    }
+    else if (strcmp(info->ip_address, str) == 0) {
+        // Another one may be left
+        info->ip_address[0] = '\0';
+        request_dump(SEQ_ADDRESSES);
     }
+}
 
-    // Execute regex (multiple times), e.g. "match_all" behavior
-    size_t nmatch = 1; // nr. of matches to be expected
-    regmatch_t pmatch[nmatch]; // holds match info (start / end offset)
-    char *ptr = &line[0];
-    char *matches[3];
-    i = 0;
-    while ((reti = regexec(&regex, ptr, nmatch, pmatch, 0)) != REG_NOMATCH) {
-        if (reti == 0) {
-            int len = pmatch[0].rm_eo - pmatch[0].rm_so;
-            matches[i] = malloc(len);
-            strncpy(matches[i], ptr + pmatch[0].rm_so, len);
-            matches[i][len] = '\0';
-            ptr += pmatch[0].rm_eo;
-            if (i++ > 3) {
-                break;
+
+
+/*
+ * Apply all messages from the kernel waiting on the socket
+ */
+static void read_netlink(wifi_info_t *info) {
+    char buf[8192] __attribute__((aligned(__alignof__(struct nlmsghdr))));
+    struct nlmsghdr *header;
+    ssize_t len;
+
+    while ((len = recv(netlink_fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+        for (header = (struct nlmsghdr *)buf; NLMSG_OK(header, len); header = NLMSG_NEXT(header, len)) {
+            switch (header->nlmsg_type) {
+                case NLMSG_DONE:
+                case NLMSG_ERROR:
+                    dump_done(header->nlmsg_seq);
+                    break;
+
+                case RTM_NEWLINK:
+                case RTM_DELLINK:
+                    on_link(header, info);
+                    break;
+
+                case RTM_NEWADDR:
+                case RTM_DELADDR:
+                    on_address(header, info);
+                    break;
             }
         }
-        else {
-            regerror(reti, &regex, msgbuf, sizeof(msgbuf));
-            fprintf(stderr, "Regex match failed: %s\n", msgbuf);
-            return -1;
+    }
+
+    // Messages have been lost, start over
+    if (len < 0 && errno == ENOBUFS) {
+        request_dump(SEQ_LINKS);
+    }
+}
+
+
+
+/*
+ * Read the signal quality with the wireless extensions
+ */
+static void read_wireless(wifi_info_t *info) {
+    struct iwreq request;
+    struct iw_statistics stats;
+    struct iw_range range;
+
+    info->link_quality = 0;
+    info->signal_level = info->noise_level = 0;
+    if (!info->link_up) {
+        return;
+    }
+
+    memset(&request, 0, sizeof(request));
+    strncpy(request.ifr_name, interface, IFNAMSIZ - 1);
+
+    if (max_quality == 0) {
+        memset(&range, 0, sizeof(range));
+        request.u.data.pointer = &range;
+        request.u.data.length = sizeof(range);
+        if (ioctl(wireless_fd, SIOCGIWRANGE, &request) == 0) {
+            max_quality = range.max_qual.qual;
         }
     }
 
-    if (i != 3) {
-        fprintf(stderr, "Wrong number of matches\n");
-        return -1;
+    memset(&stats, 0, sizeof(stats));
+    request.u.data.pointer = &stats;
+    request.u.data.length = sizeof(stats);
+    request.u.data.flags = 1;
+    if (ioctl(wireless_fd, SIOCGIWSTATS, &request) != 0) {
+        return;
     }
 
-    regfree(&regex);
-    pclose(fp);
+    info->link_quality = max_quality > 0 ? stats.qual.qual * 100 / max_quality : stats.qual.qual;
+    if (info->link_quality > 100) {
+        info->link_quality = 100;
+    }
+    if (stats.qual.updated & IW_QUAL_DBM) {
+        info->signal_level = (int8_t)stats.qual.level;
+        info->noise_level = (stats.qual.updated & IW_QUAL_NOISE_INVALID) ? 0 : (int8_t)stats.qual.noise;
+    }
+    else {
+        info->signal_level = stats.qual.level;
+        info->noise_level = (stats.qual.updated & IW_QUAL_NOISE_INVALID) ? 0 : stats.qual.noise;
+    }
+}
 
-    wifi->link_quality = atoi(matches[0]);
-    wifi->signal_level = atoi(matches[1]);
-    wifi->noise_level = atoi(matches[2]);
 
-    return 0;
+
+static void *monitor(void *data) {
+    struct pollfd fds[2] = {
+        { .fd = netlink_fd, .events = POLLIN },
+        { .fd = stop_fd, .events = POLLIN }
+    };
+    wifi_info_t info = cache;
+    int n;
+
+    (void)data;
+    for (;;) {
+        n = poll(fds, 2, NETWORK_POLL_INTERVAL * 1000);
+        if (n < 0 && errno != EINTR) {
+            syslog(LOG_ERR, "Network monitor failed: %s\n", strerror(errno));
+            break;
+        }
+        if (n > 0 && fds[1].revents != 0) {
+            break;
+        }
+        if (n > 0 && fds[0].revents != 0) {
+            read_netlink(&info);
+        }
+        read_wireless(&info);
+
+        pthread_mutex_lock(&cache_lock);
+        cache = info;
+        pthread_mutex_unlock(&cache_lock);
+    }
+    return NULL;
 }
 
 
+
 /**
- * Returns the IP Addr. of a given interface (e.g. "eth0", "wlan0" ...)
- * The string must be freed, when not used anymore
+ * Start following the state of interface `name`, e.g. NETWORK_INTERFACE
  *
- * @param char* interface
- * @return char*
+ * @param const char*   name
+ * @return int          0 on success, -1 on failure
  */
-char *get_ip_address(char* interface) {
-    struct ifaddrs *addrs, *p;
-    char *ip;
+int network_info_start(const char *name) {
+    struct sockaddr_nl addr = {
+        .nl_family = AF_NETLINK,
+        .nl_groups = RTMGRP_LINK | RTMGRP_IPV4_IFADDR
+    };
+
+    snprintf(interface, sizeof(interface), "%s", name);
+
+    netlink_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    wireless_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (netlink_fd < 0 || wireless_fd < 0 || stop_fd < 0 ||
+        bind(netlink_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        syslog(LOG_ERR, "Failed to set up the network monitor: %s\n", strerror(errno));
+        network_info_stop();
+        return -1;
+    }
 
-    if (getifaddrs(&addrs) < 0) {
-        return NULL;
+    dump_running = 0;
+    memset(dump_wanted, 0, sizeof(dump_wanted));
+    request_dump(SEQ_LINKS);
+    if (pthread_create(&monitor_thread, NULL, monitor, NULL) != 0) {
+        syslog(LOG_ERR, "Failed to start the network monitor\n");
+        network_info_stop();
+        return -1;
     }
+    monitor_running = true;
+    return 0;
+}
 
-    p = addrs;
 
-    while (p != NULL) {
 
-        if (p->ifa_addr && p->ifa_addr->sa_family == AF_INET) {
-            if (strncmp(p->ifa_name, interface, strlen(interface)) == 0) {
-                struct sockaddr_in *p_addr = (struct sockaddr_in*)p->ifa_addr;
-                char *addr = inet_ntoa(p_addr->sin_addr);
-                int len = strlen(addr);
-                ip = malloc(len + 1);
-                strncpy(ip, addr, len);
-                ip[len] = '\0';
-                break;
-            }
-        }
-
-        p = p->ifa_next;
+void network_info_stop() {
+    uint64_t one = 1;
 
+    if (monitor_running) {
+        if (write(stop_fd, &one, sizeof(one)) == sizeof(one)) {
+            pthread_join(monitor_thread, NULL);
+        }
+        monitor_running = false;
+    }
+    if (netlink_fd >= 0) {
+        close(netlink_fd);
     }
-    freeifaddrs(addrs);
-    return ip;
+    if (wireless_fd >= 0) {
+        close(wireless_fd);
+    }
+    if (stop_fd >= 0) {
+        close(stop_fd);
+    }
+    netlink_fd = wireless_fd = stop_fd = -1;
 }
 
+
+
+/**
+ * The last known state of the interface, without asking the kernel
+ *
+ * @param wifi_info_t*  wifi    Receives the state
+ */
+void network_info_get(wifi_info_t *wifi) {
+    pthread_mutex_lock(&cache_lock);
+    *wifi = cache;
+    pthread_mutex_unlock(&cache_lock);
+}
@@ -1,12 +1,26 @@
 #ifndef __NETWORK_INFO_H__
 #define __NETWORK_INFO_H__
+
+#include <netinet/in.h>
+#include <stdbool.h>
+
+// The interface shown on the LCD
+#define NETWORK_INTERFACE "wlan0"
+
+// Seconds between two reads of the signal quality, which the kernel does
+// not report by itself. Link and address changes are read when reported.
+#define NETWORK_POLL_INTERVAL 10
+
 typedef struct {
-    unsigned int link_quality;
-    unsigned int signal_level;
-    unsigned int noise_level;
+    bool link_up;
+    char ip_address[INET_ADDRSTRLEN];   // Empty if there is none
+    unsigned int link_quality;          // In percent
+    int signal_level;                   // In dBm if the driver tells
+    int noise_level;                    // Same, 0 if unknown
 } wifi_info_t;
 
-int get_wifi_info(wifi_info_t *wifi);
-char *get_ip_address(char *interface);
+int network_info_start(const char *interface);
+void network_info_stop();
+void network_info_get(wifi_info_t *wifi);
 
 #endif
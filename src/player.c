@@ -1,55 +1,132 @@
+#include <pthread.h>
 #include <stdio.h>
 #include <mpd/client.h>
 #include <mpd/connection.h>
 #include <syslog.h>
 #include "player.h"
 
+/*
+ * The one connection to mpd, shared by everybody: the main loop, the
+ * button callbacks, the card reader thread and the browser
+ */
+static struct mpd_connection *connection;
+static pthread_mutex_t connection_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+
+/**
+ * Take the shared connection to mpd, connecting if there is none. Give
+ * it back with player_connection_release().
+ *
+ * @return struct mpd_connection*   NULL if mpd can't be reached
+ */
+struct mpd_connection *player_connection_get() {
+    pthread_mutex_lock(&connection_lock);
+
+    if (connection == NULL) {
+        connection = mpd_connection_new(PLAYER_MPD_HOST, PLAYER_MPD_PORT, 0);
+    }
+    if (connection == NULL || mpd_connection_get_error(connection) != MPD_ERROR_SUCCESS) {
+        syslog(LOG_ERR, "Failed to connect to mpd\n");
+        if (connection != NULL) {
+            mpd_connection_free(connection);
+            connection = NULL;
+        }
+        pthread_mutex_unlock(&connection_lock);
+        return NULL;
+    }
+    return connection;
+}
+
+
+
+/**
+ * Give the shared connection back. If a command has failed, it is
+ * dropped unless mpd can go on, e.g. after a missing URI. The next
+ * player_connection_get() connects again.
+ */
+void player_connection_release(struct mpd_connection *mpd) {
+    if (mpd == NULL) {
+        return;
+    }
+    if (mpd_connection_get_error(mpd) != MPD_ERROR_SUCCESS) {
+        syslog(LOG_WARNING, "mpd: %s\n", mpd_connection_get_error_message(mpd));
+        if (!mpd_connection_clear_error(mpd)) {
+            mpd_connection_free(mpd);
+            connection = NULL;
+        }
+    }
+    pthread_mutex_unlock(&connection_lock);
+}
+
+
+
+/**
+ * Close the shared connection
+ */
+void player_close() {
+    pthread_mutex_lock(&connection_lock);
+    if (connection != NULL) {
+        mpd_connection_free(connection);
+        connection = NULL;
+    }
+    pthread_mutex_unlock(&connection_lock);
+}
+
 
 bool player_is_playing() {
+    return player_get_state() == MPD_STATE_PLAY;
+}
+
+
+
+/**
+ * Whether mpd is playing, paused or stopped
+ *
+ * @return int      An enum mpd_state, MPD_STATE_UNKNOWN if mpd can't be asked
+ */
+int player_get_state() {
     struct mpd_connection *mpd;
     struct mpd_status *status;
-    int state;
+    int state = MPD_STATE_UNKNOWN;
 
-    mpd = mpd_connection_new("localhost", 6600, 0);
-    if (mpd == NULL || mpd_connection_get_error(mpd) != MPD_ERROR_SUCCESS) {
-        syslog(LOG_ERR, "Failed to connect to mpd\n");
-        return -1;
+    if ((mpd = player_connection_get()) == NULL) {
+        return MPD_STATE_UNKNOWN;
     }
 
     status = mpd_run_status(mpd);
     if (status == NULL) {
         syslog(LOG_ERR, "Failed to get mpd status\n");
-        return -1;
+    }
+    else {
+        state = mpd_status_get_state(status);
+        mpd_status_free(status);
     }
 
-    state = mpd_status_get_state(status);
-
-    mpd_status_free(status);
-    mpd_connection_free(mpd);
+    player_connection_release(mpd);
 
-    return state == MPD_STATE_PLAY;
+    return state;
 }
 
 
 int player_get_current_song_nr() {
     struct mpd_connection *mpd;
+    int pos = -1;
 
-    mpd = mpd_connection_new("localhost", 6600, 0);
-    if (mpd == NULL || mpd_connection_get_error(mpd) != MPD_ERROR_SUCCESS) {
-        syslog(LOG_ERR, "Failed to connect to mpd\n");
+    if ((mpd = player_connection_get()) == NULL) {
         return -1;
     }
 
     struct mpd_status *status = mpd_run_status(mpd);
     if (status == NULL) {
         syslog(LOG_ERR, "Failed to get mpd status\n");
-        return -1;
+    }
+    else {
+        pos = mpd_status_get_song_pos(status);
+        mpd_status_free(status);
     }
 
-    int pos = mpd_status_get_song_pos(status);
-    
-    mpd_status_free(status);
-    mpd_connection_free(mpd);
+    player_connection_release(mpd);
 
     return pos;
 }
@@ -58,68 +135,58 @@ int player_get_current_song_nr() {
 void player_toggle() {
     struct mpd_connection *mpd;
 
-    mpd = mpd_connection_new("localhost", 6600, 0);
-    if (mpd == NULL || mpd_connection_get_error(mpd) != MPD_ERROR_SUCCESS) {
-        syslog(LOG_ERR, "Failed to connect to mpd\n");
+    if ((mpd = player_connection_get()) == NULL) {
         return;
     }
 
     mpd_run_toggle_pause(mpd);
 
-    mpd_connection_free(mpd);
+    player_connection_release(mpd);
 }
 
 void player_pause() {
     struct mpd_connection *mpd;
 
-    mpd = mpd_connection_new("localhost", 6600, 0);
-    if (mpd == NULL || mpd_connection_get_error(mpd) != MPD_ERROR_SUCCESS) {
-        syslog(LOG_ERR, "Failed to connect to mpd\n");
+    if ((mpd = player_connection_get()) == NULL) {
         return;
     }
 
     mpd_run_pause(mpd, true);
 
-    mpd_connection_free(mpd);
+    player_connection_release(mpd);
 }
 
 
 void player_next() {
     struct mpd_connection *mpd;
 
-    mpd = mpd_connection_new("localhost", 6600, 0);
-    if (mpd == NULL || mpd_connection_get_error(mpd) != MPD_ERROR_SUCCESS) {
-        syslog(LOG_ERR, "Failed to connect to mpd\n");
+    if ((mpd = player_connection_get()) == NULL) {
         return;
     }
 
     mpd_run_next(mpd);
 
-    mpd_connection_free(mpd);
+    player_connection_release(mpd);
 
 }
 
 void player_previous() {
     struct mpd_connection *mpd;
 
-    mpd = mpd_connection_new("localhost", 6600, 0);
-    if (mpd == NULL || mpd_connection_get_error(mpd) != MPD_ERROR_SUCCESS) {
-        syslog(LOG_ERR, "Failed to connect to mpd\n");
+    if ((mpd = player_connection_get()) == NULL) {
         return;
     }
 
     mpd_run_previous(mpd);
 
-    mpd_connection_free(mpd);
+    player_connection_release(mpd);
 }
 
 
 void player_play_uri(const char *uri) {
     struct mpd_connection *mpd;
 
-    mpd = mpd_connection_new("localhost", 6600, 0);
-    if (mpd == NULL || mpd_connection_get_error(mpd) != MPD_ERROR_SUCCESS) {
-        syslog(LOG_ERR, "Failed to connect to mpd\n");
+    if ((mpd = player_connection_get()) == NULL) {
         return;
     }
 
@@ -132,21 +199,72 @@ void player_play_uri(const char *uri) {
     syslog(LOG_NOTICE, "Playing playlist\n");
     mpd_run_play(mpd);
 
-    mpd_connection_free(mpd);
+    player_connection_release(mpd);
+}
+
+/**
+ * Append a URI to the playlist, start playing if the player is stopped
+ */
+void player_enqueue_uri(const char *uri) {
+    struct mpd_connection *mpd;
+
+    if ((mpd = player_connection_get()) == NULL) {
+        return;
+    }
+
+    syslog(LOG_NOTICE, "Appending URI to playlist: '%s'\n", uri);
+    mpd_run_add(mpd, uri);
+
+    struct mpd_status *status = mpd_run_status(mpd);
+    if (status != NULL) {
+        if (mpd_status_get_state(status) == MPD_STATE_STOP) {
+            mpd_run_play(mpd);
+        }
+        mpd_status_free(status);
+    }
+
+    player_connection_release(mpd);
 }
 
 void player_replay_playlist() {
     struct mpd_connection *mpd;
 
-    mpd = mpd_connection_new("localhost", 6600, 0);
-    if (mpd == NULL || mpd_connection_get_error(mpd) != MPD_ERROR_SUCCESS) {
-        syslog(LOG_ERR, "Failed to connect to mpd\n");
+    if ((mpd = player_connection_get()) == NULL) {
         return;
     }
 
     mpd_run_stop(mpd);
     mpd_run_play_pos(mpd, 0);
 
-    mpd_connection_free(mpd);
+    player_connection_release(mpd);
+
+}
+
+
+/**
+ * How far mpd has got into the song it is playing
+ *
+ * @param int*      song_nr     Set to the song's position in the playlist
+ * @return int      Elapsed ms, -1 if mpd is not playing
+ */
+int player_get_elapsed_ms(int *song_nr) {
+    struct mpd_connection *mpd;
+    int elapsed_ms = -1;
+
+    if ((mpd = player_connection_get()) == NULL) {
+        return -1;
+    }
+
+    struct mpd_status *status = mpd_run_status(mpd);
+    if (status != NULL) {
+        if (mpd_status_get_state(status) == MPD_STATE_PLAY) {
+            elapsed_ms = mpd_status_get_elapsed_ms(status);
+            *song_nr = mpd_status_get_song_pos(status);
+        }
+        mpd_status_free(status);
+    }
+
+    player_connection_release(mpd);
 
+    return elapsed_ms;
 }
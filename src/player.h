@@ -1,13 +1,27 @@
 #ifndef __PLAYER_H__
 #define __PLAYER_H__
 
+#include <stdbool.h>
+
+#define PLAYER_MPD_HOST "localhost"
+#define PLAYER_MPD_PORT 6600
+
+struct mpd_connection;
+
+struct mpd_connection *player_connection_get();
+void player_connection_release(struct mpd_connection *mpd);
+void player_close();
+
 int player_get_current_song_nr();
 void player_toggle();
 void player_pause();
 void player_next();
 void player_previous();
 void player_play_uri(const char *uri);
+void player_enqueue_uri(const char *uri);
 bool player_is_playing();
+int player_get_state();
 void player_replay_playlist();
+int player_get_elapsed_ms(int *song_nr);
 
 #endif
@@ -0,0 +1,173 @@
+/**
+ * Receiver gain calibration
+ *
+ * How well a card is heard depends on the case and where the antenna sits
+ * in it, so the MFRC522's default gain of 33 dB may cost several taps per
+ * card. The calibration taps a reference card lying on the reader with
+ * every gain setting and picks the one that reads it most reliably.
+ *
+ * @package kiddyblaster
+ */
+#include <stdio.h>
+#include <syslog.h>
+
+#include "rx_gain.h"
+
+static const byte settings[RX_GAIN_SETTINGS] = {
+    RxGain_18dB, RxGain_23dB, RxGain_33dB, RxGain_38dB, RxGain_43dB, RxGain_48dB
+};
+
+
+
+int rx_gain_db(byte gain) {
+    static const int db[8] = { 18, 23, 18, 23, 33, 38, 43, 48 };
+    return db[(gain >> 4) & 0x07];
+}
+
+
+
+/**
+ * Tap the card in the field `attempts` times with the given gain: wake it
+ * up, select it, authenticate and read `block`, like the daemon does
+ *
+ * @param byte          gain        RxGain mask
+ * @param MIFARE_Key*   key         Key A of the block's sector
+ * @param byte          block
+ * @param unsigned int  attempts
+ * @param RxGainStats*  stats       Receives the success counts per step
+ */
+void rx_gain_measure(byte gain, MIFARE_Key *key, byte block, unsigned int attempts, RxGainStats *stats) {
+    Uid card;
+    byte atqa[2], data[18], size, result;
+    unsigned int i;
+
+    stats->gain = gain;
+    stats->attempts = attempts;
+    stats->reqa_ok = stats->select_ok = stats->auth_ok = stats->read_ok = 0;
+
+    mfrc522_pcd_set_antenna_gain(gain);
+
+    for (i = 0; i < attempts; i++) {
+        size = sizeof(atqa);
+        result = mfrc522_picc_wakeup_a(atqa, &size);
+        if (result != STATUS_OK && result != STATUS_COLLISION) {
+            continue;
+        }
+        stats->reqa_ok++;
+
+        if (mfrc522_picc_select(&card, 0) != STATUS_OK) {
+            continue;
+        }
+        stats->select_ok++;
+
+        if (mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, block, key, &card) == STATUS_OK) {
+            stats->auth_ok++;
+            size = sizeof(data);
+            if (mfrc522_mifare_read(block, data, &size) == STATUS_OK && size == 18) {
+                stats->read_ok++;
+            }
+            mfrc522_pcd_stop_crypto_1();
+        }
+        mfrc522_picc_halt_a();
+    }
+}
+
+
+
+/**
+ * Measure all gain settings and leave the reader at the best one. Of the
+ * settings reading the card equally often, the middle one is taken to keep
+ * some margin on both sides.
+ *
+ * @param MIFARE_Key*   key
+ * @param byte          block
+ * @param unsigned int  attempts    Per setting
+ * @param RxGainStats*  results     RX_GAIN_SETTINGS entries, may be NULL
+ * @return int          The best RxGain mask, -1 if the card could not be read at all
+ */
+int rx_gain_calibrate(MIFARE_Key *key, byte block, unsigned int attempts, RxGainStats *results) {
+    RxGainStats stats[RX_GAIN_SETTINGS];
+    unsigned int i, best_read = 0, first = 0, last = 0;
+
+    for (i = 0; i < RX_GAIN_SETTINGS; i++) {
+        rx_gain_measure(settings[i], key, block, attempts, &stats[i]);
+        if (stats[i].read_ok > best_read) {
+            best_read = stats[i].read_ok;
+            first = last = i;
+        }
+        else if (stats[i].read_ok == best_read && last == i - 1) {
+            last = i;
+        }
+        if (results != NULL) {
+            results[i] = stats[i];
+        }
+    }
+
+    if (best_read == 0) {
+        return -1;
+    }
+    byte best = settings[(first + last) / 2];
+    mfrc522_pcd_set_antenna_gain(best);
+    return best;
+}
+
+
+
+/**
+ * Mean number of taps until a card plays, the polls until the first
+ * successful read
+ *
+ * @return double   0 if the card could not be read at all
+ */
+double rx_gain_taps_to_play(RxGainStats *stats) {
+    return stats->read_ok > 0 ? (double)stats->attempts / stats->read_ok : 0;
+}
+
+
+
+void rx_gain_report(const char *label, RxGainStats *stats) {
+    syslog(LOG_NOTICE, "RxGain %s %d dB: REQA %u/%u, select %u, auth %u, read %u (%u%%), %.2f taps to play\n",
+        label,
+        rx_gain_db(stats->gain),
+        stats->reqa_ok,
+        stats->attempts,
+        stats->select_ok,
+        stats->auth_ok,
+        stats->read_ok,
+        stats->attempts > 0 ? stats->read_ok * 100 / stats->attempts : 0,
+        rx_gain_taps_to_play(stats)
+    );
+}
+
+
+
+/**
+ * @return int      The RxGain mask stored in `path`, -1 if there is none
+ */
+int rx_gain_load(const char *path) {
+    FILE *fp = fopen(path, "r");
+    unsigned int gain;
+    int ret = -1;
+
+    if (fp == NULL) {
+        return -1;
+    }
+    if (fscanf(fp, "%x", &gain) == 1 && (gain & ~0x70) == 0) {
+        ret = gain;
+    }
+    fclose(fp);
+    return ret;
+}
+
+
+
+bool rx_gain_save(const char *path, byte gain) {
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        syslog(LOG_ERR, "Failed to write %s\n", path);
+        return false;
+    }
+    fprintf(fp, "%02x\n", gain);
+    fclose(fp);
+    return true;
+}
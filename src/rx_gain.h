@@ -0,0 +1,35 @@
+#ifndef __RX_GAIN_H__
+#define __RX_GAIN_H__
+
+#include "mfrc522.h"
+
+// Where the calibrated gain is kept across restarts, `.<reader name>` is appended
+#define RX_GAIN_FILE "/var/lib/kiddyblaster/rxgain"
+
+// Tap attempts per gain setting when calibrating
+#define RX_GAIN_ATTEMPTS 20
+
+// Distinct gain settings, 010b and 011b duplicate 000b and 001b
+#define RX_GAIN_SETTINGS 6
+
+/*
+ * Outcome of the tap attempts with one receiver gain setting
+ */
+typedef struct {
+    byte gain;                  // RxGain mask, see enum PCD_RxGain
+    unsigned int attempts;
+    unsigned int reqa_ok;
+    unsigned int select_ok;
+    unsigned int auth_ok;
+    unsigned int read_ok;
+} RxGainStats;
+
+int rx_gain_db(byte gain);
+void rx_gain_measure(byte gain, MIFARE_Key *key, byte block, unsigned int attempts, RxGainStats *stats);
+int rx_gain_calibrate(MIFARE_Key *key, byte block, unsigned int attempts, RxGainStats *results);
+double rx_gain_taps_to_play(RxGainStats *stats);
+void rx_gain_report(const char *label, RxGainStats *stats);
+int rx_gain_load(const char *path);
+bool rx_gain_save(const char *path, byte gain);
+
+#endif
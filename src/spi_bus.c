@@ -0,0 +1,84 @@
+/**
+ * SPI transport used by the MFRC522 driver
+ *
+ * @package kiddyblaster
+ */
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "spi_bus.h"
+
+
+
+int spi_bus_transfer(SpiBus *bus, SpiTransfer *xfers, unsigned int count) {
+    if (count == 0) {
+        return 0;
+    }
+    return bus->transfer(bus, xfers, count);
+}
+
+
+
+/**
+ * Transfer a single frame
+ */
+int spi_bus_frame(SpiBus *bus, const uint8_t *tx, uint8_t *rx, unsigned int len) {
+    SpiTransfer xfer = { tx, rx, len };
+    return bus->transfer(bus, &xfer, 1);
+}
+
+
+
+void spi_bus_set_reset(SpiBus *bus, int level) {
+    if (bus->set_reset != NULL) {
+        bus->set_reset(bus, level);
+    }
+}
+
+
+
+/**
+ * Buses without a reset line report it as high, so the driver
+ * falls back to a soft reset
+ */
+int spi_bus_get_reset(SpiBus *bus) {
+    return bus->get_reset != NULL ? bus->get_reset(bus) : 1;
+}
+
+
+
+void spi_bus_delay(SpiBus *bus, unsigned int millis) {
+    if (bus->delay != NULL) {
+        bus->delay(bus, millis);
+    }
+    else {
+        usleep(millis * 1000);
+    }
+}
+
+
+
+uint64_t spi_monotonic_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+
+uint64_t spi_bus_now(SpiBus *bus) {
+    return bus->now != NULL ? bus->now(bus) : spi_monotonic_now();
+}
+
+
+
+void spi_bus_free(SpiBus *bus) {
+    if (bus == NULL) {
+        return;
+    }
+    if (bus->free != NULL) {
+        bus->free(bus);
+    }
+    free(bus);
+}
@@ -0,0 +1,65 @@
+/**
+ * SPI transport used by the MFRC522 driver
+ *
+ * The driver only ever talks to a SpiBus, so the same code runs on the
+ * kernel's spidev driver, against a simulated MFRC522 or replays a recorded
+ * session.
+ *
+ * @package kiddyblaster
+ */
+#ifndef __SPI_BUS_H__
+#define __SPI_BUS_H__
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * One full-duplex frame, chip select is asserted for the whole frame.
+ * `rx` may point to the same buffer as `tx`.
+ */
+typedef struct {
+    const uint8_t *tx;
+    uint8_t *rx;
+    unsigned int len;
+} SpiTransfer;
+
+typedef struct SpiBus SpiBus;
+
+struct SpiBus {
+    const char *name;
+
+    // Transfer `count` frames in order, returns 0 on success
+    int (*transfer)(SpiBus *bus, SpiTransfer *xfers, unsigned int count);
+
+    // Level of the reader's reset (NRSTPD) line
+    void (*set_reset)(SpiBus *bus, int level);
+    int (*get_reset)(SpiBus *bus);
+
+    void (*delay)(SpiBus *bus, unsigned int millis);
+
+    // Microseconds on the bus' clock, NULL for CLOCK_MONOTONIC
+    uint64_t (*now)(SpiBus *bus);
+
+    void (*free)(SpiBus *bus);
+
+    void *priv;
+};
+
+int spi_bus_transfer(SpiBus *bus, SpiTransfer *xfers, unsigned int count);
+int spi_bus_frame(SpiBus *bus, const uint8_t *tx, uint8_t *rx, unsigned int len);
+void spi_bus_set_reset(SpiBus *bus, int level);
+int spi_bus_get_reset(SpiBus *bus);
+void spi_bus_delay(SpiBus *bus, unsigned int millis);
+uint64_t spi_bus_now(SpiBus *bus);
+void spi_bus_free(SpiBus *bus);
+
+uint64_t spi_monotonic_now();
+
+// Backends
+SpiBus *spi_spidev_new(const char *device, uint32_t speed_hz, int reset_gpio);
+
+// Record all traffic of `inner` to `path`, replay it later without hardware
+SpiBus *spi_trace_record_new(SpiBus *inner, const char *path);
+SpiBus *spi_trace_replay_new(const char *path);
+
+#endif
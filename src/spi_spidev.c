@@ -0,0 +1,184 @@
+/**
+ * SPI transport over the kernel's spidev driver (/dev/spidevB.C)
+ *
+ * @package kiddyblaster
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+#include <linux/gpio.h>
+
+#include "spi_bus.h"
+
+// Upper bound of frames handed to the kernel with one ioctl
+#define SPIDEV_MAX_XFERS 32
+
+#define SPIDEV_GPIO_CHIP "/dev/gpiochip0"
+
+typedef struct {
+    int fd;
+    uint32_t speed_hz;
+    int reset_gpio;
+    int reset_fd;           // Line handle of the reset GPIO, -1 if none
+    int reset_level;
+} SpidevPriv;
+
+
+
+static int spidev_transfer(SpiBus *bus, SpiTransfer *xfers, unsigned int count) {
+    SpidevPriv *priv = bus->priv;
+    struct spi_ioc_transfer msg[SPIDEV_MAX_XFERS];
+    unsigned int i, n;
+
+    while (count > 0) {
+        n = count < SPIDEV_MAX_XFERS ? count : SPIDEV_MAX_XFERS;
+        memset(msg, 0, sizeof(msg[0]) * n);
+        for (i = 0; i < n; i++) {
+            msg[i].tx_buf = (unsigned long)xfers[i].tx;
+            msg[i].rx_buf = (unsigned long)xfers[i].rx;
+            msg[i].len = xfers[i].len;
+            msg[i].speed_hz = priv->speed_hz;
+            msg[i].bits_per_word = 8;
+            // Release chip select between frames, the MFRC522 takes the
+            // first byte after CS goes low as the address
+            msg[i].cs_change = (i < n - 1);
+        }
+        if (ioctl(priv->fd, SPI_IOC_MESSAGE(n), msg) < 0) {
+            syslog(LOG_ERR, "SPI_IOC_MESSAGE failed\n");
+            return -1;
+        }
+        xfers += n;
+        count -= n;
+    }
+    return 0;
+}
+
+
+
+static void spidev_set_reset(SpiBus *bus, int level) {
+    SpidevPriv *priv = bus->priv;
+    struct gpiohandle_data data;
+
+    if (priv->reset_fd < 0) {
+        return;
+    }
+    memset(&data, 0, sizeof(data));
+    data.values[0] = level ? 1 : 0;
+    if (ioctl(priv->reset_fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) < 0) {
+        syslog(LOG_ERR, "Failed to set reset line\n");
+        return;
+    }
+    priv->reset_level = data.values[0];
+}
+
+
+
+static int spidev_get_reset(SpiBus *bus) {
+    SpidevPriv *priv = bus->priv;
+    return priv->reset_fd < 0 ? 1 : priv->reset_level;
+}
+
+
+
+/**
+ * Request a line through the GPIO character device, an output starts low
+ *
+ * @param int       gpio
+ * @param uint32_t  flags   GPIOHANDLE_REQUEST_*
+ * @return int      The line handle or -1
+ */
+static int request_line(int gpio, uint32_t flags) {
+    struct gpiohandle_request req;
+    int chip = open(SPIDEV_GPIO_CHIP, O_RDWR);
+
+    if (chip < 0) {
+        syslog(LOG_ERR, "Failed to open %s\n", SPIDEV_GPIO_CHIP);
+        return -1;
+    }
+
+    memset(&req, 0, sizeof(req));
+    req.lineoffsets[0] = gpio;
+    req.lines = 1;
+    req.flags = flags;
+    req.default_values[0] = 0;
+    strncpy(req.consumer_label, "kiddyblaster-rfid", sizeof(req.consumer_label) - 1);
+
+    int ret = ioctl(chip, GPIO_GET_LINEHANDLE_IOCTL, &req);
+    close(chip);
+    if (ret < 0) {
+        syslog(LOG_ERR, "Failed to request GPIO %d\n", gpio);
+        return -1;
+    }
+    return req.fd;
+}
+
+
+
+static void spidev_free(SpiBus *bus) {
+    SpidevPriv *priv = bus->priv;
+    int fd;
+
+    // A line handle that is closed keeps driving its last level, give the
+    // line back as an input so that nothing is held in reset
+    if (priv->reset_fd >= 0) {
+        close(priv->reset_fd);
+        if ((fd = request_line(priv->reset_gpio, GPIOHANDLE_REQUEST_INPUT)) >= 0) {
+            close(fd);
+        }
+    }
+    close(priv->fd);
+    free(priv);
+}
+
+
+
+/**
+ * Open a spidev device, e.g. "/dev/spidev0.0"
+ *
+ * Needs no root, only access to the device nodes (group spi and gpio on
+ * Raspbian). Without a reset GPIO, NRSTPD must be held high externally; the
+ * driver then falls back to a soft reset.
+ *
+ * @param const char*   device
+ * @param uint32_t      speed_hz
+ * @param int           reset_gpio      BCM number of the GPIO wired to NRSTPD, -1 for none
+ * @return SpiBus*      NULL if the device could not be opened
+ */
+SpiBus *spi_spidev_new(const char *device, uint32_t speed_hz, int reset_gpio) {
+    uint8_t mode = SPI_MODE_0, bits = 8;
+    int fd = open(device, O_RDWR);
+
+    if (fd < 0) {
+        syslog(LOG_ERR, "Failed to open %s\n", device);
+        return NULL;
+    }
+
+    if (ioctl(fd, SPI_IOC_WR_MODE, &mode) < 0 ||
+        ioctl(fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+        ioctl(fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed_hz) < 0) {
+        syslog(LOG_ERR, "Failed to configure %s\n", device);
+        close(fd);
+        return NULL;
+    }
+
+    SpidevPriv *priv = malloc(sizeof(SpidevPriv));
+    priv->fd = fd;
+    priv->speed_hz = speed_hz;
+    priv->reset_gpio = reset_gpio;
+    // Starts low so the first mfrc522_pcd_init() does a hard reset
+    priv->reset_fd = (reset_gpio >= 0) ? request_line(reset_gpio, GPIOHANDLE_REQUEST_OUTPUT) : -1;
+    priv->reset_level = 0;
+
+    SpiBus *bus = calloc(1, sizeof(SpiBus));
+    bus->name = "spidev";
+    bus->transfer = spidev_transfer;
+    bus->set_reset = spidev_set_reset;
+    bus->get_reset = spidev_get_reset;
+    bus->free = spidev_free;
+    bus->priv = priv;
+    return bus;
+}
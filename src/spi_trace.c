@@ -0,0 +1,360 @@
+/**
+ * Record and replay SPI sessions
+ *
+ * A trace is a text file with one event per line:
+ *
+ *     <usec> X <tx hex> <rx hex>     one frame
+ *     <usec> R <level>               reset line set
+ *     <usec> G <level>               reset line read
+ *     <usec> D <millis>              delay
+ *
+ * where <usec> is the time since the start of the recording. Replaying a
+ * trace hands the recorded bytes back to the driver as long as it sends
+ * exactly what was recorded, and reports the recorded time as the bus'
+ * clock, so a session captured on the box runs deterministically anywhere.
+ *
+ * @package kiddyblaster
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <syslog.h>
+
+#include "spi_bus.h"
+
+// Frames passed on to the recorded bus with one transfer
+#define TRACE_BATCH 16
+
+typedef struct {
+    SpiBus *inner;
+    FILE *fp;
+    uint64_t t0;
+} RecordPriv;
+
+typedef struct {
+    char type;
+    uint64_t t;
+    unsigned int value;     // level or millis
+    uint8_t *tx, *rx;       // frames only
+    unsigned int len;
+} TraceEvent;
+
+typedef struct {
+    TraceEvent *events;
+    unsigned int n_events;
+    unsigned int pos;
+    uint64_t now;
+    bool failed;            // Diverged from the trace, everything fails from here on
+} ReplayPriv;
+
+
+
+static void write_hex(FILE *fp, const uint8_t *data, unsigned int len) {
+    unsigned int i;
+    for (i = 0; i < len; i++) {
+        fprintf(fp, "%02x", data[i]);
+    }
+}
+
+
+
+static uint64_t record_time(RecordPriv *priv) {
+    return spi_bus_now(priv->inner) - priv->t0;
+}
+
+
+
+static int record_transfer(SpiBus *bus, SpiTransfer *xfers, unsigned int count) {
+    RecordPriv *priv = bus->priv;
+    SpiTransfer copies[TRACE_BATCH];
+    uint8_t tx[TRACE_BATCH][256], rx[TRACE_BATCH][256];
+    unsigned int i, n;
+    int ret;
+
+    // Frames go through scratch buffers: `rx` may be missing or overwrite
+    // `tx`, and both have to end up in the trace. The batch is handed on as
+    // it is, so the recorded timing is the one of the real transfer.
+    while (count > 0) {
+        n = count < TRACE_BATCH ? count : TRACE_BATCH;
+        for (i = 0; i < n; i++) {
+            if (xfers[i].len > sizeof(tx[i])) {
+                return -1;
+            }
+            memcpy(tx[i], xfers[i].tx, xfers[i].len);
+            copies[i] = (SpiTransfer){ tx[i], rx[i], xfers[i].len };
+        }
+
+        if ((ret = spi_bus_transfer(priv->inner, copies, n)) != 0) {
+            return ret;
+        }
+
+        uint64_t t = record_time(priv);
+        for (i = 0; i < n; i++) {
+            if (xfers[i].rx != NULL) {
+                memcpy(xfers[i].rx, rx[i], xfers[i].len);
+            }
+            fprintf(priv->fp, "%llu X ", (unsigned long long)t);
+            write_hex(priv->fp, tx[i], copies[i].len);
+            fputc(' ', priv->fp);
+            write_hex(priv->fp, rx[i], copies[i].len);
+            fputc('\n', priv->fp);
+        }
+        xfers += n;
+        count -= n;
+    }
+    return 0;
+}
+
+
+
+static void record_set_reset(SpiBus *bus, int level) {
+    RecordPriv *priv = bus->priv;
+    spi_bus_set_reset(priv->inner, level);
+    fprintf(priv->fp, "%llu R %d\n", (unsigned long long)record_time(priv), level ? 1 : 0);
+}
+
+
+
+static int record_get_reset(SpiBus *bus) {
+    RecordPriv *priv = bus->priv;
+    int level = spi_bus_get_reset(priv->inner) ? 1 : 0;
+    fprintf(priv->fp, "%llu G %d\n", (unsigned long long)record_time(priv), level);
+    return level;
+}
+
+
+
+static void record_delay(SpiBus *bus, unsigned int millis) {
+    RecordPriv *priv = bus->priv;
+    fprintf(priv->fp, "%llu D %u\n", (unsigned long long)record_time(priv), millis);
+    spi_bus_delay(priv->inner, millis);
+}
+
+
+
+static uint64_t record_now(SpiBus *bus) {
+    RecordPriv *priv = bus->priv;
+    return spi_bus_now(priv->inner);
+}
+
+
+
+static void record_free(SpiBus *bus) {
+    RecordPriv *priv = bus->priv;
+    fclose(priv->fp);
+    spi_bus_free(priv->inner);
+    free(priv);
+}
+
+
+
+/**
+ * Wrap a bus and write everything going over it to a trace file
+ *
+ * @param SpiBus*       inner   The bus to record, owned by the returned bus
+ * @param const char*   path
+ * @return SpiBus*      NULL if the trace file could not be opened
+ */
+SpiBus *spi_trace_record_new(SpiBus *inner, const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (fp == NULL) {
+        syslog(LOG_ERR, "Failed to open trace file %s\n", path);
+        return NULL;
+    }
+
+    RecordPriv *priv = malloc(sizeof(RecordPriv));
+    priv->inner = inner;
+    priv->fp = fp;
+    priv->t0 = spi_bus_now(inner);
+
+    SpiBus *bus = calloc(1, sizeof(SpiBus));
+    bus->name = "record";
+    bus->transfer = record_transfer;
+    bus->set_reset = record_set_reset;
+    bus->get_reset = record_get_reset;
+    bus->delay = record_delay;
+    bus->now = record_now;
+    bus->free = record_free;
+    bus->priv = priv;
+    return bus;
+}
+
+
+
+static int parse_hex(const char *str, uint8_t *out, unsigned int max) {
+    unsigned int n = 0, byte;
+    while (str[0] && str[1] && n < max) {
+        if (sscanf(str, "%2x", &byte) != 1) {
+            return -1;
+        }
+        out[n++] = byte;
+        str += 2;
+    }
+    return n;
+}
+
+
+
+/**
+ * Take the next event from the trace, it must be of the given type
+ */
+static TraceEvent *replay_next(ReplayPriv *priv, char type) {
+    if (priv->failed) {
+        return NULL;
+    }
+    if (priv->pos >= priv->n_events) {
+        syslog(LOG_ERR, "SPI replay: trace exhausted\n");
+        priv->failed = true;
+        return NULL;
+    }
+    TraceEvent *ev = &priv->events[priv->pos];
+    if (ev->type != type) {
+        syslog(LOG_ERR, "SPI replay: expected '%c' but trace has '%c' at event %u\n", type, ev->type, priv->pos);
+        priv->failed = true;
+        return NULL;
+    }
+    priv->pos++;
+    priv->now = ev->t;
+    return ev;
+}
+
+
+
+static int replay_transfer(SpiBus *bus, SpiTransfer *xfers, unsigned int count) {
+    ReplayPriv *priv = bus->priv;
+    unsigned int i;
+
+    for (i = 0; i < count; i++) {
+        TraceEvent *ev = replay_next(priv, 'X');
+        if (ev == NULL) {
+            return -1;
+        }
+        if (ev->len != xfers[i].len || memcmp(ev->tx, xfers[i].tx, ev->len) != 0) {
+            syslog(LOG_ERR, "SPI replay: driver diverged from trace at event %u\n", priv->pos - 1);
+            priv->failed = true;
+            return -1;
+        }
+        if (xfers[i].rx != NULL) {
+            memcpy(xfers[i].rx, ev->rx, ev->len);
+        }
+    }
+    return 0;
+}
+
+
+
+/*
+ * The driver has to do what it did when recording, down to the value
+ */
+static void replay_check(ReplayPriv *priv, char type, unsigned int value) {
+    TraceEvent *ev = replay_next(priv, type);
+
+    if (ev != NULL && ev->value != value) {
+        syslog(LOG_ERR, "SPI replay: driver diverged from trace at event %u\n", priv->pos - 1);
+        priv->failed = true;
+    }
+}
+
+
+
+static void replay_set_reset(SpiBus *bus, int level) {
+    replay_check(bus->priv, 'R', level ? 1 : 0);
+}
+
+
+
+static int replay_get_reset(SpiBus *bus) {
+    TraceEvent *ev = replay_next(bus->priv, 'G');
+    return ev != NULL ? ev->value : 1;
+}
+
+
+
+static void replay_delay(SpiBus *bus, unsigned int millis) {
+    replay_check(bus->priv, 'D', millis);
+}
+
+
+
+static uint64_t replay_now(SpiBus *bus) {
+    ReplayPriv *priv = bus->priv;
+    return priv->now;
+}
+
+
+
+static void replay_free(SpiBus *bus) {
+    ReplayPriv *priv = bus->priv;
+    unsigned int i;
+    for (i = 0; i < priv->n_events; i++) {
+        free(priv->events[i].tx);
+    }
+    free(priv->events);
+    free(priv);
+}
+
+
+
+/**
+ * Load a trace file recorded with spi_trace_record_new()
+ *
+ * @param const char*   path
+ * @return SpiBus*      NULL if the trace could not be read
+ */
+SpiBus *spi_trace_replay_new(const char *path) {
+    FILE *fp = fopen(path, "r");
+    char *line = NULL, type, tx[600], rx[600];
+    size_t size = 0;
+    unsigned long long t;
+    unsigned int value, capacity = 0;
+
+    if (fp == NULL) {
+        syslog(LOG_ERR, "Failed to open trace file %s\n", path);
+        return NULL;
+    }
+
+    ReplayPriv *priv = calloc(1, sizeof(ReplayPriv));
+
+    while (getline(&line, &size, fp) > 0) {
+        if (sscanf(line, "%llu %c", &t, &type) != 2) {
+            continue;
+        }
+        if (priv->n_events == capacity) {
+            capacity = capacity ? capacity * 2 : 1024;
+            priv->events = realloc(priv->events, capacity * sizeof(TraceEvent));
+        }
+
+        TraceEvent *ev = &priv->events[priv->n_events];
+        memset(ev, 0, sizeof(TraceEvent));
+        ev->type = type;
+        ev->t = t;
+
+        if (type == 'X') {
+            if (sscanf(line, "%*u %*c %599s %599s", tx, rx) != 2) {
+                continue;
+            }
+            ev->len = strlen(tx) / 2;
+            ev->tx = malloc(ev->len * 2);
+            ev->rx = ev->tx + ev->len;
+            parse_hex(tx, ev->tx, ev->len);
+            parse_hex(rx, ev->rx, ev->len);
+        }
+        else if (sscanf(line, "%*u %*c %u", &value) == 1) {
+            ev->value = value;
+        }
+        priv->n_events++;
+    }
+    free(line);
+    fclose(fp);
+
+    SpiBus *bus = calloc(1, sizeof(SpiBus));
+    bus->name = "replay";
+    bus->transfer = replay_transfer;
+    bus->set_reset = replay_set_reset;
+    bus->get_reset = replay_get_reset;
+    bus->delay = replay_delay;
+    bus->now = replay_now;
+    bus->free = replay_free;
+    bus->priv = priv;
+    return bus;
+}
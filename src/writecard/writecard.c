@@ -7,7 +7,7 @@
  *
  * Compile with
  * ```
- * gcc -o writecard src/writecard.c src/card.c src/mfrc522.c -lsqlite3 -lbcm2835 -lpigpio
+ * gcc -o writecard src/writecard/writecard.c src/card.c src/mfrc522.c src/spi_bus.c src/spi_spidev.c -lsqlite3
  * ```
  */
 #include <stdio.h>
@@ -19,11 +19,10 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <errno.h>
-#include "../bcm2835.h" 
 #include "../mfrc522.h"
+#include "../card_reader.h"
 #include "../card.h"
 
-extern Uid uid;
 const char *path_to_uri(const char *_path);
 
 // This is the default key for authentication
@@ -105,8 +104,7 @@ int write_card(const char *name, const char *_uri) {
 
     for(i = 0; i < 1000 ; i++) {
 
-        /* gpioDelay(500000); */
-        bcm2835_delay(500);
+        usleep(500000);
 
         printf(".");
         fflush(stdout);
@@ -121,7 +119,7 @@ int write_card(const char *name, const char *_uri) {
         }
 
         // Authenticate
-        if (mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, 8, &auth_key, &uid) != STATUS_OK) {
+        if (mfrc522_pcd_authenticate(PICC_CMD_MF_AUTH_KEY_A, 8, &auth_key, &mfrc522_current()->uid) != STATUS_OK) {
             fprintf(stderr, "Failed to authenticate\n");
             continue;
         }
@@ -272,8 +270,12 @@ int main(int argc, char **argv) {
 
 
     // Init MFRC522 (RFID card reader)
-    // (which also initializes bcm2835 lib)
-    mfrc522_init();
+    SpiBus *bus = spi_spidev_new(CARD_READER_SPI_DEVICE, CARD_READER_SPI_SPEED, CARD_READER_RESET_GPIO);
+    if (bus == NULL) {
+        fprintf(stderr, "Failed to open SPI bus\n");
+        return -1;
+    }
+    mfrc522_init(bus);
     mfrc522_pcd_init();
 
     name = argv[1];
@@ -286,7 +288,7 @@ int main(int argc, char **argv) {
 
 
     /* gpioTerminate(); */
-    bcm2835_close();
+    mfrc522_close();
 
     return 0;
 }